@@ -0,0 +1,202 @@
+#include "AutomationEngine.h"
+#include "WiFiManager.h"
+#include "BTManager.h"
+#include "ScriptJobManager.h"
+#include "LogManager.h"
+
+enum AutomationTrigger {
+  TRIGGER_WIFI_CLIENT_CHANGE,
+  TRIGGER_WIFI_CLIENT_CONNECT,
+  TRIGGER_WIFI_CLIENT_DISCONNECT,
+  TRIGGER_BT_CLIENT_CHANGE,
+  TRIGGER_BT_CLIENT_CONNECT,
+  TRIGGER_BT_CLIENT_DISCONNECT,
+  TRIGGER_SSID_CHANGE,
+  TRIGGER_BT_FOUND,
+  TRIGGER_COUNT
+};
+
+enum AutomationAction {
+  ACTION_RUN_SCRIPT,
+  ACTION_WIFI_OFF,
+  ACTION_WIFI_ON,
+  ACTION_BT_OFF,
+  ACTION_BT_ON
+};
+
+struct AutomationRule {
+  String key;           // Declaring keyword; re-declaring replaces the rule
+  String subject;       // SSID or BLE name fragment, empty for client triggers
+  bool expectPresent;   // SSID rules: fire on appear (IS_ONLINE) or disappear
+  AutomationAction action;
+  String script;        // ACTION_RUN_SCRIPT target under DIR_SCRIPTS
+};
+
+struct ClientRuleKey {
+  const char* key;
+  AutomationTrigger trigger;
+  const char* script;
+};
+
+// The unsuffixed keys cover both transports, as they always have
+static const ClientRuleKey CLIENT_RULE_KEYS[] = {
+  {"IF_CLIENT_CONNECTED_DISCONNECTED_WIFI", TRIGGER_WIFI_CLIENT_CHANGE, "wifi_change.txt"},
+  {"IF_CLIENT_CONNECTED_DISCONNECTED_BLUETOOTH", TRIGGER_BT_CLIENT_CHANGE, "bt_change.txt"},
+  {"IF_CLIENT_CONNECTED_DISCONNECTED", TRIGGER_WIFI_CLIENT_CHANGE, "wifi_change.txt"},
+  {"IF_CLIENT_CONNECTED_DISCONNECTED", TRIGGER_BT_CLIENT_CHANGE, "bt_change.txt"},
+  {"IF_CLIENT_CONNECTED_WIFI", TRIGGER_WIFI_CLIENT_CONNECT, "wifi_connect.txt"},
+  {"IF_CLIENT_CONNECTED_BLUETOOTH", TRIGGER_BT_CLIENT_CONNECT, "bt_connect.txt"},
+  {"IF_CLIENT_CONNECTED", TRIGGER_WIFI_CLIENT_CONNECT, "wifi_connect.txt"},
+  {"IF_CLIENT_CONNECTED", TRIGGER_BT_CLIENT_CONNECT, "bt_connect.txt"},
+  {"IF_CLIENT_DISCONNECTED_WIFI", TRIGGER_WIFI_CLIENT_DISCONNECT, "wifi_disconnect.txt"},
+  {"IF_CLIENT_DISCONNECTED_BLUETOOTH", TRIGGER_BT_CLIENT_DISCONNECT, "bt_disconnect.txt"},
+  {"IF_CLIENT_DISCONNECTED", TRIGGER_WIFI_CLIENT_DISCONNECT, "wifi_disconnect.txt"},
+  {"IF_CLIENT_DISCONNECTED", TRIGGER_BT_CLIENT_DISCONNECT, "bt_disconnect.txt"},
+};
+
+static std::vector<AutomationRule> rulesByTrigger[TRIGGER_COUNT];
+static bool watchListDirty = true;
+
+// SSID transitions from the scan service, applied on the next automation tick
+static std::vector<std::pair<String, bool>> pendingSSIDChanges;
+
+static void onSSIDChange(const String& ssid, bool present) {
+  pendingSSIDChanges.push_back({ssid, present});
+}
+
+static void addRule(AutomationTrigger trigger, const AutomationRule& rule) {
+  std::vector<AutomationRule>& rules = rulesByTrigger[trigger];
+  for (AutomationRule& existing : rules) {
+    if (existing.key == rule.key) {
+      existing = rule;
+      return;
+    }
+  }
+  rules.push_back(rule);
+}
+
+static String quotedValue(const String& value) {
+  int q1 = value.indexOf('"') + 1, q2 = value.indexOf('"', q1);
+  if (q1 > 0 && q2 > q1) return value.substring(q1, q2);
+  String plain = value;
+  plain.trim();
+  return plain;
+}
+
+bool declareAutomationRule(String key, String value) {
+  key.trim();
+
+  if (key.startsWith("IF_CLIENT_")) {
+    bool matched = false;
+    for (const ClientRuleKey& entry : CLIENT_RULE_KEYS) {
+      if (key != entry.key) continue;
+      // One rule per client trigger: the generic and specific keys run the same file
+      addRule(entry.trigger, {entry.script, "", true, ACTION_RUN_SCRIPT, entry.script});
+      matched = true;
+    }
+    return matched;
+  }
+
+  if (key.endsWith("_WHEN_WIFI")) {
+    AutomationRule rule;
+    rule.key = key;
+    rule.subject = quotedValue(value);
+    rule.expectPresent = (value.indexOf("IS_ONLINE") != -1);
+    if (key == "WIFI_OFF_WHEN_WIFI") rule.action = ACTION_WIFI_OFF;
+    else if (key == "WIFI_ON_WHEN_WIFI") rule.action = ACTION_WIFI_ON;
+    else if (key == "BLUETOOTH_OFF_WHEN_WIFI") rule.action = ACTION_BT_OFF;
+    else if (key == "BLUETOOTH_ON_WHEN_WIFI") rule.action = ACTION_BT_ON;
+    else return false;
+    if (rule.subject.length() == 0) return false;
+    addRule(TRIGGER_SSID_CHANGE, rule);
+    watchListDirty = true;
+    return true;
+  }
+
+  if (key == "RUN_WHEN_BLUETOOTH_FOUND" || key == "RUN_WHEN_BT_FOUND" || key == "BT_FOUND") {
+    String name = quotedValue(value);
+    if (name.length() == 0) return false;
+    // BTManager matches a single name in its scan callback; the latest declaration wins
+    addRule(TRIGGER_BT_FOUND, {"BT_FOUND", name, true, ACTION_RUN_SCRIPT, "bt_found.txt"});
+    setBTNameTrigger(name);
+    return true;
+  }
+
+  return false;
+}
+
+static void runAction(const AutomationRule& rule) {
+  switch (rule.action) {
+    case ACTION_RUN_SCRIPT: queueScriptFileJob("automation", rule.script, SCRIPT_PRIORITY_HIGH); break;
+    case ACTION_WIFI_OFF: WiFi.mode(WIFI_OFF); break;
+    case ACTION_WIFI_ON: setupAP(); break;
+    case ACTION_BT_OFF: stopBT(); break;
+    case ACTION_BT_ON: setupBT(); break;
+  }
+}
+
+static void dispatch(AutomationTrigger trigger) {
+  for (const AutomationRule& rule : rulesByTrigger[trigger]) runAction(rule);
+}
+
+static void dispatchSSIDChange(const String& ssid, bool present) {
+  for (const AutomationRule& rule : rulesByTrigger[TRIGGER_SSID_CHANGE]) {
+    if (rule.subject == ssid && rule.expectPresent == present) runAction(rule);
+  }
+}
+
+// SSID rules and RUN_WHEN_WIFI tasks share one watch list in the scan service
+static void refreshWatchList() {
+  if (!watchListDirty && !activeTasksChanged) return;
+  std::vector<String> watched;
+  for (const AutomationRule& rule : rulesByTrigger[TRIGGER_SSID_CHANGE]) watched.push_back(rule.subject);
+  for (const BackgroundTask& task : activeTasks) {
+    if (task.type == "WIFI_TRIGGER") watched.push_back(task.payload);
+  }
+  setWatchedSSIDs(watched);
+  watchListDirty = false;
+  activeTasksChanged = false;
+}
+
+extern bool deviceConnected;
+
+void processAutomation() {
+  static unsigned long lastCheck = 0;
+  if (millis() - lastCheck < 2000 || scriptRunning) return; 
+  lastCheck = millis();
+
+  static bool ssidCallbackSet = false;
+  if (!ssidCallbackSet) {
+    setSSIDChangeCallback(onSSIDChange);
+    ssidCallbackSet = true;
+  }
+  refreshWatchList();
+
+  // 1. WiFi client events
+  int currentWiFiClients = WiFi.softAPgetStationNum();
+  static int lastWiFiClients = 0;
+  if (currentWiFiClients != lastWiFiClients) {
+    dispatch(TRIGGER_WIFI_CLIENT_CHANGE);
+    dispatch(currentWiFiClients > lastWiFiClients ? TRIGGER_WIFI_CLIENT_CONNECT : TRIGGER_WIFI_CLIENT_DISCONNECT);
+  }
+  lastWiFiClients = currentWiFiClients;
+
+  // 2. Bluetooth client events
+  static bool lastBTConnected = false;
+  if (deviceConnected != lastBTConnected) {
+    dispatch(TRIGGER_BT_CLIENT_CHANGE);
+    dispatch(deviceConnected ? TRIGGER_BT_CLIENT_CONNECT : TRIGGER_BT_CLIENT_DISCONNECT);
+  }
+  lastBTConnected = deviceConnected;
+
+  // 3. Bluetooth discovery — the name is matched in the BLE scan callback
+  String device;
+  if (takeBTTriggerHit(device) && btDiscoveryEnabled) {
+    Serial.println("Bluetooth automation trigger: Found " + device);
+    dispatch(TRIGGER_BT_FOUND);
+  }
+
+  // 4. SSID appeared/disappeared events from the scan cache
+  for (auto const& change : pendingSSIDChanges) dispatchSSIDChange(change.first, change.second);
+  pendingSSIDChanges.clear();
+}
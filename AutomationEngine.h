@@ -0,0 +1,14 @@
+#ifndef AUTOMATION_ENGINE_H
+#define AUTOMATION_ENGINE_H
+
+#include "GlobalState.h"
+
+// Background automation rules (trigger -> condition -> action), compiled when a
+// script declares them and indexed by trigger so each event only visits its own
+// rules. Keys are the script keywords: *_WHEN_WIFI=, RUN_WHEN_BT_FOUND= and
+// friends, and the IF_CLIENT_* client-connection triggers declared via VAR.
+// Rules persist across scripts, like the variables they are mirrored into.
+bool declareAutomationRule(String key, String value);
+void processAutomation();
+
+#endif // AUTOMATION_ENGINE_H
@@ -3,12 +3,12 @@
 #include <BLE2902.h>
 
 BLEScan* pBLEScan;
-std::vector<String> foundBTDevices;
 
 BLEServer *pServer = NULL;
 BLECharacteristic * pTxCharacteristic = NULL;
 bool deviceConnected = false;
 bool oldDeviceConnected = false;
+static volatile bool btReady = false;
 
 #define SERVICE_UUID           "6E400001-B5A3-F393-E0A9-E50E24DCCA9E"
 #define CHARACTERISTIC_UUID_RX "6E400002-B5A3-F393-E0A9-E50E24DCCA9E"
@@ -39,12 +39,131 @@ class MyCallbacks: public BLECharacteristicCallbacks {
     }
 };
 
+// ============================================================
+// Discovery table — open addressing keyed by BLE address, fixed capacity.
+// Written from the BLE host task (onResult), read from loop().
+// ============================================================
+enum BTSlotState : uint8_t { BT_SLOT_EMPTY, BT_SLOT_USED, BT_SLOT_TOMB };
+
+struct BTDeviceSlot {
+    uint64_t addr;
+    char name[BT_DEVICE_NAME_LEN];
+    int8_t rssi;
+    uint8_t state;
+    uint32_t lastSeen;
+};
+
+static BTDeviceSlot btDevices[BT_DEVICE_TABLE_SIZE];
+static size_t btDeviceCount = 0;
+static portMUX_TYPE btDevicesMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Name trigger: matched in the scan callback whenever a stored name is set or
+// changes, and against the live table when the trigger is declared
+static char btTriggerName[BT_DEVICE_NAME_LEN] = "";
+static char btTriggerHitName[BT_DEVICE_NAME_LEN] = "";
+static volatile bool btTriggerHit = false;
+
+static uint64_t addressKey(BLEAddress& address) {
+    const uint8_t* raw = *address.getNative();
+    uint64_t key = 0;
+    for (int i = 0; i < 6; i++) key = (key << 8) | raw[i];
+    return key;
+}
+
+static size_t slotFor(uint64_t key) {
+    key ^= key >> 29;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 32;
+    return (size_t)key & (BT_DEVICE_TABLE_SIZE - 1);
+}
+
+static bool isStale(const BTDeviceSlot& slot, uint32_t now) {
+    return now - slot.lastSeen > BT_DEVICE_MAX_AGE;
+}
+
+// Caller holds btDevicesMux. Tombstones directly before an empty slot end no probe
+// chain, so they can go back to empty; otherwise they would pile up until every miss
+// walks the whole table.
+static void reclaimTombstones(size_t emptyIdx) {
+    size_t i = (emptyIdx - 1) & (BT_DEVICE_TABLE_SIZE - 1);
+    while (i != emptyIdx && btDevices[i].state == BT_SLOT_TOMB) {
+        btDevices[i].state = BT_SLOT_EMPTY;
+        i = (i - 1) & (BT_DEVICE_TABLE_SIZE - 1);
+    }
+}
+
+// Caller holds btDevicesMux. Returns the device's slot; nameChanged is set when the
+// device is new or back from stale, or its stored name was first set or changed.
+static BTDeviceSlot& upsertBTDevice(uint64_t key, const char* name, int rssi, uint32_t now, bool& nameChanged) {
+    size_t home = slotFor(key);
+    int freeSlot = -1;
+    for (size_t i = 0; i < BT_DEVICE_TABLE_SIZE; i++) {
+        size_t idx = (home + i) & (BT_DEVICE_TABLE_SIZE - 1);
+        BTDeviceSlot& slot = btDevices[idx];
+        if (slot.state == BT_SLOT_USED && slot.addr == key) {
+            nameChanged = isStale(slot, now);
+            if (name[0] && strncmp(slot.name, name, sizeof(slot.name) - 1) != 0) {
+                strlcpy(slot.name, name, sizeof(slot.name));
+                nameChanged = true;
+            }
+            slot.rssi = rssi;
+            slot.lastSeen = now;
+            return slot;
+        }
+        if (slot.state == BT_SLOT_USED && isStale(slot, now)) {
+            slot.state = BT_SLOT_TOMB;
+            btDeviceCount--;
+        }
+        if (slot.state != BT_SLOT_USED && freeSlot == -1) freeSlot = idx;
+        if (slot.state == BT_SLOT_EMPTY) {
+            // A reclaimed freeSlot is empty now, still the first free slot on the chain
+            reclaimTombstones(idx);
+            break;
+        }
+    }
+
+    if (freeSlot == -1) {
+        // Full of live entries: age out the least recently seen one
+        size_t oldest = 0;
+        for (size_t i = 1; i < BT_DEVICE_TABLE_SIZE; i++) {
+            if (now - btDevices[i].lastSeen > now - btDevices[oldest].lastSeen) oldest = i;
+        }
+        freeSlot = oldest;
+        btDeviceCount--;
+    }
+
+    BTDeviceSlot& slot = btDevices[freeSlot];
+    slot.addr = key;
+    strlcpy(slot.name, name, sizeof(slot.name));
+    slot.rssi = rssi;
+    slot.lastSeen = now;
+    slot.state = BT_SLOT_USED;
+    btDeviceCount++;
+    nameChanged = true;
+    return slot;
+}
+
+// Caller holds btDevicesMux
+static void matchBTTrigger(const char* name) {
+    if (btTriggerName[0] && !btTriggerHit && name[0] && strstr(name, btTriggerName) != nullptr) {
+        strlcpy(btTriggerHitName, name, sizeof(btTriggerHitName));
+        btTriggerHit = true;
+    }
+}
+
 class MyAdvertisedDeviceCallbacks: public BLEAdvertisedDeviceCallbacks {
     void onResult(BLEAdvertisedDevice advertisedDevice) {
+        BLEAddress address = advertisedDevice.getAddress();
+        uint64_t key = addressKey(address);
         String name = advertisedDevice.getName().c_str();
-        if (name.length() > 0) {
-            foundBTDevices.push_back(name);
-        }
+        int rssi = advertisedDevice.haveRSSI() ? advertisedDevice.getRSSI() : 0;
+
+        portENTER_CRITICAL(&btDevicesMux);
+        bool nameChanged = false;
+        BTDeviceSlot& slot = upsertBTDevice(key, name.c_str(), rssi, millis(), nameChanged);
+        // The name often arrives in a later scan response than the first advertisement
+        if (nameChanged) matchBTTrigger(slot.name);
+        portEXIT_CRITICAL(&btDevicesMux);
     }
 };
 
@@ -90,9 +209,26 @@ void setupBT() {
     pBLEScan->setActiveScan(true);
     pBLEScan->setInterval(100);
     pBLEScan->setWindow(99);
+    btReady = true;
+}
+
+static void btInitTask(void* arg) {
+    setupBT();
+    Serial.println("[BT] Ready (deferred init)");
+    vTaskDelete(NULL);
+}
+
+void setupBTAsync() {
+    if (btReady) return;
+    xTaskCreatePinnedToCore(btInitTask, "bt_init", 8192, NULL, 1, NULL, 0);
+}
+
+bool isBTReady() {
+    return btReady;
 }
 
 void loopBT() {
+    if (!btReady) return;
     if (!deviceConnected && oldDeviceConnected) {
         delay(500); // give the bluetooth stack the chance to get things ready
         pServer->startAdvertising(); // restart advertising
@@ -105,11 +241,12 @@ void loopBT() {
 }
 
 void stopBT() {
+    btReady = false;
     BLEDevice::deinit();
 }
 
 void scanBT() {
-    foundBTDevices.clear();
+    if (!btReady) return;
     Serial.println("Scanning for BT devices...");
     BLEScanResults* foundDevices = pBLEScan->start(5, false);
     Serial.print("BT Devices found: ");
@@ -118,10 +255,63 @@ void scanBT() {
 }
 
 bool isBTDevicePresent(String name) {
-    for (String device : foundBTDevices) {
-        if (device.indexOf(name) != -1) return true;
+    bool found = false;
+    uint32_t now = millis();
+    portENTER_CRITICAL(&btDevicesMux);
+    for (size_t i = 0; i < BT_DEVICE_TABLE_SIZE && !found; i++) {
+        const BTDeviceSlot& slot = btDevices[i];
+        if (slot.state == BT_SLOT_USED && !isStale(slot, now) && strstr(slot.name, name.c_str())) found = true;
+    }
+    portEXIT_CRITICAL(&btDevicesMux);
+    return found;
+}
+
+void setBTNameTrigger(String name) {
+    portENTER_CRITICAL(&btDevicesMux);
+    if (strcmp(btTriggerName, name.c_str()) != 0) {
+        strlcpy(btTriggerName, name.c_str(), sizeof(btTriggerName));
+        btTriggerHit = false;
+        // Devices already in the table count as found
+        uint32_t now = millis();
+        for (size_t i = 0; i < BT_DEVICE_TABLE_SIZE && !btTriggerHit; i++) {
+            const BTDeviceSlot& slot = btDevices[i];
+            if (slot.state == BT_SLOT_USED && !isStale(slot, now)) matchBTTrigger(slot.name);
+        }
+    }
+    portEXIT_CRITICAL(&btDevicesMux);
+}
+
+bool takeBTTriggerHit(String& deviceName) {
+    if (!btTriggerHit) return false;
+    portENTER_CRITICAL(&btDevicesMux);
+    char name[BT_DEVICE_NAME_LEN];
+    strlcpy(name, btTriggerHitName, sizeof(name));
+    btTriggerHit = false;
+    portEXIT_CRITICAL(&btDevicesMux);
+    deviceName = name;
+    return true;
+}
+
+String getBTDevicesJson() {
+    String json = "[";
+    uint32_t now = millis();
+    bool first = true;
+    for (size_t i = 0; i < BT_DEVICE_TABLE_SIZE; i++) {
+        portENTER_CRITICAL(&btDevicesMux);
+        BTDeviceSlot slot = btDevices[i];
+        portEXIT_CRITICAL(&btDevicesMux);
+        if (slot.state != BT_SLOT_USED || isStale(slot, now)) continue;
+        if (!first) json += ",";
+        first = false;
+        char addr[18];
+        snprintf(addr, sizeof(addr), "%02x:%02x:%02x:%02x:%02x:%02x",
+                 (uint8_t)(slot.addr >> 40), (uint8_t)(slot.addr >> 32), (uint8_t)(slot.addr >> 24),
+                 (uint8_t)(slot.addr >> 16), (uint8_t)(slot.addr >> 8), (uint8_t)slot.addr);
+        json += "{\"address\":\"" + String(addr) + "\",\"name\":\"" + String(slot.name) +
+                "\",\"rssi\":" + String(slot.rssi) + ",\"ageMs\":" + String(now - slot.lastSeen) + "}";
     }
-    return false;
+    json += "]";
+    return json;
 }
 
 int getBTClientCount() {
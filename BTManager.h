@@ -8,10 +8,17 @@
 #include <BLEAdvertisedDevice.h>
 
 void setupBT();
+void setupBTAsync();  // Brings BLE up from a background task so it stays off the boot path
+bool isBTReady();
 void loopBT();
 void stopBT();
 void scanBT();
 bool isBTDevicePresent(String name);
+// Substring trigger on advertised names; fires when a device (re)appears, its name is
+// learned or changes, or it is already in the table when the trigger is set
+void setBTNameTrigger(String name);
+bool takeBTTriggerHit(String& deviceName);
+String getBTDevicesJson();
 int getBTClientCount();
 
 #endif // BT_MANAGER_H
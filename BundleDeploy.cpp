@@ -0,0 +1,313 @@
+#include "BundleDeploy.h"
+#include "FSManager.h"
+#include "ScriptCache.h"
+#include "ScriptSearch.h"
+#include <ArduinoJson.h>
+
+#define TAR_BLOCK 512
+#define TAR_NAME_MAX 255  // Longest entry path accepted, GNU long names included
+
+struct BundleResult {
+  uint32_t files = 0;
+  uint32_t failed = 0;
+  uint32_t skipped = 0;     // Directories, links, pax headers, dotfiles
+  uint32_t scripts = 0;
+  uint32_t languages = 0;
+  uint32_t libraries = 0;
+  uint32_t precompiled = 0;
+  uint32_t invalid = 0;     // Language files that failed to parse
+  uint64_t bytes = 0;
+  unsigned long durationMs = 0;
+  String error;
+};
+
+// Parser state across UPLOAD_FILE_WRITE chunks; header blocks may arrive split
+struct BundleParser {
+  uint8_t header[TAR_BLOCK];
+  size_t headerFill = 0;
+  uint64_t remaining = 0;   // Data bytes left in the current entry
+  size_t padding = 0;       // Zero fill after the data, up to the next block
+  bool writing = false;
+  bool longNameEntry = false;
+  bool longNameTooLong = false;
+  bool ended = false;
+  String longName;
+  String entryName;
+};
+
+static BundleParser parser;
+static BundleResult lastBundle;
+static std::vector<String> deployedScripts;
+static std::vector<String> deployedLanguages;
+static unsigned long bundleStartedAt = 0;
+static bool precompileBundle = false;
+
+static uint64_t parseOctal(const uint8_t* field, size_t len) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < len && field[i]; i++) {
+    if (field[i] == ' ') continue;
+    if (field[i] < '0' || field[i] > '7') break;
+    value = (value << 3) | (field[i] - '0');
+  }
+  return value;
+}
+
+static String headerString(const uint8_t* field, size_t len) {
+  size_t n = 0;
+  while (n < len && field[n]) n++;
+  String s;
+  s.reserve(n);
+  for (size_t i = 0; i < n; i++) s += (char)field[i];
+  return s;
+}
+
+static bool headerChecksumValid(const uint8_t* h) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i < TAR_BLOCK; i++) sum += (i >= 148 && i < 156) ? ' ' : h[i];
+  return sum == parseOctal(h + 148, 8);
+}
+
+// Archive path relative to DIR_SCRIPTS ("lib/common.txt"), or "" when it is absolute,
+// climbs out with "..", or names a dotfile or dot-directory
+static String scriptSubpath(const String& name) {
+  if (name.startsWith("/") || name.indexOf('\\') != -1) return "";
+  String path;
+  int start = 0;
+  while (start <= (int)name.length()) {
+    int slash = name.indexOf('/', start);
+    if (slash == -1) slash = name.length();
+    String part = name.substring(start, slash);
+    start = slash + 1;
+    if (part.length() == 0 || part == ".") continue;
+    if (part.startsWith(".")) return "";
+    if (path.length() > 0) path += "/";
+    path += part;
+  }
+  return path;
+}
+
+static void finishEntry() {
+  if (parser.longNameEntry) {
+    parser.longNameEntry = false;
+    return;
+  }
+  if (!parser.writing) return;
+  parser.writing = false;
+
+  if (!stagedWriteCommit()) {
+    lastBundle.failed++;
+    return;
+  }
+  lastBundle.files++;
+  if (parser.entryName.endsWith(".txt")) {
+    lastBundle.scripts++;
+    deployedScripts.push_back(parser.entryName);
+    queueSearchIndexUpdate(parser.entryName);
+  } else if (parser.entryName.endsWith(".json")) {
+    lastBundle.languages++;
+    deployedLanguages.push_back(parser.entryName);
+  } else if (parser.entryName.endsWith(SCRIPT_LIBRARY_SUFFIX)) {
+    lastBundle.libraries++;
+  }
+}
+
+// One 512-byte header: decides whether the following data is written, captured or skipped
+static void beginEntry() {
+  const uint8_t* h = parser.header;
+  bool empty = true;
+  for (size_t i = 0; i < TAR_BLOCK && empty; i++) empty = h[i] == 0;
+  if (empty) {
+    parser.ended = true;
+    return;
+  }
+  if (!headerChecksumValid(h)) {
+    lastBundle.error = "Bad tar header checksum";
+    parser.ended = true;
+    return;
+  }
+
+  uint64_t size = parseOctal(h + 124, 12);
+  char type = (char)h[156];
+  parser.remaining = size;
+  parser.padding = (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK;
+
+  if (type == 'L') {
+    // GNU long name: the data block holds the name of the next entry
+    parser.longName = "";
+    parser.longNameEntry = true;
+    parser.longNameTooLong = false;
+    if (size == 0) finishEntry();
+    return;
+  }
+
+  String name = parser.longName;
+  bool nameTooLong = parser.longNameTooLong;
+  parser.longName = "";
+  parser.longNameTooLong = false;
+  if (name.length() == 0) {
+    name = headerString(h, 100);
+    // ustar splits long paths: prefix (155 bytes at 345) + "/" + name
+    String prefix = memcmp(h + 257, "ustar", 5) == 0 ? headerString(h + 345, 155) : String();
+    if (prefix.length() > 0) name = prefix + "/" + name;
+  }
+  if (nameTooLong || name.length() > TAR_NAME_MAX) {
+    // A cut path would deploy to the wrong place
+    lastBundle.failed++;
+    if (lastBundle.error.length() == 0) lastBundle.error = "Entry path longer than " + String(TAR_NAME_MAX) + " characters";
+    return;
+  }
+
+  // Scripts keep their relative subpath under DIR_SCRIPTS so IMPORT "lib/common.txt"
+  // resolves; everything else is routed by base name like /api/upload. Libraries are
+  // only indexed at the top of DIR_SCRIPTS.
+  String base = getFileNameFromPath(name);
+  String subpath = scriptSubpath(name);
+  if ((type != '0' && type != '\0') || base.length() == 0 || base.startsWith(".")) {
+    lastBundle.skipped++;
+    return;
+  }
+  bool isScript = base.endsWith(".txt");
+  if (isScript && subpath.length() == 0) {
+    lastBundle.skipped++;
+    return;
+  }
+
+  parser.entryName = isScript ? subpath : base;
+  String target = uploadPathFor(parser.entryName);
+  if (isScript && subpath.indexOf('/') != -1) ensureDirectoryExists(getParentDirectory(target));
+  if (!stagedWriteBegin(target)) {
+    lastBundle.failed++;
+    return;
+  }
+  parser.writing = true;
+  lastBundle.bytes += size;
+  if (size == 0) finishEntry();
+}
+
+static void feedBundle(const uint8_t* data, size_t len) {
+  while (len > 0 && !parser.ended) {
+    if (parser.remaining > 0) {
+      size_t n = parser.remaining < len ? (size_t)parser.remaining : len;
+      if (parser.longNameEntry) {
+        for (size_t i = 0; i < n && data[i] && !parser.longNameTooLong; i++) {
+          if (parser.longName.length() >= TAR_NAME_MAX) parser.longNameTooLong = true;
+          else parser.longName += (char)data[i];
+        }
+      } else if (parser.writing && !stagedWrite(data, n)) {
+        stagedWriteAbort();
+        parser.writing = false;
+        lastBundle.failed++;
+      }
+      parser.remaining -= n;
+      data += n;
+      len -= n;
+      if (parser.remaining == 0) finishEntry();
+    } else if (parser.padding > 0) {
+      size_t n = parser.padding < len ? parser.padding : len;
+      parser.padding -= n;
+      data += n;
+      len -= n;
+    } else {
+      size_t n = TAR_BLOCK - parser.headerFill;
+      if (n > len) n = len;
+      memcpy(parser.header + parser.headerFill, data, n);
+      parser.headerFill += n;
+      data += n;
+      len -= n;
+      if (parser.headerFill == TAR_BLOCK) {
+        parser.headerFill = 0;
+        beginEntry();
+      }
+    }
+  }
+}
+
+// Compiling more scripts than the cache holds would only evict the first ones again
+static void precompileDeployed() {
+  for (size_t i = 0; i < deployedScripts.size() && i < SCRIPT_CACHE_MAX_ENTRIES; i++) {
+    if (getCachedScript(deployedScripts[i])) lastBundle.precompiled++;
+  }
+  for (const String& name : deployedLanguages) {
+    File file = SD.open(uploadPathFor(name));
+    if (!file) continue;
+    DynamicJsonDocument doc(16384);
+    DeserializationError error = deserializeJson(doc, file);
+    file.close();
+    if (error) {
+      lastBundle.invalid++;
+      lastError = "Bundle language " + name + ": " + String(error.c_str());
+      errorCount++;
+    }
+  }
+}
+
+static void finishBundle() {
+  if (parser.writing) {
+    stagedWriteAbort();
+    parser.writing = false;
+    lastBundle.failed++;
+  }
+  if (!parser.ended && lastBundle.error.length() == 0) lastBundle.error = "Bundle truncated";
+
+  // One rescan per bundle, not one per file. Packed scripts are cached under their
+  // member names, so a replaced library drops the whole cache.
+  if (lastBundle.libraries > 0) clearScriptCache();
+  if (lastBundle.scripts > 0 || lastBundle.libraries > 0) loadAvailableScripts();
+  if (lastBundle.languages > 0) {
+    loadAvailableLanguages();
+    for (const String& name : deployedLanguages) {
+      if (name == currentLanguage + ".json") loadLanguage(currentLanguage);
+    }
+  }
+  if (precompileBundle) precompileDeployed();
+
+  lastBundle.durationMs = millis() - bundleStartedAt;
+  deployedScripts.clear();
+  deployedLanguages.clear();
+  Serial.println("Bundle deployed: " + String(lastBundle.files) + " files, " + String(lastBundle.failed) +
+                 " failed in " + String(lastBundle.durationMs) + " ms");
+}
+
+void handleBundleUpload() {
+  HTTPUpload& upload = server.upload();
+
+  if (upload.status == UPLOAD_FILE_START) {
+    parser = BundleParser();
+    lastBundle = BundleResult();
+    deployedScripts.clear();
+    deployedLanguages.clear();
+    bundleStartedAt = millis();
+    precompileBundle = server.arg("precompile") == "1";
+    uploadFilename = upload.filename;
+    Serial.println("Bundle upload start: " + uploadFilename);
+    if (!sdCardPresent) {
+      lastBundle.error = "SD card not present";
+      parser.ended = true;
+    }
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    feedBundle(upload.buf, upload.currentSize);
+  } else if (upload.status == UPLOAD_FILE_END) {
+    finishBundle();
+    unsigned long elapsed = lastBundle.durationMs;
+    lastUpload.bytes = upload.totalSize;
+    lastUpload.durationMs = elapsed;
+    lastUpload.kbps = elapsed > 0 ? (upload.totalSize / 1024.0f) / (elapsed / 1000.0f) : 0.0f;
+  } else if (upload.status == UPLOAD_FILE_ABORTED) {
+    Serial.println("Bundle upload aborted: " + uploadFilename);
+    lastBundle.error = "Upload aborted";
+    finishBundle();
+  }
+}
+
+bool bundleDeploySucceeded() {
+  return lastBundle.error.length() == 0 && lastBundle.failed == 0;
+}
+
+String getBundleDeployJson() {
+  return "{\"success\":" + String(bundleDeploySucceeded() ? "true" : "false") +
+         ",\"files\":" + String(lastBundle.files) + ",\"scripts\":" + String(lastBundle.scripts) +
+         ",\"languages\":" + String(lastBundle.languages) + ",\"libraries\":" + String(lastBundle.libraries) + ",\"failed\":" + String(lastBundle.failed) +
+         ",\"skipped\":" + String(lastBundle.skipped) + ",\"precompiled\":" + String(lastBundle.precompiled) +
+         ",\"invalid\":" + String(lastBundle.invalid) + ",\"bytes\":" + String((uint32_t)lastBundle.bytes) +
+         ",\"durationMs\":" + String(lastBundle.durationMs) + ",\"error\":\"" + lastBundle.error + "\"}";
+}
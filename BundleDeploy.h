@@ -0,0 +1,16 @@
+#ifndef BUNDLE_DEPLOY_H
+#define BUNDLE_DEPLOY_H
+
+#include "GlobalState.h"
+
+// /api/deploy: a tar bundle (ustar prefix paths, GNU long names up to 255 characters)
+// uploaded in one request; it answers 500 when any entry failed. Each
+// regular file is streamed through the staged writer to the same place /api/upload
+// would put it, the script and language indexes are rescanned once at the end, and
+// with ?precompile=1 scripts are compiled into the script cache and language files
+// are checked for valid JSON.
+void handleBundleUpload();
+bool bundleDeploySucceeded();
+String getBundleDeployJson();
+
+#endif // BUNDLE_DEPLOY_H
@@ -0,0 +1,134 @@
+#include "ClockCore.h"
+#include <string.h>
+
+enum DstRule { DST_NONE, DST_EU, DST_US };
+
+struct RegionRule {
+  const char* name;
+  long stdOffset;  // Seconds east of UTC
+  DstRule dst;
+};
+
+static const RegionRule REGIONS[] = {
+  {"utc", 0, DST_NONE},
+  {"us", 0, DST_NONE},  // Historical default: scripts written against UTC
+  {"de", 3600, DST_EU},
+  {"uk", 0, DST_EU},
+  {"us-east", -5 * 3600, DST_US},
+  {"us-central", -6 * 3600, DST_US},
+  {"us-mountain", -7 * 3600, DST_US},
+  {"us-pacific", -8 * 3600, DST_US},
+};
+
+// ============================================================
+// SNTP packets
+// ============================================================
+void sntpBuildRequest(uint8_t* packet) {
+  memset(packet, 0, SNTP_PACKET_SIZE);
+  packet[0] = (0 << 6) | (4 << 3) | 3;
+}
+
+static uint32_t readU32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+bool sntpParseReply(const uint8_t* packet, size_t len, time_t* epoch) {
+  if (len < SNTP_PACKET_SIZE) return false;
+  uint8_t leap = packet[0] >> 6;
+  uint8_t version = (packet[0] >> 3) & 0x07;
+  uint8_t mode = packet[0] & 0x07;
+  uint8_t stratum = packet[1];
+  if (leap == 3 || version < 3 || mode != 4 || stratum == 0 || stratum > 15) return false;
+
+  uint32_t seconds = readU32(packet + 40);
+  uint32_t fraction = readU32(packet + 44);
+  if (seconds == 0) return false;
+  // Era 0 ends in 2036; timestamps below the Unix epoch offset belong to era 1
+  uint64_t unixSeconds = seconds >= SNTP_UNIX_OFFSET ? (uint64_t)seconds - SNTP_UNIX_OFFSET
+                                                     : (uint64_t)seconds + 0x100000000ULL - SNTP_UNIX_OFFSET;
+  *epoch = (time_t)(unixSeconds + (fraction >= 0x80000000UL ? 1 : 0));
+  return true;
+}
+
+// ============================================================
+// Calendar math (no SNTP or TZ environment involved)
+// ============================================================
+static long daysFromCivil(int y, int m, int d) {
+  y -= m <= 2;
+  const long era = (y >= 0 ? y : y - 399) / 400;
+  const unsigned yoe = (unsigned)(y - era * 400);
+  const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (long)doe - 719468;
+}
+
+static int weekdayFromDays(long days) {
+  return (int)((days % 7 + 11) % 7);  // 1970-01-01 was a Thursday
+}
+
+// UTC instant of the nth Sunday (n = -1 for the last) of a month, plus secondsUtc
+static time_t sundayUtc(int year, int month, int n, long secondsUtc) {
+  long day;
+  if (n > 0) {
+    long first = daysFromCivil(year, month, 1);
+    day = first + (7 - weekdayFromDays(first)) % 7 + (n - 1) * 7;
+  } else {
+    long last = daysFromCivil(year + (month == 12), month % 12 + 1, 1) - 1;
+    day = last - weekdayFromDays(last);
+  }
+  return (time_t)day * 86400 + secondsUtc;
+}
+
+static bool dstActive(const RegionRule& rule, time_t utc) {
+  if (rule.dst == DST_NONE) return false;
+  struct tm u;
+  gmtime_r(&utc, &u);
+  int year = u.tm_year + 1900;
+  if (rule.dst == DST_EU) {
+    // Last Sunday of March to last Sunday of October, both at 01:00 UTC
+    return utc >= sundayUtc(year, 3, -1, 3600) && utc < sundayUtc(year, 10, -1, 3600);
+  }
+  // Second Sunday of March to first Sunday of November, both at 02:00 local
+  return utc >= sundayUtc(year, 3, 2, 7200 - rule.stdOffset) &&
+         utc < sundayUtc(year, 11, 1, 7200 - rule.stdOffset - 3600);
+}
+
+static const RegionRule& findRegion(const char* region) {
+  for (const RegionRule& rule : REGIONS) {
+    if (strcmp(region, rule.name) == 0) return rule;
+  }
+  return REGIONS[0];
+}
+
+long regionUtcOffset(const char* region, time_t utc) {
+  const RegionRule& rule = findRegion(region);
+  return rule.stdOffset + (dstActive(rule, utc) ? 3600 : 0);
+}
+
+// ============================================================
+// Cached clock
+// ============================================================
+time_t clockCacheNow(ClockCache& cache, ClockSource source) {
+  time_t now = source();
+  if (now < cache.lastReturned) return cache.lastReturned;
+  cache.lastReturned = now;
+  return now;
+}
+
+void clockCacheResync(ClockCache& cache) {
+  cache.lastReturned = 0;
+  cache.cachedEpoch = -1;
+}
+
+void clockCacheLocalTime(ClockCache& cache, const char* region, time_t t, struct tm* out) {
+  if (t == cache.cachedEpoch && strcmp(region, cache.cachedRegion) == 0) {
+    *out = cache.cachedTm;
+    return;
+  }
+  time_t local = t + regionUtcOffset(region, t);
+  gmtime_r(&local, &cache.cachedTm);
+  cache.cachedEpoch = t;
+  strncpy(cache.cachedRegion, region, sizeof(cache.cachedRegion) - 1);
+  cache.cachedRegion[sizeof(cache.cachedRegion) - 1] = '\0';
+  *out = cache.cachedTm;
+}
@@ -0,0 +1,40 @@
+#ifndef CLOCK_CORE_H
+#define CLOCK_CORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Host-buildable core of ClockManager: SNTP packets, region/DST rules and the
+// monotonic cached clock. No Arduino or ESP-IDF dependencies; the time source is
+// passed in, so all of it runs against a stand-in responder or a fake clock.
+#define SNTP_PACKET_SIZE 48
+#define SNTP_PORT 123
+#define SNTP_UNIX_OFFSET 2208988800UL  // Seconds from 1900-01-01 to 1970-01-01
+
+// Client request: LI 0, version 4, mode 3
+void sntpBuildRequest(uint8_t* packet);
+// Server reply (mode 4, stratum 1-15, not unsynchronized) to its transmit time, rounded
+bool sntpParseReply(const uint8_t* packet, size_t len, time_t* epoch);
+
+// Regions: "" / "us" / "utc" = UTC, "de" = CET/CEST, "uk" = GMT/BST,
+// "us-east" / "us-central" / "us-mountain" / "us-pacific"; unknown names are UTC.
+// region is matched as given (lowercase, no padding).
+long regionUtcOffset(const char* region, time_t utc);
+
+typedef time_t (*ClockSource)();
+
+struct ClockCache {
+  time_t lastReturned = 0;
+  time_t cachedEpoch = -1;  // Breakdown of the last second read, per region
+  char cachedRegion[16] = "";
+  struct tm cachedTm = {};
+};
+
+// Between resyncs source() never appears to step backwards; call
+// clockCacheResync() after setting the system time so a correction takes effect
+time_t clockCacheNow(ClockCache& cache, ClockSource source);
+void clockCacheResync(ClockCache& cache);
+void clockCacheLocalTime(ClockCache& cache, const char* region, time_t t, struct tm* out);
+
+#endif // CLOCK_CORE_H
@@ -0,0 +1,116 @@
+#include "ClockManager.h"
+#include "ClockCore.h"
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <sys/time.h>
+
+static const char* const SNTP_SERVERS[] = {NTP_SERVER_PRIMARY, NTP_SERVER_SECONDARY};
+
+static WiFiUDP sntpUdp;
+static bool sntpRequestPending = false;
+static int sntpServer = 0;
+static unsigned long sntpSentAt = 0;
+static unsigned long nextSyncAt = 0;
+static bool syncScheduled = false;
+
+static bool clockSynced = false;
+static time_t lastSyncAt = 0;
+static unsigned long syncCount = 0;
+static unsigned long syncFailures = 0;
+static ClockCache clockCache;
+
+static time_t systemTime() {
+  return time(nullptr);
+}
+
+// ============================================================
+// SNTP: one request in flight, polled from loop(); parsing lives in ClockCore
+// ============================================================
+static void scheduleSync(unsigned long delayMs) {
+  nextSyncAt = millis() + delayMs;
+  syncScheduled = true;
+}
+
+static void sendSntpRequest() {
+  uint8_t packet[SNTP_PACKET_SIZE];
+  sntpBuildRequest(packet);
+  sntpUdp.stop();
+  if (!sntpUdp.begin(CLOCK_SNTP_LOCAL_PORT) || !sntpUdp.beginPacket(SNTP_SERVERS[sntpServer], SNTP_PORT)) {
+    syncFailures++;
+    scheduleSync(CLOCK_SNTP_RETRY_MS);
+    return;
+  }
+  sntpUdp.write(packet, sizeof(packet));
+  if (!sntpUdp.endPacket()) {
+    syncFailures++;
+    scheduleSync(CLOCK_SNTP_RETRY_MS);
+    return;
+  }
+  sntpRequestPending = true;
+  sntpSentAt = millis();
+}
+
+static void pollSntpReply() {
+  if (sntpUdp.parsePacket() >= SNTP_PACKET_SIZE) {
+    uint8_t packet[SNTP_PACKET_SIZE];
+    time_t epoch;
+    int len = sntpUdp.read(packet, sizeof(packet));
+    if (len == SNTP_PACKET_SIZE && sntpParseReply(packet, len, &epoch)) {
+      // UTC in the system clock; region offsets are applied on read
+      struct timeval tv = {epoch, 0};
+      settimeofday(&tv, nullptr);
+      clockCacheResync(clockCache);
+      lastSyncAt = epoch;
+      syncCount++;
+      if (!clockSynced) Serial.println("[Clock] Synced from " + String(SNTP_SERVERS[sntpServer]));
+      clockSynced = true;
+      sntpRequestPending = false;
+      sntpUdp.stop();
+      scheduleSync(CLOCK_RESYNC_INTERVAL);
+      return;
+    }
+  }
+  if (millis() - sntpSentAt >= CLOCK_SNTP_TIMEOUT_MS) {
+    sntpRequestPending = false;
+    sntpUdp.stop();
+    syncFailures++;
+    sntpServer = (sntpServer + 1) % 2;  // Alternate servers on failure
+    scheduleSync(CLOCK_SNTP_RETRY_MS);
+  }
+}
+
+void processClock() {
+  if (WiFi.status() != WL_CONNECTED) return;
+  if (sntpRequestPending) {
+    pollSntpReply();
+    return;
+  }
+  if (syncScheduled && (long)(millis() - nextSyncAt) < 0) return;
+  syncScheduled = false;
+  sendSntpRequest();
+}
+
+bool isClockSynced() {
+  return clockSynced;
+}
+
+time_t clockNow() {
+  return clockCacheNow(clockCache, systemTime);
+}
+
+bool clockLocalTime(String region, time_t t, struct tm* out) {
+  if (!clockSynced) return false;
+  region.trim();
+  region.toLowerCase();
+  clockCacheLocalTime(clockCache, region.c_str(), t, out);
+  return true;
+}
+
+String getClockStatusJson() {
+  String json = "{\"synced\":" + String(clockSynced ? "true" : "false");
+  json += ",\"epoch\":" + String((unsigned long)(clockSynced ? clockNow() : 0));
+  json += ",\"lastSync\":" + String((unsigned long)lastSyncAt);
+  json += ",\"syncCount\":" + String(syncCount);
+  json += ",\"syncFailures\":" + String(syncFailures) + "}";
+  return json;
+}
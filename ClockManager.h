@@ -0,0 +1,17 @@
+#ifndef CLOCK_MANAGER_H
+#define CLOCK_MANAGER_H
+
+#include "GlobalState.h"
+#include <time.h>
+
+// Wall clock synced once over SNTP (then every CLOCK_RESYNC_INTERVAL) and read
+// from cache afterwards. Regions: "" / "us" / "utc" = UTC, "de" = CET/CEST,
+// "uk" = GMT/BST, "us-east" / "us-central" / "us-mountain" / "us-pacific".
+// Packet parsing, DST rules and the cache are the host-buildable ClockCore.
+void processClock();
+bool isClockSynced();
+time_t clockNow();
+bool clockLocalTime(String region, time_t t, struct tm* out);
+String getClockStatusJson();
+
+#endif // CLOCK_MANAGER_H
@@ -25,9 +25,80 @@
 #define STATUS_UPDATE_INTERVAL 5000
 #define MAX_HISTORY_SIZE 50
 #define WIFI_SCAN_TIMEOUT 5000
+#define WIFI_SCAN_INTERVAL 15000
+
+// BLE discovery table: power-of-two capacity, entries age out after BT_DEVICE_MAX_AGE
+#define BT_DEVICE_TABLE_SIZE 64
+#define BT_DEVICE_NAME_LEN 32
+#define BT_DEVICE_MAX_AGE 60000
+#define SETTINGS_COMMIT_DELAY 2000
+#define HID_READY_TIMEOUT 3000
+#define HID_SETTLE_DELAY 300
 #define LOG_SESSION_START_MARKER "=== Log Session Started ==="
 #define LOG_SESSION_END_MARKER "=== Log Session Ended ==="
 
+// Staged SD writes (uploads): two buffers of this size, multiple of the 512-byte sector
+#define STAGE_BUFFER_SIZE 16384
+#define STAGE_FILE_SUFFIX ".part"
+
+// Background file jobs (copy/move/delete)
+#define FILE_COPY_BUFFER_SIZE 32768
+#define MAX_FILE_JOBS 16
+
+// Script execution queue: queued jobs, and total jobs kept including finished ones
+#define MAX_SCRIPT_QUEUE 8
+#define MAX_SCRIPT_JOBS 16
+// Script arena chunk size for interpreter temporaries (first chunk is kept between runs)
+#define SCRIPT_ARENA_CHUNK 4096
+// Top-level lines between persisted execution cursor writes (CHECKPOINT_INTERVAL overrides)
+#define SCRIPT_CURSOR_INTERVAL 25
+// Largest variable store saved with the cursor (NVS blob); a bigger store disables the cursor
+#define SCRIPT_CURSOR_STATE_MAX 4000
+// WHILE loops: passes allowed when the header gives no MAX (MAX 0 lifts the cap)
+#define WHILE_DEFAULT_MAX_ITERATIONS 100000
+
+// Nested FUNCTION calls before the script is stopped as runaway recursion
+#define FUNCTION_MAX_CALL_DEPTH 32
+
+// IMPORT nesting: modules importing modules, deeper levels stay unresolved
+#define IMPORT_MAX_DEPTH 8
+
+// Rower: hop-to-hop gaps kept for /api/stats
+#define ROWER_GAP_HISTORY 16
+
+// Dry-run simulation: line visits before giving up on a runaway loop, waits reported
+#define SIMULATION_MAX_STEPS 200000
+#define SIMULATION_TOP_WAITS 5
+// Static analysis (/api/validate-script): diagnostics returned, JSON document budget
+#define ANALYZER_MAX_DIAGNOSTICS 100
+#define ANALYZER_DOC_SIZE 16384
+
+// Compiled script cache (automation triggers, rower payloads)
+#define SCRIPT_CACHE_MAX_ENTRIES 16
+#define SCRIPT_CACHE_MAX_BYTES 262144
+#define SCRIPT_CACHE_REVALIDATE_MS 10000
+
+// Packed script libraries (*.pak in DIR_SCRIPTS); larger ones are read from the card per script
+#define SCRIPT_LIBRARY_SUFFIX ".pak"
+#define SCRIPT_LIBRARY_PSRAM_MAX_BYTES 2097152
+
+// Script search index: scripts (re)indexed per loop pass, quiet time before the index file is rewritten
+#define SEARCH_INDEX_BATCH 4
+#define SEARCH_SAVE_DELAY_MS 5000
+#define SEARCH_MAX_TOKEN_LENGTH 24
+#define SEARCH_MAX_TOKENS_PER_SCRIPT 512
+#define SEARCH_MAX_RESULTS 20
+#define SEARCH_DOC_SIZE 8192
+
+// Wall clock (SNTP) and TIME_TRIGGER / DAY_TRIGGER scheduling
+#define NTP_SERVER_PRIMARY "pool.ntp.org"
+#define NTP_SERVER_SECONDARY "time.nist.gov"
+#define CLOCK_RESYNC_INTERVAL 3600000
+#define CLOCK_SNTP_TIMEOUT_MS 2000
+#define CLOCK_SNTP_RETRY_MS 10000
+#define CLOCK_SNTP_LOCAL_PORT 2390
+#define TIMER_CLOCK_RETRY_MS 5000
+
 // File system paths
 #define DIR_LANGUAGES "/languages"
 #define DIR_SCRIPTS "/scripts"
@@ -37,5 +108,7 @@
 #define FILE_LOG "/logs/log.txt"
 #define FILE_DEBUG "/logs/debug.txt"
 #define FILE_INDEX "/index.html"
+#define FILE_CHECKPOINT "/resume.ckpt"
+#define FILE_SEARCH_INDEX "/search.idx"
 
 #endif // CONFIG_H
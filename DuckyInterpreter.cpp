@@ -5,15 +5,44 @@
 #include "FSManager.h"
 #include "WiFiManager.h"
 #include "BTManager.h"
+#include "SettingsManager.h"
+#include "ScriptCache.h"
+#include "TaskScheduler.h"
+#include "AutomationEngine.h"
+#include "ScriptJobManager.h"
+#include "ScriptCheckpoint.h"
+#include "ExecutionCursor.h"
+#include "ScriptArena.h"
+#include "ScriptModules.h"
+#include "RowerPipeline.h"
+#include "ScriptSimulator.h"
 #include <USB.h>
+#include <esp_heap_caps.h>
 
-struct LoopState {
-  int startLine;
-  int currentIteration;
-  int totalIterations;
-  String varName;
-  int step;
+static const ScriptValue* findVariable(String name);
+
+// Keep in step with the variables["..."] assignments below and in FSManager/WiFiManager
+const char* const BUILTIN_VARIABLES[] = {
+  "TIME", "DAY", "HTTP_RESPONSE", "LAST_HTTP_RESPONSE", "CURRENT_TIME", "CURRENT_DAY",
+  "LAST_PING_SUCCESS", "DETECTED_OS", "WIFI_CONNECTED", "WIFI_SSID", "SELECTED_FILE", "SELECTED_FILES"
 };
+const size_t BUILTIN_VARIABLE_COUNT = sizeof(BUILTIN_VARIABLES) / sizeof(BUILTIN_VARIABLES[0]);
+
+// Searched in order, so the two-character operators win over '>' and '<'
+static const char* const CONDITION_OPS[] = {"==", "!=", ">=", "<=", ">", "<"};
+
+static bool compareOperands(const String& left, const char* op, const String& right) {
+  float lVal = left.toFloat();
+  float rVal = right.toFloat();
+
+  if (!strcmp(op, "==")) return lVal == rVal || left == right;
+  if (!strcmp(op, "!=")) return lVal != rVal || left != right;
+  if (!strcmp(op, ">=")) return lVal >= rVal;
+  if (!strcmp(op, "<=")) return lVal <= rVal;
+  if (!strcmp(op, ">")) return lVal > rVal;
+  if (!strcmp(op, "<")) return lVal < rVal;
+  return false;
+}
 
 bool evalCondition(String condition) {
   condition.trim();
@@ -34,26 +63,15 @@ bool evalCondition(String condition) {
   if (condition == "IF_CLIENT_CONNECTED_DISCONNECTED_WIFI") return true;
 
 
-  String ops[] = {"==", "!=", ">=", "<=", ">", "<"};
-  for (String op : ops) {
+  for (const char* op : CONDITION_OPS) {
     int opIdx = condition.indexOf(op);
     if (opIdx != -1) {
       String left = condition.substring(0, opIdx);
-      String right = condition.substring(opIdx + op.length());
+      String right = condition.substring(opIdx + strlen(op));
       left.trim();
       right.trim();
 
-      if (left.length() > 0 && right.length() > 0) {
-        float lVal = left.toFloat();
-        float rVal = right.toFloat();
-        
-        if (op == "==") return lVal == rVal || left == right;
-        if (op == "!=") return lVal != rVal || left != right;
-        if (op == ">=") return lVal >= rVal;
-        if (op == "<=") return lVal <= rVal;
-        if (op == ">") return lVal > rVal;
-        if (op == "<") return lVal < rVal;
-      }
+      if (left.length() > 0 && right.length() > 0) return compareOperands(left, op, right);
       break;
     }
   }
@@ -61,71 +79,359 @@ bool evalCondition(String condition) {
   return condition.length() > 0;
 }
 
-void executeScript(const String& script) {
-  if (scriptRunning) {
-    Serial.println("Script already running");
-    return;
+// A WHILE operand that names a variable is a map lookup; anything else is substituted like evalCondition
+static String conditionOperand(const String& text) {
+  const ScriptValue* value = findVariable(text);
+  if (value) return value->toString();
+  return processVariables(text);
+}
+
+static bool evalWhileCondition(const WhileBlock& block) {
+  if (block.op < 0) return evalCondition(block.left);
+  return compareOperands(conditionOperand(block.left), CONDITION_OPS[block.op], conditionOperand(block.right));
+}
+
+// Scope locals resolve against (processVariables, findVariable, VAR); rebound on every call and return
+static CallFrame* activeFrame = nullptr;
+static const FunctionInfo* activeFunction = nullptr;
+
+// Dry run in progress: commands go to the ScriptSimulator hooks, not the host
+static bool simulating = false;
+
+static void bindActiveFrame(const CompiledScript& script, std::vector<CallFrame>& callStack) {
+  activeFrame = nullptr;
+  activeFunction = nullptr;
+  if (callStack.empty()) return;
+  auto fnIt = script.functions.find(callStack.back().functionLine);
+  if (fnIt == script.functions.end()) return;
+  activeFrame = &callStack.back();
+  activeFunction = &fnIt->second;
+}
+
+// Slot lookup in the active frame; "$name" and "name" name the same local
+static ScriptValue* findLocal(const String& name) {
+  if (!activeFrame) return nullptr;
+  const char* want = name.c_str();
+  if (*want == '$') want++;
+  const std::vector<String>& slots = activeFunction->slotNames;
+  for (size_t k = 0; k < slots.size(); k++) {
+    const char* have = slots[k].c_str();
+    if (*have == '$') have++;
+    if (strcmp(have, want) == 0) return &activeFrame->locals[k];
+  }
+  return nullptr;
+}
+
+static void assignVariable(const String& name, const ScriptValue& value) {
+  ScriptValue* local = findLocal(name);
+  if (local) *local = value;
+  else variables[name] = value;
+}
+
+// FOR counters follow the same scoping as assignVariable. A local slot lives in a
+// frame that may be copied when callStack grows, so only the global slot is cached.
+static ScriptValue* loopCounter(LoopState& loop) {
+  ScriptValue* local = findLocal(loop.varName);
+  if (local) return local;
+  if (!loop.counter) loop.counter = &variables[loop.varName];
+  return loop.counter;
+}
+
+static std::vector<String> splitCallArgs(const String& args);
+static void dispatchCommand(const String& line);
+
+// Pushes a frame for the FUNCTION at fnLine and jumps into its body. Arguments are
+// evaluated in the caller's scope, before the frame becomes active.
+static bool enterFunction(const CompiledScript& script, ExecState& state, int fnLine, const String& args, const String& resultVar) {
+  if ((int)state.callStack.size() >= FUNCTION_MAX_CALL_DEPTH) {
+    lastError = "Call depth limit (" + String(FUNCTION_MAX_CALL_DEPTH) + ") reached at line " + String(state.pc + 1);
+    errorCount++;
+    return false;
+  }
+  CallFrame frame;
+  frame.returnLine = state.pc;
+  frame.functionLine = fnLine;
+  frame.resultVar = resultVar;
+  frame.loopDepth = state.loopStack.size();
+  frame.ifDepth = state.ifHandledStack.size();
+  auto fnIt = script.functions.find(fnLine);
+  if (fnIt != script.functions.end()) {
+    const FunctionInfo& fn = fnIt->second;
+    frame.locals.resize(fn.slotNames.size());
+    std::vector<String> values = splitCallArgs(args);
+    for (int k = 0; k < fn.paramCount && k < (int)values.size(); k++) {
+      frame.locals[k] = evalValueExpression(values[k]);
+    }
+  }
+  state.callStack.push_back(std::move(frame));
+  bindActiveFrame(script, state.callStack);
+  state.pc = fnLine + 1;
+  return true;
+}
+
+CompiledScript::~CompiledScript() {
+  free(text);
+}
+
+// Splits the source into trimmed, non-empty lines packed NUL-separated into one
+// buffer (PSRAM when present) and resolves FUNCTION labels up front.
+CompiledScriptPtr compileScript(const String& script, String* error) {
+  CompiledScriptPtr compiled = std::make_shared<CompiledScript>();
+  compiled->sourceBytes = script.length();
+
+  uint32_t hash = 2166136261UL; // FNV-1a
+  for (size_t k = 0; k < script.length(); k++) {
+    hash = (hash ^ (uint8_t)script[k]) * 16777619UL;
   }
+  compiled->hash = hash;
 
-  scriptRunning = true;
-  stopRequested = false;
-  scriptStartTime = millis();
-  setLEDMode(1);
+  size_t cap = script.length() + 1;
+  compiled->text = (char*)heap_caps_malloc(cap, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!compiled->text) compiled->text = (char*)malloc(cap);
+  if (!compiled->text) {
+    if (error) {
+      *error = "Out of memory compiling script";
+    } else {
+      lastError = "Out of memory compiling script";
+      errorCount++;
+    }
+    return compiled;
+  }
 
-  if (loggingEnabled) {
-    openLogFile();
-    logCommand("SCRIPT_START", "Script execution started");
+  const char* src = script.c_str();
+  size_t len = script.length();
+  size_t pos = 0;
+  size_t out = 0;
+  while (pos < len) {
+    size_t end = pos;
+    while (end < len && src[end] != '\n') end++;
+    size_t a = pos, b = end;
+    while (a < b && isspace((unsigned char)src[a])) a++;
+    while (b > a && isspace((unsigned char)src[b - 1])) b--;
+    if (b > a) {
+      compiled->lineOffsets.push_back(out);
+      compiled->sourceOffsets.push_back(pos);
+      memcpy(compiled->text + out, src + a, b - a);
+      out += b - a;
+      compiled->text[out++] = '\0';
+    }
+    pos = end + 1;
   }
+  compiled->textSize = out;
+
+  linkCompiledScript(*compiled);
+
+  return compiled;
+}
+
+// "name", "name()" or "name(a, b)"
+bool parseFunctionCall(const String& text, String& name, String& args) {
+  int open = text.indexOf('(');
+  if (open != -1 && text.endsWith(")")) {
+    name = text.substring(0, open);
+    args = text.substring(open + 1, text.length() - 1);
+    args.trim();
+  } else {
+    name = text;
+    args = "";
+  }
+  name.trim();
+  return name.length() > 0;
+}
+
+// "VAR $x = f(...)" or "VAR_X = f(...)": a call whose RETURN value is assigned
+bool parseCallAssignment(const String& line, String& target, String& name, String& args) {
+  int eqIdx = line.indexOf('=');
+  if (eqIdx == -1) return false;
+  if (line.startsWith("VAR ")) target = line.substring(4, eqIdx);
+  else if (line.startsWith("VAR_") || line.startsWith("VARIABLE_")) target = line.substring(0, eqIdx);
+  else return false;
+  target.trim();
+  String rhs = line.substring(eqIdx + 1);
+  rhs.trim();
+  return target.length() > 0 && rhs.endsWith(")") && parseFunctionCall(rhs, name, args);
+}
+
+// Splits call arguments / parameter lists on commas outside double quotes
+static std::vector<String> splitCallArgs(const String& args) {
+  std::vector<String> parts;
+  if (args.length() == 0) return parts;
+  bool quoted = false;
+  int start = 0;
+  for (int k = 0; k <= (int)args.length(); k++) {
+    if (k < (int)args.length() && args[k] == '"') quoted = !quoted;
+    if (k == (int)args.length() || (args[k] == ',' && !quoted)) {
+      String part = args.substring(start, k);
+      part.trim();
+      parts.push_back(part);
+      start = k + 1;
+    }
+  }
+  return parts;
+}
+
+// Resolves FUNCTION labels and lays out each body's locals: the parameters of
+// "FUNCTION name($a, $b)", then every LOCAL declared directly in the body.
+static void linkFunctions(CompiledScript& script) {
+  script.functionTable.clear();
+  script.functions.clear();
+  for (size_t j = 0; j < script.lineCount(); j++) {
+    const char* fLine = script.line(j);
+    if (strncmp(fLine, "FUNCTION ", 9) != 0) continue;
+    String funcName, params;
+    if (!parseFunctionCall(String(fLine + 9), funcName, params)) continue;
+    script.functionTable[funcName] = j;
+
+    FunctionInfo& fn = script.functions[j];
+    fn.slotNames = splitCallArgs(params);
+    fn.paramCount = fn.slotNames.size();
+
+    int depth = 0;
+    for (size_t k = j + 1; k < script.lineCount(); k++) {
+      const char* bLine = script.line(k);
+      if (strncmp(bLine, "FUNCTION ", 9) == 0) {
+        depth++;
+      } else if (strcmp(bLine, "END_FUNCTION") == 0) {
+        if (depth == 0) {
+          fn.endLine = k;
+          break;
+        }
+        depth--;
+      } else if (depth == 0 && strncmp(bLine, "LOCAL ", 6) == 0) {
+        String name = String(bLine + 6);
+        int eqIdx = name.indexOf('=');
+        if (eqIdx != -1) name = name.substring(0, eqIdx);
+        name.trim();
+        if (name.length() > 0 && std::find(fn.slotNames.begin(), fn.slotNames.end(), name) == fn.slotNames.end()) {
+          fn.slotNames.push_back(name);
+        }
+      }
+    }
+
+    for (int k = 0; k < (int)fn.slotNames.size(); k++) fn.substituteOrder.push_back(k);
+    std::sort(fn.substituteOrder.begin(), fn.substituteOrder.end(), [&fn](int a, int b) {
+      return fn.slotNames[a].length() > fn.slotNames[b].length();
+    });
+  }
+}
 
-  addToHistory("Script executed at " + String(millis()));
-  totalScriptsExecuted++;
+// Peels a trailing "<keyword> <digits>" guard off a WHILE header
+static bool takeWhileGuard(String& header, const char* keyword, uint32_t& value) {
+  int at = header.lastIndexOf(keyword);
+  if (at <= 0) return false;
+  String num = header.substring(at + strlen(keyword));
+  num.trim();
+  if (num.length() == 0) return false;
+  for (size_t k = 0; k < num.length(); k++) {
+    if (!isdigit((unsigned char)num[k])) return false;
+  }
+  value = strtoul(num.c_str(), nullptr, 10);
+  header = header.substring(0, at);
+  header.trim();
+  return true;
+}
 
-  std::vector<String> lines;
-  int startIndex = 0;
-  int endIndex = script.indexOf('\n');
+// Pairs WHILE/END_WHILE lines and pre-splits each condition, so a pass costs one
+// comparison and the exit is a direct jump instead of a skip scan.
+// Syntax: WHILE <condition> [MAX n] [TIMEOUT ms] ... END_WHILE
+static void linkWhileBlocks(CompiledScript& script) {
+  script.whileBlocks.clear();
+  std::vector<int> open;
+  for (size_t j = 0; j < script.lineCount(); j++) {
+    const char* wLine = script.line(j);
+    if (strncmp(wLine, "WHILE ", 6) == 0) {
+      open.push_back(j);
+    } else if (strcmp(wLine, "END_WHILE") == 0 && !open.empty()) {
+      int start = open.back();
+      open.pop_back();
+
+      WhileBlock block;
+      block.endLine = j;
+      String header = String(script.line(start) + 6);
+      header.trim();
+      while (takeWhileGuard(header, " MAX ", block.maxIterations) ||
+             takeWhileGuard(header, " TIMEOUT ", block.timeoutMs)) {}
+
+      block.left = header;
+      for (int k = 0; k < (int)(sizeof(CONDITION_OPS) / sizeof(CONDITION_OPS[0])); k++) {
+        int opIdx = header.indexOf(CONDITION_OPS[k]);
+        if (opIdx == -1) continue;
+        String left = header.substring(0, opIdx);
+        String right = header.substring(opIdx + strlen(CONDITION_OPS[k]));
+        left.trim();
+        right.trim();
+        if (left.length() > 0 && right.length() > 0) {
+          block.left = left;
+          block.right = right;
+          block.op = k;
+        }
+        break;
+      }
+      script.whileBlocks[start] = block;
+    }
+  }
+}
 
-  while (endIndex != -1) {
-    String line = script.substring(startIndex, endIndex);
-    line.trim();
-    if (line.length() > 0) lines.push_back(line);
-    startIndex = endIndex + 1;
-    endIndex = script.indexOf('\n', startIndex);
+// Tables derived from the lines alone; rebuilt after compiling or loading a checkpoint
+void linkCompiledScript(CompiledScript& script) {
+  linkFunctions(script);
+  linkWhileBlocks(script);
+}
+
+void executeCompiledScript(CompiledScriptPtr script, const ExecState* resumeFrom, bool simulate) {
+  if (scriptRunning) {
+    Serial.println("Script already running");
+    return;
   }
-  if (startIndex < script.length()) {
-    String line = script.substring(startIndex);
-    line.trim();
-    if (line.length() > 0) lines.push_back(line);
+  if (!script || !script->text) return;
+  // A resumed state indexes the already-linked script it was saved from
+  if (!resumeFrom) script = linkScriptImports(script);
+
+  // A dry run leaves the LED, log, history, counters and cursor alone
+  scriptRunning = true;
+  simulating = simulate;
+  if (!simulate) {
+    stopRequested = false;
+    scriptStartTime = millis();
   }
+  scriptArenaBeginRun();
+  if (!simulate) {
+    setLEDMode(1);
 
-  int totalLines = lines.size();
-  std::vector<LoopState> loopStack;
-  int i = 0;
-  int skipDepth = 0;
-  bool skipActive = false;
-  std::vector<int> callStack;
-  std::vector<bool> ifHandledStack;
-  std::map<String, int> functionTable;
+    if (loggingEnabled) {
+      openLogFile();
+      logCommand("SCRIPT_START", "Script execution started");
+    }
 
-  // Pre-scan for functions
-  for (int j = 0; j < lines.size(); j++) {
-    String fLine = lines[j];
-    fLine.trim();
-    if (fLine.startsWith("FUNCTION ")) {
-      String funcName = fLine.substring(9);
-      funcName.trim();
-      if (funcName.endsWith("()")) funcName = funcName.substring(0, funcName.length() - 2);
-      functionTable[funcName] = j;
+    if (resumeFrom) {
+      addToHistory("Script resumed at line " + String(resumeFrom->pc + 1));
+    } else {
+      addToHistory("Script executed at " + String(millis()));
+      totalScriptsExecuted++;
     }
   }
 
+  const int totalLines = script->lineCount();
+  ExecState state;
+  if (resumeFrom) state = *resumeFrom;
+  int& i = state.pc;
+  int& skipDepth = state.skipDepth;
+  bool& skipActive = state.skipActive;
+  std::vector<LoopState>& loopStack = state.loopStack;
+  std::vector<CallFrame>& callStack = state.callStack;
+  std::vector<bool>& ifHandledStack = state.ifHandledStack;
+  const std::map<String, int>& functionTable = script->functionTable;
+  bindActiveFrame(*script, callStack);
+
   // Handle BEGIN_ROWER block
   bool inRowerBlock = false;
   std::vector<String> rowerPayloads;
 
-  while (i < lines.size() && !stopRequested) {
+  while (i < totalLines && !stopRequested) {
+    if (simulate && !simulationStep(i)) break;
     currentLineNum = i + 1;
-    String line = lines[i];
-    line.trim();
+    // Compiled lines are already trimmed; dispatch on a view, copy only what executes
+    StrView line(script->line(i));
 
     if (line.length() == 0 || line.startsWith("REM") || line.startsWith("//")) {
       i++;
@@ -151,15 +457,14 @@ void executeScript(const String& script) {
 
     if (line == "END_ROWER") {
       inRowerBlock = false;
-      rower.payloads = rowerPayloads;
-      rower.currentPayloadIdx = 0;
-      rower.active = true;
+      if (simulate) simulateExternal(i, false);
+      else startRower(rowerPayloads);
       i++;
       continue;
     }
 
     if (inRowerBlock) {
-      rowerPayloads.push_back(line);
+      rowerPayloads.push_back(line.toString());
       i++;
       continue;
     }
@@ -168,18 +473,19 @@ void executeScript(const String& script) {
       i++;
       String payload = "";
       int depth = 1;
-      while (i < lines.size() && depth > 0) {
-        String subLine = lines[i];
-        subLine.trim();
+      while (i < totalLines && depth > 0) {
+        StrView subLine(script->line(i));
         if (subLine.startsWith("IF") || subLine.startsWith("FOR") || subLine.startsWith("WHILE")) depth++;
         else if (subLine.startsWith("ENDIF") || subLine.startsWith("END_IF") || subLine.startsWith("ENDFOR") || subLine.startsWith("END_FOR") || subLine.startsWith("END_WHILE")) depth--;
         
         if (depth > 0) {
-          payload += lines[i] + "\n";
+          payload += String(script->line(i)) + "\n";
           i++;
         }
       }
-      if (payload.length() > 0) {
+      if (simulate) {
+        simulateExternal(i, false);
+      } else if (payload.length() > 0) {
         File f = SD.open("/reboot_script.txt", FILE_WRITE);
         if (f) {
           f.print(payload);
@@ -187,9 +493,8 @@ void executeScript(const String& script) {
           Serial.println("Reboot payload saved to SD");
         }
       }
-      if (i < lines.size()) {
-          String endLine = lines[i];
-          endLine.trim();
+      if (i < totalLines) {
+          StrView endLine(script->line(i));
           if (endLine.startsWith("END_RUN_ON_REBOOT")) i++;
           else if (endLine.startsWith("ENDIF") || endLine.startsWith("END_IF")) i++;
       }
@@ -197,48 +502,49 @@ void executeScript(const String& script) {
     }
 
     // RANDOM USB Identity commands — apply change, save remaining script, and reboot
-    auto isRandomUSBCmd = [](const String& l) {
+    auto isRandomUSBCmd = [](const StrView& l) {
       return l == "RANDOM_VID" || l == "RANDOM_PID" || l == "RANDOM_MAN" || l == "RANDOM_PRODUCT" ||
              l.startsWith("RANDOM_VID ") || l.startsWith("RANDOM_PID ") ||
              l.startsWith("RANDOM_MAN ") || l.startsWith("RANDOM_PRODUCT ");
     };
 
+    if (isRandomUSBCmd(line) && simulate) {
+      // The device re-enumerates and resumes from the checkpoint
+      simulateExternal(i, true);
+      i++;
+      continue;
+    }
+
     if (isRandomUSBCmd(line)) {
       // Apply the randomization to the matching field
-      String cmd = line.substring(0, line.indexOf(' ') == -1 ? line.length() : line.indexOf(' '));
-      cmd.trim();
+      StrView cmd = line.substring(0, line.indexOf(' ') == -1 ? line.length() : line.indexOf(' '));
       if (cmd == "RANDOM_VID") {
         char buf[7]; sprintf(buf, "0x%04x", (uint16_t)(esp_random() & 0xFFFF));
-        preferences.putString("usb_vid", String(buf));
+        currentUSBConfig.vid = String(buf);
         Serial.println("RANDOM_VID: " + String(buf));
       } else if (cmd == "RANDOM_PID") {
         char buf[7]; sprintf(buf, "0x%04x", (uint16_t)(esp_random() & 0xFFFF));
-        preferences.putString("usb_pid", String(buf));
+        currentUSBConfig.pid = String(buf);
         Serial.println("RANDOM_PID: " + String(buf));
       } else if (cmd == "RANDOM_MAN") {
         const char* mfrs[] = {"Microsoft", "Logitech", "Dell", "Apple", "HP", "Lenovo", "Asus", "Samsung"};
         String mfr = mfrs[esp_random() % 8];
-        preferences.putString("usb_mfr", mfr);
+        currentUSBConfig.mfr = mfr;
         Serial.println("RANDOM_MAN: " + mfr);
       } else if (cmd == "RANDOM_PRODUCT") {
         const char* prods[] = {"USB Keyboard", "HID Device", "Wireless Dongle", "USB Hub", "Flash Drive"};
         String prod = prods[esp_random() % 5];
-        preferences.putString("usb_prod", prod);
+        currentUSBConfig.prod = prod;
         Serial.println("RANDOM_PRODUCT: " + prod);
       }
-      // Save remaining script lines to /temp_resume.txt
+      markSettingDirty(SETTING_USB);
+      commitSettings();
+      // Checkpoint the interpreter just past this line; setup() resumes from it,
+      // so the line cursor of this run is superseded
+      finishExecutionCursor(*script);
       i++;
-      String remaining = "";
-      while (i < lines.size()) {
-        String remLine = lines[i];
-        remLine.trim();
-        if (remLine.length() > 0) remaining += remLine + "\n";
-        i++;
-      }
-      if (remaining.length() > 0 && sdCardPresent) {
-        File f = SD.open("/temp_resume.txt", FILE_WRITE);
-        if (f) { f.print(remaining); f.close(); }
-        Serial.println("Resume script saved. Rebooting for USB identity change...");
+      if (i < totalLines && saveScriptCheckpoint(*script, state)) {
+        Serial.println("Checkpoint saved at line " + String(i + 1) + ". Rebooting for USB identity change...");
       }
       delay(500);
       ESP.restart();
@@ -246,16 +552,16 @@ void executeScript(const String& script) {
     }
 
     if (line.startsWith("IF_NOT_PRESENT ")) {
-      String target = line.substring(15);
-      target.trim();
+      StrView target = line.substring(15).trimmed();
       bool isPresent = false;
       
-      if (target == "SD") isPresent = sdCardPresent;
+      if (simulate) isPresent = !simulateLiveCondition(i);
+      else if (target == "SD") isPresent = sdCardPresent;
       else if (target.startsWith("SSID=\"")) {
         int q1 = target.indexOf('"') + 1;
         int q2 = target.indexOf('"', q1);
         if (q2 > q1) {
-          String ssid = target.substring(q1, q2);
+          String ssid = target.substring(q1, q2).toString();
           scanWiFi();
           isPresent = isSSIDPresent(ssid);
         }
@@ -276,16 +582,32 @@ void executeScript(const String& script) {
     }
 
     if (line.startsWith("FUNCTION ") || line.startsWith("DEF_")) {
+      // Bodies only run when called; a linked FUNCTION jumps straight past its END_FUNCTION
+      auto fnIt = script->functions.find(i);
+      if (fnIt != script->functions.end() && fnIt->second.endLine >= 0) {
+        i = fnIt->second.endLine + 1;
+        continue;
+      }
       skipActive = true;
       skipDepth = 0;
       i++;
       continue;
     }
 
-    if (line == "END_FUNCTION" || line == "RETURN") {
+    if (line == "END_FUNCTION" || line == "RETURN" || line.startsWith("RETURN ")) {
       if (!callStack.empty()) {
-        i = callStack.back() + 1;
+        // The value is evaluated in the callee's scope and assigned in the caller's
+        ScriptValue result;
+        if (line.startsWith("RETURN ")) result = evalValueExpression(line.substring(7).toString());
+        CallFrame frame = std::move(callStack.back());
         callStack.pop_back();
+        bindActiveFrame(*script, callStack);
+        // Leaving from inside a FOR/WHILE/IF drops the blocks the body opened; never
+        // grow the stacks back if the body already closed some of the caller's
+        if ((int)loopStack.size() > frame.loopDepth) loopStack.resize(frame.loopDepth);
+        if ((int)ifHandledStack.size() > frame.ifDepth) ifHandledStack.resize(frame.ifDepth);
+        if (frame.resultVar.length() > 0) assignVariable(frame.resultVar, result);
+        i = frame.returnLine + 1;
         continue;
       }
       i++;
@@ -293,15 +615,13 @@ void executeScript(const String& script) {
     }
 
     if (line.startsWith("FOR ")) {
-      String forParams = line.substring(4);
-      forParams.trim();
+      StrView forParams = line.substring(4).trimmed();
       int fromIdx = forParams.indexOf("FROM ");
       int toIdx = forParams.indexOf("TO ");
       int stepIdx = forParams.indexOf("STEP ");
       
       if (fromIdx != -1 && toIdx != -1) {
-        String varName = forParams.substring(0, fromIdx);
-        varName.trim();
+        String varName = forParams.substring(0, fromIdx).trimmed().toString();
         int startVal = forParams.substring(fromIdx + 5, toIdx).toInt();
         int endVal;
         int stepVal = 1;
@@ -312,8 +632,55 @@ void executeScript(const String& script) {
           endVal = forParams.substring(toIdx + 3).toInt();
         }
         LoopState loop = {i, startVal, endVal, varName, stepVal};
+        loop.callDepth = callStack.size();
+        loopCounter(loop)->setInt(startVal);
+        loopStack.push_back(loop);
+      }
+      i++;
+      continue;
+    }
+
+    if (line.startsWith("WHILE ")) {
+      auto blockIt = script->whileBlocks.find(i);
+      if (blockIt == script->whileBlocks.end()) {
+        lastError = "WHILE without END_WHILE at line " + String(i + 1);
+        errorCount++;
+        break;
+      }
+      const WhileBlock& block = blockIt->second;
+      // END_WHILE jumps back here, so a frame already on top means another pass,
+      // unless it belongs to the same WHILE in a caller (recursion)
+      const LoopState* top = loopStack.empty() ? nullptr : &loopStack.back();
+      if (!top || !top->isWhile || top->startLine != i || top->callDepth != (int)callStack.size()) {
+        LoopState loop = {i, 0, (int)block.maxIterations, "", 0};
+        loop.isWhile = true;
+        loop.startedMs = millis();
+        loop.callDepth = callStack.size();
         loopStack.push_back(loop);
-        variables[varName] = String(startVal);
+      }
+      LoopState& loop = loopStack.back();
+      bool guardHit = !simulate && ((block.maxIterations > 0 && (uint32_t)loop.currentIteration >= block.maxIterations) ||
+                                    (block.timeoutMs > 0 && millis() - loop.startedMs >= block.timeoutMs));
+      if (guardHit) {
+        lastError = "WHILE guard stopped the loop at line " + String(i + 1);
+        errorCount++;
+      }
+      bool pass = simulate ? simulateWhilePass(i, loop.currentIteration) : evalWhileCondition(block);
+      if (guardHit || !pass) {
+        loopStack.pop_back();
+        i = block.endLine + 1;
+        continue;
+      }
+      loop.currentIteration++;
+      i++;
+      continue;
+    }
+
+    if (line == "END_WHILE") {
+      if (!loopStack.empty() && loopStack.back().isWhile) {
+        i = loopStack.back().startLine;
+        yield();  // An empty body must not starve the idle task
+        continue;
       }
       i++;
       continue;
@@ -324,7 +691,7 @@ void executeScript(const String& script) {
         LoopState& loop = loopStack.back();
         loop.currentIteration += loop.step;
         if (loop.currentIteration <= loop.totalIterations) {
-          variables[loop.varName] = String(loop.currentIteration);
+          loopCounter(loop)->setInt(loop.currentIteration);
           i = loop.startLine + 1;
           continue;
         } else {
@@ -338,12 +705,17 @@ void executeScript(const String& script) {
     bool isIf = false;
     bool conditionMet = false;
 
-    if (line.startsWith("IF_PRESENT SSID=\"")) {
+    // IF_* conditions read the radios and the host, so a dry run assumes their branch;
+    // "IF <expr>" only reads variables and is evaluated as usual
+    if (simulate && line.startsWith("IF_")) {
+      isIf = true;
+      conditionMet = simulateLiveCondition(i);
+    } else if (line.startsWith("IF_PRESENT SSID=\"")) {
       isIf = true;
       int quoteStart = line.indexOf('"') + 1;
       int quoteEnd = line.indexOf('"', quoteStart);
       if (quoteEnd > quoteStart) {
-        String ssid = line.substring(quoteStart, quoteEnd);
+        String ssid = line.substring(quoteStart, quoteEnd).toString();
         scanWiFi();
         conditionMet = isSSIDPresent(ssid);
       }
@@ -352,7 +724,7 @@ void executeScript(const String& script) {
       int quoteStart = line.indexOf('"') + 1;
       int quoteEnd = line.indexOf('"', quoteStart);
       if (quoteEnd > quoteStart) {
-        String ssid = line.substring(quoteStart, quoteEnd);
+        String ssid = line.substring(quoteStart, quoteEnd).toString();
         scanWiFi();
         conditionMet = !isSSIDPresent(ssid);
       }
@@ -361,7 +733,7 @@ void executeScript(const String& script) {
       int quoteStart = line.indexOf('"') + 1;
       int quoteEnd = line.indexOf('"', quoteStart);
       if (quoteEnd > quoteStart) {
-        String name = line.substring(quoteStart, quoteEnd);
+        String name = line.substring(quoteStart, quoteEnd).toString();
         scanBT();
         conditionMet = isBTDevicePresent(name);
       }
@@ -382,15 +754,14 @@ void executeScript(const String& script) {
       conditionMet = (WiFi.status() != WL_CONNECTED);
     } else if (line.startsWith("IF_OS ")) {
       isIf = true;
-      String targetOS = line.substring(6);
-      targetOS.trim();
+      String targetOS = line.substring(6).trimmed().toString();
       conditionMet = (detectedOS.equalsIgnoreCase(targetOS));
     } else if (line.startsWith("IF_DETECT_OS_INCLUDES = \"")) {
       isIf = true;
       int q1 = line.indexOf('"') + 1;
       int q2 = line.indexOf('"', q1);
       if (q2 > q1) {
-        String target = line.substring(q1, q2);
+        String target = line.substring(q1, q2).toString();
         conditionMet = (detectedOS.indexOf(target) != -1);
       }
     } else if (line.startsWith("IF_CLIENT_CONNECTED")) {
@@ -407,7 +778,7 @@ void executeScript(const String& script) {
       conditionMet = (WiFi.status() == WL_CONNECTED);
     } else if (line.startsWith("IF ")) {
       isIf = true;
-      conditionMet = evalCondition(line.substring(3));
+      conditionMet = evalCondition(line.substring(3).toString());
     } else if (line.startsWith("IF_CLIENT_CONNECTED_DISCONNECTED_BLUETOOTH")) {
       isIf = true;
       conditionMet = true; // Triggered if reached
@@ -419,7 +790,7 @@ void executeScript(const String& script) {
       conditionMet = true;
     } else if (line.startsWith("IF_")) {
       isIf = true;
-      conditionMet = evalCondition(line);
+      conditionMet = evalCondition(line.toString());
     }
 
 
@@ -439,7 +810,7 @@ void executeScript(const String& script) {
         skipDepth = 0;
       } else if (skipDepth == 0) {
         if (!ifHandledStack.empty() && !ifHandledStack.back()) {
-          conditionMet = evalCondition(line.substring(5));
+          conditionMet = evalCondition(line.substring(5).toString());
           if (conditionMet) {
             skipActive = false;
             ifHandledStack.back() = true;
@@ -456,7 +827,7 @@ void executeScript(const String& script) {
         skipDepth = 0;
       } else if (skipDepth == 0) {
         if (!ifHandledStack.empty() && !ifHandledStack.back()) {
-          conditionMet = evalCondition(line.substring(5));
+          conditionMet = evalCondition(line.substring(5).toString());
           if (conditionMet) {
             skipActive = false;
             ifHandledStack.back() = true;
@@ -488,15 +859,27 @@ void executeScript(const String& script) {
       continue;
     }
 
-    String potentialFunc = line;
-    if (potentialFunc.endsWith("()")) potentialFunc = potentialFunc.substring(0, potentialFunc.length() - 2);
-    if (functionTable.find(potentialFunc) != functionTable.end()) {
-      callStack.push_back(i);
-      i = functionTable[potentialFunc] + 1;
+    String command = line.toString();
+    if (!functionTable.empty()) {
+      String callName, callArgs, target;
+      bool assigns = parseCallAssignment(command, target, callName, callArgs);
+      if (assigns || parseFunctionCall(command, callName, callArgs)) {
+        auto funcIt = functionTable.find(callName);
+        if (funcIt != functionTable.end()) {
+          if (!enterFunction(*script, state, funcIt->second, callArgs, assigns ? target : String())) break;
+          continue;
+        }
+      }
+    }
+
+    if (simulate) {
+      // The simulator prices the command and its default delay; variable updates still run
+      if (!simulateCommand(command, i)) dispatchCommand(command);
+      i++;
       continue;
     }
 
-    executeCommand(line);
+    executeCommand(command);
     totalCommandsExecuted++;
     if (stopRequested) break;
     if (defaultDelay > 0) {
@@ -504,9 +887,22 @@ void executeScript(const String& script) {
       while (millis() - delayStart < (unsigned long)defaultDelay && !stopRequested) delay(10);
     }
     i++;
+    // Only top-level positions are persisted, so RESUME needs no stack state
+    if (loopStack.empty() && callStack.empty() && ifHandledStack.empty() && !skipActive) {
+      noteExecutionCursor(*script, i);
+    }
   }
-
+  scriptArenaEndRun();
+  activeFrame = nullptr;
+  activeFunction = nullptr;
   scriptRunning = false;
+
+  if (simulate) {
+    simulating = false;
+    if (i < totalLines) simulationHalted(i);
+    return;
+  }
+  finishExecutionCursor(*script);
   if (loggingEnabled) {
     if (stopRequested) logCommand("SCRIPT_STOP", "Stopped at line " + String(currentLineNum));
     else logCommand("SCRIPT_END", "Completed successfully");
@@ -521,17 +917,44 @@ void executeScript(const String& script) {
   }
 }
 
-void executeCommand(String line) {
+// Reports of the last static STRING/key line; REPEAT resends them instead of re-dispatching
+static std::vector<HidStroke> replayStrokes;
+static bool replayValid = false;
+
+static void beginReplayRecording() {
+  replayStrokes.clear();
+  beginHidRecording(&replayStrokes);
+}
+
+static void endReplayRecording() {
+  endHidRecording();
+  replayValid = !stopRequested;
+}
+
+void executeCommand(const String& line) {
   if (stopRequested) return;
   
   if (!line.startsWith("REPEAT ")) {
     lastCommand = line;
+    replayValid = false;
   }
   
   addToHistory(line);
+  dispatchCommand(line);
+}
+
+// Command body without the lastCommand/history bookkeeping; REPEAT re-enters here
+static void dispatchCommand(const String& line) {
+  if (stopRequested) return;
 
   if (line.startsWith("STRING ")) {
-    fastTypeString(processVariables(line.substring(7)));
+    String text = line.substring(7);
+    String typed = processVariables(text);
+    // No variables substituted: the same reports every time, safe to replay
+    bool record = typed == text;
+    if (record) beginReplayRecording();
+    fastTypeString(typed);
+    if (record) endReplayRecording();
     if (holdTillStringActive) {
       releaseAllKeys();
       holdTillStringActive = false;
@@ -540,8 +963,13 @@ void executeCommand(String line) {
   }
 
   if (line.startsWith("STRINGLN ")) {
-    fastTypeString(processVariables(line.substring(9)));
+    String text = line.substring(9);
+    String typed = processVariables(text);
+    bool record = typed == text;
+    if (record) beginReplayRecording();
+    fastTypeString(typed);
     fastPressKey("ENTER");
+    if (record) endReplayRecording();
     if (holdTillStringActive) {
       releaseAllKeys();
       holdTillStringActive = false;
@@ -596,27 +1024,27 @@ void executeCommand(String line) {
       String name = varLine.substring(0, eqIdx);
       String val = varLine.substring(eqIdx + 1);
       name.trim(); val.trim();
-      val = processVariables(val);
-      if (val.indexOf('+') != -1 || val.indexOf('-') != -1 || val.indexOf('*') != -1 || val.indexOf('/') != -1) {
-        char ops[] = {'+', '-', '*', '/'};
-        for (char op : ops) {
-          int opIdx = val.indexOf(op);
-          if (opIdx != -1) {
-            float v1 = val.substring(0, opIdx).toFloat();
-            float v2 = val.substring(opIdx + 1).toFloat();
-            if (op == '+') val = String(v1 + v2);
-            else if (op == '-') val = String(v1 - v2);
-            else if (op == '*') val = String(v1 * v2);
-            else if (op == '/') val = (v2 != 0) ? String(v1 / v2) : "0";
-            break;
-          }
-        }
-      }
-      variables[name] = val;
+      ScriptValue value = evalValueExpression(val);
+      assignVariable(name, value);
+      // VAR IF_CLIENT_CONNECTED = ... declares a client automation, as it always has
+      String key = name.startsWith("$") ? name.substring(1) : name;
+      if (key.startsWith("IF_CLIENT_") && !simulating) declareAutomationRule(key, value.toString());
     }
     return;
   }
 
+  // Slot reserved at link time; outside a FUNCTION it assigns a global like VAR
+  if (line.startsWith("LOCAL ")) {
+    String decl = line.substring(6);
+    int eqIdx = decl.indexOf('=');
+    String name = eqIdx > 0 ? decl.substring(0, eqIdx) : decl;
+    name.trim();
+    ScriptValue value;
+    if (eqIdx > 0) value = evalValueExpression(decl.substring(eqIdx + 1));
+    assignVariable(name, value);
+    return;
+  }
+
   if (line.startsWith("BEGIN_ROWER")) {
     // Already handled in pre-scan or skip
     return;
@@ -633,7 +1061,11 @@ void executeCommand(String line) {
     String cmd = line.substring(0, eqIdx);
     String val = line.substring(eqIdx + 1);
     variables[cmd] = val;
-    Serial.println("Background automation set: " + cmd + " = " + val);
+    if (declareAutomationRule(cmd, val)) {
+      Serial.println("Background automation set: " + cmd + " = " + val);
+    } else {
+      Serial.println("Background automation ignored (bad value): " + cmd + " = " + val);
+    }
     return;
   }
 
@@ -650,11 +1082,10 @@ void executeCommand(String line) {
     String scriptName = line.substring(16);
     scriptName.trim();
     if (!scriptName.endsWith(".txt")) scriptName += ".txt";
-    String fullPath = String(DIR_SCRIPTS) + "/" + scriptName;
-    if (SD.exists(fullPath)) {
-      preferences.putString("boot_script", scriptName);
+    if (scriptExists(scriptName)) {
       currentBootScriptFiles.clear();
       currentBootScriptFiles.push_back(scriptName);
+      markSettingDirty(SETTING_BOOT_SCRIPT);
       bootScript = loadScript(scriptName);
       bootModeEnabled = true;
       Serial.println("Boot script set to: " + scriptName);
@@ -855,7 +1286,9 @@ void executeCommand(String line) {
 
   for (auto const& km : keyMap) {
     if (line == km.name) {
+      beginReplayRecording();
       fastPressKey(km.key);
+      endReplayRecording();
       return;
     }
   }
@@ -901,7 +1334,7 @@ void executeCommand(String line) {
   if (line.startsWith("RUN_AT_DAY = ")) {
      String targetDay = line.substring(13); targetDay.trim();
      // While loop blocking as requested in RUN_AT_TIME style
-     while (variables["DAY"] != targetDay && !stopRequested) delay(5000);
+     while (variables["DAY"].toString() != targetDay && !stopRequested) delay(5000);
      return;
   }
 
@@ -909,7 +1342,7 @@ void executeCommand(String line) {
     currentUSBConfig.vid = line.substring(4);
     currentUSBConfig.rndVid = false;
     USB.VID((uint16_t)strtol(currentUSBConfig.vid.c_str(), NULL, 16));
-    saveSettings();
+    markSettingDirty(SETTING_USB);
     return;
   }
 
@@ -917,25 +1350,26 @@ void executeCommand(String line) {
     currentUSBConfig.pid = line.substring(4);
     currentUSBConfig.rndPid = false;
     USB.PID((uint16_t)strtol(currentUSBConfig.pid.c_str(), NULL, 16));
-    saveSettings();
+    markSettingDirty(SETTING_USB);
     return;
   }
 
   if (line.startsWith("MAN_")) {
     currentUSBConfig.mfr = line.substring(4);
     USB.manufacturerName(currentUSBConfig.mfr.c_str());
-    saveSettings();
+    markSettingDirty(SETTING_USB);
     return;
   }
 
   if (line.startsWith("PRODUCT_")) {
     currentUSBConfig.prod = line.substring(8);
     USB.productName(currentUSBConfig.prod.c_str());
-    saveSettings();
+    markSettingDirty(SETTING_USB);
     return;
   }
 
   if (line == "REBOOT") {
+    commitSettings();
     Serial.println("Rebooting device...");
     delay(500);
     ESP.restart();
@@ -1057,7 +1491,7 @@ void executeCommand(String line) {
     task.type = "TIME_TRIGGER";
     task.payload = target;
     task.active = true;
-    activeTasks.push_back(task);
+    scheduleTimedTask(task);
     return;
   }
 
@@ -1070,7 +1504,7 @@ void executeCommand(String line) {
     task.type = "DAY_TRIGGER";
     task.payload = target;
     task.active = true;
-    activeTasks.push_back(task);
+    scheduleTimedTask(task);
     return;
   }
 
@@ -1086,6 +1520,7 @@ void executeCommand(String line) {
       task.payload = ssid;
       task.active = true;
       activeTasks.push_back(task);
+      activeTasksChanged = true;
     }
     return;
   }
@@ -1163,15 +1598,22 @@ void executeCommand(String line) {
 
   if (line.startsWith("REPEAT ")) {
     int count = line.substring(7).toInt();
-    String cmdToRepeat = lastCommand; // This will be the command BEFORE the current REPEAT
+    if (replayValid) {
+      for (int j = 0; j < count && !stopRequested; j++) {
+        replayHidStrokes(replayStrokes);
+      }
+      return;
+    }
+    // Dynamic command: dispatch again, skipping the lastCommand/history bookkeeping
+    const String& cmdToRepeat = lastCommand;
     for (int j = 0; j < count && !stopRequested; j++) {
-      executeCommand(cmdToRepeat);
+      dispatchCommand(cmdToRepeat);
     }
     return;
   }
 
   if (line == "SHUTDOWN") { ESP.deepSleep(0); return; }
-  if (line == "REBOOT") { ESP.restart(); return; }
+  if (line == "REBOOT") { commitSettings(); ESP.restart(); return; }
   if (line == "DETECT_OS") { detectOS(); return; }
   if (line == "SELFDESTRUCT" || line.startsWith("SELFDESTRUCT ")) {
     selfDestruct();
@@ -1187,11 +1629,32 @@ void executeCommand(String line) {
     if (buttonPin > 0) pinMode(buttonPin, INPUT_PULLUP);
     return;
   }
+  if (line == "CHECKPOINT") {
+    requestCursorWrite();
+    return;
+  }
+  if (line.startsWith("CHECKPOINT_INTERVAL ")) {
+    cursorInterval = line.substring(20).toInt();
+    return;
+  }
+  if (line == "RESUME") {
+    // Continues the last interrupted file-backed run once this script finishes
+    if (hasExecutionCursor()) queueResumeJob("cursor");
+    else Serial.println("RESUME: no saved execution cursor");
+    return;
+  }
+
+  // Resolved IMPORTs are linked away before the run; one left here failed to load
+  if (line.startsWith("IMPORT ")) {
+    lastError = "Module not found: " + line.substring(7);
+    errorCount++;
+    return;
+  }
+
   if (line.startsWith("RUN_PAYLOAD ")) {
     String f = line.substring(12); f.trim();
-    if (!f.startsWith("/")) f = "/scripts/" + f;
-    File file = SD.open(f);
-    if (file) { String s = file.readString(); file.close(); executeScript(s); }
+    // Runs once the current script finishes (it used to be dropped as "already running")
+    queueScriptFileJob("payload", f, SCRIPT_PRIORITY_HIGH);
     return;
   }
 
@@ -1244,7 +1707,7 @@ void executeCommand(String line) {
     varVal.trim();
     
     if (varName == "VAR" || varName.startsWith("VAR_") || varName.startsWith("VARIABLE_")) {
-      variables[varName] = processVariables(varVal);
+      variables[varName] = ScriptValue::parse(processVariables(varVal));
       return;
     }
   }
@@ -1289,7 +1752,73 @@ void executeCommand(String line) {
     return;
   }
 
+  beginReplayRecording();
   handleKeyInput(line);
+  endReplayRecording();
+}
+
+// Resolves "$name", "${name}" or "name" against the store, whichever spelling VAR used
+static const ScriptValue* findVariable(String name) {
+  if (name.startsWith("${") && name.endsWith("}")) name = name.substring(2, name.length() - 1);
+  const ScriptValue* local = findLocal(name);
+  if (local) return local;
+  auto it = variables.find(name);
+  if (it == variables.end()) it = variables.find(name.startsWith("$") ? name.substring(1) : "$" + name);
+  return it == variables.end() ? nullptr : &it->second;
+}
+
+static ScriptValue operandValue(String text) {
+  text.trim();
+  const ScriptValue* var = findVariable(text);
+  if (var) return var->type == VALUE_STRING ? ScriptValue::parse(var->s) : *var;
+  return ScriptValue::parse(processVariables(text));
+}
+
+// VAR right-hand side: "a OP b" with + - * / stays integer while both sides are
+// integers (division only when exact). Anything non-numeric is stored as text.
+ScriptValue evalValueExpression(String expr) {
+  expr.trim();
+  const char ops[] = {'+', '-', '*', '/'};
+  for (char op : ops) {
+    int opIdx = expr.indexOf(op, 1);  // A leading '-' is a sign
+    if (opIdx == -1) continue;
+    ScriptValue a = operandValue(expr.substring(0, opIdx));
+    ScriptValue b = operandValue(expr.substring(opIdx + 1));
+    if (!a.isNumber() || !b.isNumber()) break;
+    if (a.type == VALUE_INT && b.type == VALUE_INT) {
+      if (op == '+') return ScriptValue(a.i + b.i);
+      if (op == '-') return ScriptValue(a.i - b.i);
+      if (op == '*') return ScriptValue(a.i * b.i);
+      if (b.i == 0) return ScriptValue((int64_t)0);
+      if (a.i % b.i == 0) return ScriptValue(a.i / b.i);
+    }
+    double x = a.asDouble(), y = b.asDouble();
+    if (op == '+') return ScriptValue(x + y);
+    if (op == '-') return ScriptValue(x - y);
+    if (op == '*') return ScriptValue(x * y);
+    return y != 0 ? ScriptValue(x / y) : ScriptValue((int64_t)0);
+  }
+  const ScriptValue* var = findVariable(expr);
+  if (var) return *var;
+  return ScriptValue::parse(processVariables(expr));
+}
+
+// Replaces "${key}", "$key" and whole-word "key" with val
+static void substituteVariable(String& result, const String& key, const String& val) {
+  result.replace("${" + key + "}", val);
+  result.replace("$" + key, val);
+
+  int idx = 0;
+  while ((idx = result.indexOf(key, idx)) != -1) {
+    bool startOk = (idx == 0 || (!isalnum(result.charAt(idx - 1)) && result.charAt(idx - 1) != '_'));
+    bool endOk = (idx + key.length() >= result.length() || (!isalnum(result.charAt(idx + key.length())) && result.charAt(idx + key.length()) != '_'));
+    if (startOk && endOk) {
+      result = result.substring(0, idx) + val + result.substring(idx + key.length());
+      idx += val.length();
+    } else {
+      idx += key.length();
+    }
+  }
 }
 
 String processVariables(String text) {
@@ -1310,7 +1839,7 @@ String processVariables(String text) {
            String padChar = params.substring(commaIdx + 1);
            if (padChar.startsWith("\"")) padChar = padChar.substring(1, padChar.length() - 1);
            
-           String paddedVal = val;
+           String paddedVal = val.toString();
            while (paddedVal.length() < padLen) paddedVal = padChar + paddedVal;
            result.replace(result.substring(startIdx, endIdx + 2), paddedVal);
          }
@@ -1318,29 +1847,38 @@ String processVariables(String text) {
     }
   }
 
-  // Sort keys by length descending to prevent partial replacements
-  std::vector<String> keys;
-  for (auto const& [key, val] : variables) keys.push_back(key);
-  std::sort(keys.begin(), keys.end(), [](const String& a, const String& b) {
-    return a.length() > b.length();
+  // Locals of the active call shadow globals of the same name
+  if (activeFrame) {
+    for (int k : activeFunction->substituteOrder) {
+      const String& key = activeFunction->slotNames[k];
+      if (result.indexOf(key) == -1) continue;
+      substituteVariable(result, key, activeFrame->locals[k].toString());
+    }
+  }
+
+  if (variables.empty()) return result;
+
+  // Sort keys by length descending to prevent partial replacements. The order
+  // is scratch: pointers to the map's own keys, held in the script arena (or on
+  // the heap when the arena cannot grow, so "$name" is never typed raw).
+  ArenaScope scratch(scriptArena);
+  std::vector<const String*> heapKeys;
+  const String** keys = scriptArena.allocArray<const String*>(variables.size());
+  if (!keys) {
+    heapKeys.resize(variables.size());
+    keys = heapKeys.data();
+  }
+  size_t keyCount = 0;
+  for (auto const& [key, val] : variables) keys[keyCount++] = &key;
+  std::sort(keys, keys + keyCount, [](const String* a, const String* b) {
+    return a->length() > b->length();
   });
 
-  for (String const& key : keys) {
-    String val = variables[key];
-    result.replace("${" + key + "}", val);
-    result.replace("$" + key, val);
-    
-    int idx = 0;
-    while ((idx = result.indexOf(key, idx)) != -1) {
-      bool startOk = (idx == 0 || (!isalnum(result.charAt(idx - 1)) && result.charAt(idx - 1) != '_'));
-      bool endOk = (idx + key.length() >= result.length() || (!isalnum(result.charAt(idx + key.length())) && result.charAt(idx + key.length()) != '_'));
-      if (startOk && endOk) {
-        result = result.substring(0, idx) + val + result.substring(idx + key.length());
-        idx += val.length();
-      } else {
-        idx += key.length();
-      }
-    }
+  for (size_t k = 0; k < keyCount; k++) {
+    const String& key = *keys[k];
+    // Every pattern below contains the bare name; skip the text conversion otherwise
+    if (result.indexOf(key) == -1) continue;
+    substituteVariable(result, key, variables[key].toString());
   }
   return result;
 }
@@ -1416,153 +1954,19 @@ void selfDestruct() {
 #include <WiFi.h>
 #include <vector>
 
-extern std::vector<String> foundBTDevices;
-extern bool deviceConnected;
-
-void processRower() {
-  if (rower.active && !scriptRunning) {
-    if (rower.currentPayloadIdx < rower.payloads.size()) {
-      String nextPayload = rower.payloads[rower.currentPayloadIdx];
-      rower.currentPayloadIdx++;
-      Serial.println("Rower executing next: " + nextPayload);
-      
-      // Load and execute
-      String content = loadScript(nextPayload);
-      if (content.length() > 0) {
-        executeScript(content);
-      }
-    } else {
-      rower.active = false;
-      rower.payloads.clear();
-      Serial.println("Rower completed.");
-    }
-  }
-}
-
-void processAutomation() {
-  static unsigned long lastCheck = 0;
-  if (millis() - lastCheck < 2000 || scriptRunning) return; 
-  lastCheck = millis();
-
-  // 1. WiFi Connection Triggers
-  int currentWiFiClients = WiFi.softAPgetStationNum();
-  static int lastWiFiClients = 0;
-  if (currentWiFiClients != lastWiFiClients) {
-    if (variables.count("IF_CLIENT_CONNECTED_DISCONNECTED_WIFI") || variables.count("IF_CLIENT_CONNECTED_DISCONNECTED")) {
-       String content = loadScript("/scripts/wifi_change.txt");
-       if (content.length() > 0) executeScript(content);
-    }
-    if (currentWiFiClients > lastWiFiClients) {
-      if (variables.count("IF_CLIENT_CONNECTED_WIFI") || variables.count("IF_CLIENT_CONNECTED")) {
-         String content = loadScript("/scripts/wifi_connect.txt");
-         if (content.length() > 0) executeScript(content);
-      }
-    } else if (currentWiFiClients < lastWiFiClients) {
-      if (variables.count("IF_CLIENT_DISCONNECTED_WIFI") || variables.count("IF_CLIENT_DISCONNECTED")) {
-         String content = loadScript("/scripts/wifi_disconnect.txt");
-         if (content.length() > 0) executeScript(content);
-      }
-    }
-  }
-  lastWiFiClients = currentWiFiClients;
-
-  // 2. Bluetooth Connection Triggers
-  static bool lastBTConnected = false;
-  if (deviceConnected != lastBTConnected) {
-    if (variables.count("IF_CLIENT_CONNECTED_DISCONNECTED_BLUETOOTH") || variables.count("IF_CLIENT_CONNECTED_DISCONNECTED")) {
-       String content = loadScript("/scripts/bt_change.txt");
-       if (content.length() > 0) executeScript(content);
-    }
-    if (deviceConnected && !lastBTConnected) {
-      if (variables.count("IF_CLIENT_CONNECTED_BLUETOOTH") || variables.count("IF_CLIENT_CONNECTED")) {
-         String content = loadScript("/scripts/bt_connect.txt");
-         if (content.length() > 0) executeScript(content);
-      }
-    } else if (!deviceConnected && lastBTConnected) {
-      if (variables.count("IF_CLIENT_DISCONNECTED_BLUETOOTH") || variables.count("IF_CLIENT_DISCONNECTED")) {
-         String content = loadScript("/scripts/bt_disconnect.txt");
-         if (content.length() > 0) executeScript(content);
-      }
-    }
-  }
-  lastBTConnected = deviceConnected;
-
-  // 3. Bluetooth Discovery Triggers
-  if (btDiscoveryEnabled && !foundBTDevices.empty()) {
-    String triggerName = "";
-    if (variables.count("RUN_WHEN_BLUETOOTH_FOUND")) triggerName = variables["RUN_WHEN_BLUETOOTH_FOUND"];
-    else if (variables.count("RUN_WHEN_BT_FOUND")) triggerName = variables["RUN_WHEN_BT_FOUND"];
-    else if (variables.count("BT_FOUND")) triggerName = variables["BT_FOUND"];
-
-    if (triggerName.length() > 0) {
-      triggerName.replace("\"", ""); // Strip quotes
-      for (String& device : foundBTDevices) {
-        if (device.indexOf(triggerName) != -1) {
-          Serial.println("Bluetooth automation trigger: Found " + device);
-          String content = loadScript("/scripts/bt_found.txt");
-          if (content.length() > 0) executeScript(content);
-          foundBTDevices.clear(); // Prevent re-triggering immediately
-          break;
-        }
-      }
-    }
-  }
-
-  // 4. Legacy WiFi Status Automation
-  for (auto const& [key, val] : variables) {
-    if (key.indexOf("_WHEN_WIFI=") != -1) {
-      int q1 = val.indexOf('"') + 1, q2 = val.indexOf('"', q1);
-      if (q2 > q1) {
-        String ssid = val.substring(q1, q2);
-        bool online = (val.indexOf("IS_ONLINE") != -1);
-        scanWiFi();
-        bool present = isSSIDPresent(ssid);
-        
-        if (present == online) {
-          if (key.startsWith("WIFI_OFF")) WiFi.mode(WIFI_OFF);
-          else if (key.startsWith("WIFI_ON")) setupAP();
-          else if (key.startsWith("BLUETOOTH_OFF")) stopBT();
-          else if (key.startsWith("BLUETOOTH_ON")) setupBT();
-        }
-      }
-    }
-  }
-}
-
-void saveSettings() {
-  preferences.putString("ap_ssid", ap_ssid);
-  preferences.putString("ap_password", ap_password);
-  preferences.putString("language", currentLanguage);
-  String bootFiles = "";
-  for (size_t i=0; i<currentBootScriptFiles.size(); i++) {
-    if (i > 0) bootFiles += ",";
-    bootFiles += currentBootScriptFiles[i];
-  }
-  preferences.putString("boot_script", bootFiles);
-  preferences.putInt("wifi_scan_time", wifiScanTime);
-  preferences.putBool("led_enabled", ledEnabled);
-  preferences.putBool("logging_enabled", loggingEnabled);
-  preferences.putBool("autoconnect", autoConnectEnabled);
-  preferences.putBool("save_creds", saveOnConnectEnabled);
-  preferences.putBool("bt_discovery", btDiscoveryEnabled);
-  preferences.putString("usb_vid", currentUSBConfig.vid);
-  preferences.putString("usb_pid", currentUSBConfig.pid);
-  preferences.putBool("usb_rndVid", currentUSBConfig.rndVid);
-  preferences.putBool("usb_rndPid", currentUSBConfig.rndPid);
-  preferences.putString("usb_mfr", currentUSBConfig.mfr);
-  preferences.putString("usb_prod", currentUSBConfig.prod);
-  Serial.println("Settings saved");
-}
-
 // ============================================================
 // Background Task Processing
 // ============================================================
+static void onTimedTaskDue(const BackgroundTask& task) {
+  if (task.type == "TIME_TRIGGER") Serial.println("[Task] Time trigger hit: " + task.payload);
+  else Serial.println("[Task] Day trigger hit: " + task.payload);
+}
+
 void processBackgroundTasks() {
+  processTimedTasks(onTimedTaskDue);
+  // Only polled tasks (WiFi join/trigger, SD removal) live in activeTasks
   if (activeTasks.empty()) return;
 
-  String curTime = getTime("us");
-  String curDay = getDay("us");
-
   for (auto it = activeTasks.begin(); it != activeTasks.end(); ) {
     bool completed = false;
 
@@ -1582,18 +1986,6 @@ void processBackgroundTasks() {
         WiFi.disconnect();
       }
     } 
-    else if (it->type == "TIME_TRIGGER") {
-      if (curTime.startsWith(it->payload)) {
-        Serial.println("[Task] Time trigger hit: " + it->payload);
-        completed = true;
-      }
-    }
-    else if (it->type == "DAY_TRIGGER") {
-      if (curDay.equalsIgnoreCase(it->payload)) {
-        Serial.println("[Task] Day trigger hit: " + it->payload);
-        completed = true;
-      }
-    }
     else if (it->type == "WIFI_TRIGGER") {
       if (isSSIDPresent(it->payload)) {
         Serial.println("[Task] WiFi trigger hit: " + it->payload);
@@ -1621,6 +2013,7 @@ void processBackgroundTasks() {
 
     if (completed) {
       it = activeTasks.erase(it);
+      activeTasksChanged = true;
     } else {
       ++it;
     }
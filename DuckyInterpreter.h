@@ -2,16 +2,110 @@
 #define DUCKY_INTERPRETER_H
 
 #include "GlobalState.h"
+#include <memory>
 
-void executeScript(const String& script);
-void executeCommand(String line);
+// WHILE header resolved at link time: the jump target past its END_WHILE, the
+// condition split into operands around its comparison, and the loop guards.
+struct WhileBlock {
+  int endLine = -1;
+  String left;            // Whole condition when there is no comparison
+  String right;
+  int op = -1;            // Index into the comparison table, -1 for evalCondition(left)
+  uint32_t maxIterations = WHILE_DEFAULT_MAX_ITERATIONS;  // 0 = unbounded
+  uint32_t timeoutMs = 0;                                  // 0 = no timeout
+};
+
+// FUNCTION resolved at link time: body bounds and the local slot layout.
+// Slots 0..paramCount-1 are the parameters, then LOCAL declarations in order.
+struct FunctionInfo {
+  int endLine = -1;                  // Matching END_FUNCTION
+  int paramCount = 0;
+  std::vector<String> slotNames;     // As written, e.g. "$count"
+  std::vector<int> substituteOrder;  // Slot indices, longest name first, for processVariables
+};
+
+// A script split once into trimmed, non-empty lines with FUNCTION labels resolved.
+// Lines live NUL-separated in one buffer (PSRAM when available).
+struct CompiledScript {
+  char* text = nullptr;
+  size_t textSize = 0;
+  size_t sourceBytes = 0;
+  uint32_t hash = 0;
+  std::vector<uint32_t> lineOffsets;
+  std::vector<uint32_t> sourceOffsets;  // Byte offset of each line in the source
+  std::map<String, int> functionTable;
+  std::map<int, WhileBlock> whileBlocks;  // Keyed by the WHILE line
+  std::map<int, FunctionInfo> functions;  // Keyed by the FUNCTION line
+
+  // Set when compiled from an SD file; enables the persisted execution cursor
+  String sourcePath;
+  uint32_t sourceBase = 0;  // Source byte offset the text starts at
+  size_t sourceFileSize = 0;
+  time_t sourceMtime = 0;
+
+  CompiledScript() = default;
+  CompiledScript(const CompiledScript&) = delete;
+  CompiledScript& operator=(const CompiledScript&) = delete;
+  ~CompiledScript();
+  size_t lineCount() const { return lineOffsets.size(); }
+  const char* line(size_t i) const { return text + lineOffsets[i]; }
+};
+
+typedef std::shared_ptr<CompiledScript> CompiledScriptPtr;
+
+struct LoopState {
+  int startLine;
+  int currentIteration;
+  int totalIterations;
+  String varName;
+  int step;
+  ScriptValue* counter = nullptr;  // Slot in variables, resolved lazily after a resume; unused for locals
+  bool isWhile = false;            // WHILE frame: currentIteration counts passes
+  uint32_t startedMs = 0;
+  int callDepth = 0;               // callStack size when the loop was entered
+};
+
+// One active call: where to resume, the callee's locals and where its RETURN value goes
+struct CallFrame {
+  int returnLine = 0;
+  int functionLine = 0;
+  std::vector<ScriptValue> locals;
+  String resultVar;   // Assignment target of "VAR $x = f(...)", empty when the value is dropped
+  int loopDepth = 0;  // Caller's loopStack/ifHandledStack sizes, restored on return
+  int ifDepth = 0;
+};
+
+// Interpreter position within a compiled script — everything a checkpoint needs
+// besides the global variables.
+struct ExecState {
+  int pc = 0;
+  int skipDepth = 0;
+  bool skipActive = false;
+  std::vector<LoopState> loopStack;
+  std::vector<CallFrame> callStack;
+  std::vector<bool> ifHandledStack;
+};
+
+// Variables the interpreter and its helpers assign themselves (HTTP_GET, GET_TIME,
+// WiFi joins, file pickers, ...); ScriptAnalyzer counts them as defined
+extern const char* const BUILTIN_VARIABLES[];
+extern const size_t BUILTIN_VARIABLE_COUNT;
+
+// error: set instead of lastError/errorCount, for callers off the loop task
+CompiledScriptPtr compileScript(const String& script, String* error = nullptr);
+void linkCompiledScript(CompiledScript& script);
+bool parseFunctionCall(const String& text, String& name, String& args);
+bool parseCallAssignment(const String& line, String& target, String& name, String& args);
+// simulate: dry run for ScriptSimulator; commands, live conditions and waits go to its
+// hooks instead of the HID, radios and card (only variables change)
+void executeCompiledScript(CompiledScriptPtr script, const ExecState* resumeFrom = nullptr, bool simulate = false);
+
+void executeCommand(const String& line);
 String processVariables(String text);
+ScriptValue evalValueExpression(String expr);
 bool evalCondition(String condition);
 void detectOS();
 void selfDestruct();
-void saveSettings();
-void processRower();
-void processAutomation();
 void processBackgroundTasks();
 
 #endif // DUCKY_INTERPRETER_H
@@ -22,30 +22,21 @@
 #include "DuckyInterpreter.h"
 #include "WebServerManager.h"
 #include "BTManager.h"
-
-void setup() {
-  Serial.begin(115200);
-  delay(1000);
-
-  pixels.begin();
-  pixels.setBrightness(50);
-  setLED(0, 255, 0);
-
-  preferences.begin("badusb", false);
-
-  ap_ssid = preferences.getString("ap_ssid", DEFAULT_AP_SSID);
-  ap_password = preferences.getString("ap_password", DEFAULT_AP_PASSWORD);
-  currentLanguage = preferences.getString("language", "us");
-  wifiScanTime = preferences.getInt("wifi_scan_time", WIFI_SCAN_TIMEOUT);
-  ledEnabled = preferences.getBool("led_enabled", true);
-  loggingEnabled = preferences.getBool("logging_enabled", false);
-  autoConnectEnabled = preferences.getBool("autoconnect", false);
-  saveOnConnectEnabled = preferences.getBool("save_creds", false);
-  btDiscoveryEnabled = preferences.getBool("bt_discovery", false);
-
-
-  pinMode(RESET_BUTTON_PIN, INPUT_PULLUP);
-
+#include "FileJobManager.h"
+#include "SettingsManager.h"
+#include "ClockManager.h"
+#include "AutomationEngine.h"
+#include "ScriptJobManager.h"
+#include "ScriptCheckpoint.h"
+#include "RowerPipeline.h"
+#include "ScriptSearch.h"
+
+// ============================================================
+// Boot stages — each one ends with markBootStage() so /api/boot-report
+// shows where boot time goes. Script list, language names, history and
+// BLE are not touched here; they load on first use or in the background.
+// ============================================================
+static void bootStorage() {
   if (!initSDCard()) {
     Serial.println("SD Card initialization failed!");
     setLEDMode(2);
@@ -59,14 +50,9 @@ void setup() {
   logDebug("=== BOOT START ===");
   logDebug("AP SSID: " + ap_ssid);
   logDebug("Language pref: " + currentLanguage);
+}
 
-  loadAvailableLanguages();
-  logDebug("Languages loaded: " + String(availableLanguages.size()));
-  for (auto& l : availableLanguages) logDebug("  lang: " + l);
-
-  loadAvailableScripts();
-  logDebug("Scripts loaded: " + String(availableScripts.size()));
-
+static void bootKeymap() {
   if (!loadLanguage(currentLanguage)) {
     Serial.println("Failed to load default language, trying 'us'");
     logDebug("Failed to load language: " + currentLanguage + ", trying 'us'");
@@ -78,8 +64,11 @@ void setup() {
   }
   logDebug("Active language: " + currentLanguage);
   logDebug("Keymap entries: " + String(currentKeymap.size()));
+}
 
-  String bootPref = preferences.getString("boot_script", "");
+// Resolves which boot scripts exist; their content is loaded when a client first connects
+static void bootScriptSelection() {
+  String bootPref = getSavedBootScripts();
   currentBootScriptFiles.clear();
   bootScript = "";
   
@@ -88,37 +77,29 @@ void setup() {
     int end = bootPref.indexOf(',');
     while (end != -1) {
       String file = bootPref.substring(start, end);
-      if (SD.exists(String(DIR_SCRIPTS) + "/" + file)) {
+      if (scriptExists(file)) {
         currentBootScriptFiles.push_back(file);
-        bootScript += loadScript(file) + "\n";
       }
       start = end + 1;
       end = bootPref.indexOf(',', start);
     }
     String lastFile = bootPref.substring(start);
-    if (SD.exists(String(DIR_SCRIPTS) + "/" + lastFile)) {
+    if (scriptExists(lastFile)) {
       currentBootScriptFiles.push_back(lastFile);
-      bootScript += loadScript(lastFile) + "\n";
     }
 
     if (currentBootScriptFiles.size() > 0) {
       bootModeEnabled = true;
-      Serial.println("Boot scripts loaded: " + bootPref);
+      Serial.println("Boot scripts selected: " + bootPref);
     }
-  } else if (SD.exists(String(DIR_SCRIPTS) + "/boot.txt")) {
-    bootScript = loadScript("boot.txt");
+  } else if (scriptExists("boot.txt")) {
     bootModeEnabled = true;
     currentBootScriptFiles.push_back("boot.txt");
     Serial.println("Default boot.txt found");
   }
+}
 
-  currentUSBConfig.vid = preferences.getString("usb_vid", "0x303a");
-  currentUSBConfig.pid = preferences.getString("usb_pid", "0x0002");
-  currentUSBConfig.rndVid = preferences.getBool("usb_rndVid", false);
-  currentUSBConfig.rndPid = preferences.getBool("usb_rndPid", false);
-  currentUSBConfig.mfr = preferences.getString("usb_mfr", "Espressif");
-  currentUSBConfig.prod = preferences.getString("usb_prod", "ESP32-S3");
-
+static void bootUSB() {
   if (currentUSBConfig.rndVid) {
     char buf[7]; sprintf(buf, "0x%04x", (uint16_t)(esp_random() & 0xFFFF));
     currentUSBConfig.vid = String(buf);
@@ -135,36 +116,69 @@ void setup() {
 
   keyboard.begin();
   USB.begin();
-  delay(1000);
+}
 
-  setupAP();
-  bluetoothName = preferences.getString("bt_name", "ESP32-S3");
-  setupBT();
-  setupWebServer();
+static bool hidReadyMarked = false;
 
-  setLED(0, 255, 0);
+static void markHIDReady() {
+  if (hidReadyMarked) return;
+  hidReadyMarked = true;
+  markBootStage("hid_ready");
+}
 
-  // Check for reboot-once script (from RUN_ON_REBOOT block)
-  if (SD.exists("/reboot_script.txt")) {
-    Serial.println("Reboot script found - executing once");
-    String content = loadScript("/reboot_script.txt");
-    SD.remove("/reboot_script.txt");
-    if (content.length() > 0) {
-      delay(2000);
-      executeScript(content);
-    }
-  }
+// Waits for the host to mount the HID interface instead of a fixed delay
+static bool waitForHIDReady(unsigned long timeoutMs) {
+  unsigned long start = millis();
+  while (!USB && millis() - start < timeoutMs) delay(10);
+  if (!USB) return false;
+  markHIDReady();
+  delay(HID_SETTLE_DELAY);
+  return true;
+}
 
-  // Check for USB identity change resume script (from RANDOM_VID/PID/MAN/PRODUCT)
-  if (SD.exists("/temp_resume.txt")) {
-    Serial.println("Resume script found after USB identity change - executing");
-    String content = loadScript("/temp_resume.txt");
-    SD.remove("/temp_resume.txt");
-    if (content.length() > 0) {
-      delay(2000);
-      executeScript(content);
-    }
+static String takePendingPayload(const char* path) {
+  if (!sdCardPresent || !SD.exists(path)) return "";
+  String payload = "";
+  File f = SD.open(path, FILE_READ);
+  if (f) {
+    payload = f.readString();
+    f.close();
   }
+  SD.remove(path);
+  return payload;
+}
+
+void setup() {
+  Serial.begin(115200);
+
+  pixels.begin();
+  pixels.setBrightness(50);
+  setLED(0, 255, 0);
+
+  preferences.begin("badusb", false);
+  loadSettings();
+
+  pinMode(RESET_BUTTON_PIN, INPUT_PULLUP);
+  markBootStage("settings");
+
+  bootStorage();
+  markBootStage("storage");
+
+  bootKeymap();
+  bootScriptSelection();
+  markBootStage("keymap");
+
+  bootUSB();
+  markBootStage("usb_begin");
+
+  setupAP();
+  setupFileJobs();
+  setupWebServer();
+  markBootStage("web_ready");
+
+  setupBTAsync();
+
+  setLED(0, 255, 0);
 
   Serial.println("ESP32-S3 BadUSB Ready!");
   Serial.print("Connect to WiFi: ");
@@ -173,17 +187,19 @@ void setup() {
   Serial.println(ap_password);
   Serial.println("Open browser and go to: 192.168.4.1");
 
-  loadCommandHistory();
-
-  // Check for reboot payload
-  if (sdCardPresent && SD.exists("/reboot_script.txt")) {
-    Serial.println("Reboot payload found! Executing...");
-    File f = SD.open("/reboot_script.txt", FILE_READ);
-    if (f) {
-      String payload = f.readString();
-      f.close();
-      SD.remove("/reboot_script.txt");
-      executeScript(payload);
+  // One-shot payloads: RUN_ON_REBOOT block, then the checkpoint of a script
+  // interrupted by a USB identity change (RANDOM_VID/PID/MAN/PRODUCT)
+  String rebootPayload = takePendingPayload("/reboot_script.txt");
+  bool resumePending = hasScriptCheckpoint();
+  if (rebootPayload.length() > 0 || resumePending) {
+    waitForHIDReady(HID_READY_TIMEOUT);
+    if (rebootPayload.length() > 0) {
+      Serial.println("Reboot payload found - executing once");
+      queueScriptJob("reboot", "reboot_script.txt", rebootPayload, SCRIPT_PRIORITY_HIGH);
+    }
+    if (resumePending) {
+      Serial.println("Checkpoint found after USB identity change - resuming");
+      queueResumeJob("checkpoint");
     }
   }
 }
@@ -192,6 +208,8 @@ void loop() {
   server.handleClient();
   handleLED();
 
+  if (!hidReadyMarked && USB) markHIDReady();
+
   if (millis() - lastSDCheck >= SD_CHECK_INTERVAL) {
     lastSDCheck = millis();
     checkSDCard();
@@ -222,17 +240,28 @@ void loop() {
     }
   }
 
-  if (bootModeEnabled && WiFi.softAPgetStationNum() > 0 && !scriptRunning) {
+  if (bootModeEnabled && WiFi.softAPgetStationNum() > 0 && !scriptJobActive("boot")) {
     Serial.println("Client connected - executing boot script");
     logCommand("BOOT_SCRIPT", "Executing boot script on client connection");
-    executeScript(bootScript);
+    if (currentBootScriptFiles.size() == 1) {
+      // A single file runs through the script cache and keeps an execution cursor
+      queueScriptFileJob("boot", currentBootScriptFiles[0], SCRIPT_PRIORITY_HIGH);
+    } else {
+      if (bootScript.length() == 0) bootScript = loadBootScripts(currentBootScriptFiles);
+      queueScriptJob("boot", "boot script", bootScript, SCRIPT_PRIORITY_HIGH);
+    }
   }
   
   // Background processing for Rower and Automation
   processRower();
   processAutomation();
   processAutoConnect();
+  processClock();
   processBackgroundTasks();
+  processFileJobs();
+  processSettings();
+  processSearchIndex();
+  processScriptJobs();
   
   if (bluetoothToggleEnabled) {
     loopBT();
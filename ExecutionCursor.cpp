@@ -0,0 +1,254 @@
+#include "ExecutionCursor.h"
+#include "ScriptCache.h"
+#include "ScriptModules.h"
+#include "ScriptLibrary.h"
+#include "FSManager.h"
+
+#define CURSOR_KEY "exec_cursor"
+#define CURSOR_STATE_KEY "exec_state"
+#define CURSOR_MAGIC 0x43525355UL  // "USRC"
+
+struct PersistedCursor {
+  uint32_t magic;
+  char path[96];
+  uint32_t fileSize;
+  uint32_t fileMtime;
+  uint32_t scriptHash;
+  uint32_t line;        // Compiled line index to continue from
+  uint32_t byteOffset;  // Offset of that line in the file
+  uint8_t hasFunctions; // Resume needs the whole file for the function table
+  uint8_t reserved[3];
+  int32_t defaultDelay;
+  char language[32];
+  uint32_t stateHash;   // FNV-1a of the CURSOR_STATE_KEY blob (the variable store)
+};
+
+int cursorInterval = SCRIPT_CURSOR_INTERVAL;
+static int linesSinceWrite = 0;
+static bool forceWrite = false;
+static bool cursorWritten = false;
+static const CompiledScript* cursorScript = nullptr;
+static uint32_t savedStateHash = 0;
+
+// Variable store as name/type/value records; rewritten only when its hash changes
+static void putBytes(std::vector<uint8_t>& out, const void* data, size_t len) {
+  const uint8_t* p = (const uint8_t*)data;
+  out.insert(out.end(), p, p + len);
+}
+
+static void putString(std::vector<uint8_t>& out, const String& s) {
+  uint16_t len = s.length();
+  putBytes(out, &len, sizeof(len));
+  putBytes(out, s.c_str(), len);
+}
+
+static bool serializeVariables(std::vector<uint8_t>& out) {
+  for (auto const& [name, value] : variables) {
+    putString(out, name);
+    uint8_t type = value.type;
+    putBytes(out, &type, 1);
+    if (value.type == VALUE_STRING) putString(out, value.s);
+    else if (value.type == VALUE_DOUBLE) putBytes(out, &value.d, sizeof(value.d));
+    else putBytes(out, &value.i, sizeof(value.i));
+    if (out.size() > SCRIPT_CURSOR_STATE_MAX) return false;
+  }
+  return true;
+}
+
+static bool getString(const std::vector<uint8_t>& in, size_t& pos, String& s) {
+  uint16_t len = 0;
+  if (pos + sizeof(len) > in.size()) return false;
+  memcpy(&len, &in[pos], sizeof(len));
+  pos += sizeof(len);
+  if (pos + len > in.size()) return false;
+  s = String();
+  s.concat((const char*)&in[pos], len);
+  pos += len;
+  return true;
+}
+
+static bool deserializeVariables(const std::vector<uint8_t>& in, std::map<String, ScriptValue>& out) {
+  size_t pos = 0;
+  while (pos < in.size()) {
+    String name;
+    if (!getString(in, pos, name) || pos >= in.size()) return false;
+    uint8_t type = in[pos++];
+    ScriptValue value;
+    if (type == VALUE_STRING) {
+      if (!getString(in, pos, value.s)) return false;
+    } else if (type == VALUE_DOUBLE || type == VALUE_INT || type == VALUE_BOOL) {
+      if (pos + 8 > in.size()) return false;
+      value.type = (ScriptValueType)type;
+      if (type == VALUE_DOUBLE) memcpy(&value.d, &in[pos], sizeof(value.d));
+      else memcpy(&value.i, &in[pos], sizeof(value.i));
+      pos += 8;
+    } else {
+      return false;
+    }
+    out[name] = value;
+  }
+  return true;
+}
+
+static uint32_t fnv1a(const std::vector<uint8_t>& data) {
+  uint32_t hash = 2166136261UL;
+  for (uint8_t b : data) hash = (hash ^ b) * 16777619UL;
+  return hash;
+}
+
+void requestCursorWrite() {
+  forceWrite = true;
+}
+
+// Called by the executor after each top-level line (empty loop/call/IF stacks)
+void noteExecutionCursor(const CompiledScript& script, int nextLine) {
+  if (script.sourcePath.length() == 0 || nextLine >= (int)script.lineCount()) return;
+  if (cursorScript != &script) {
+    cursorScript = &script;
+    linesSinceWrite = 0;
+  }
+  linesSinceWrite++;
+  if (!forceWrite && (cursorInterval <= 0 || linesSinceWrite < cursorInterval)) return;
+  forceWrite = false;
+  linesSinceWrite = 0;
+
+  // VARs, DEFAULTDELAY and LOCALE set before this line have to survive the reboot
+  std::vector<uint8_t> state;
+  if (!serializeVariables(state)) {
+    Serial.println("[Cursor] Variables exceed " + String(SCRIPT_CURSOR_STATE_MAX) + " bytes - cursor not saved");
+    if (cursorWritten) preferences.remove(CURSOR_KEY);
+    cursorWritten = false;
+    return;
+  }
+  uint32_t stateHash = fnv1a(state);
+  if (!cursorWritten || stateHash != savedStateHash) {
+    if (state.empty()) preferences.remove(CURSOR_STATE_KEY);
+    else if (preferences.putBytes(CURSOR_STATE_KEY, state.data(), state.size()) != state.size()) return;
+    savedStateHash = stateHash;
+  }
+
+  PersistedCursor cursor = {};
+  cursor.magic = CURSOR_MAGIC;
+  strlcpy(cursor.path, script.sourcePath.c_str(), sizeof(cursor.path));
+  cursor.fileSize = script.sourceFileSize;
+  cursor.fileMtime = (uint32_t)script.sourceMtime;
+  cursor.scriptHash = script.hash;
+  cursor.line = nextLine;
+  cursor.byteOffset = script.sourceBase + script.sourceOffsets[nextLine];
+  cursor.hasFunctions = script.functionTable.empty() ? 0 : 1;
+  cursor.defaultDelay = defaultDelay;
+  strlcpy(cursor.language, currentLanguage.c_str(), sizeof(cursor.language));
+  cursor.stateHash = stateHash;
+  preferences.putBytes(CURSOR_KEY, &cursor, sizeof(cursor));
+  cursorWritten = true;
+}
+
+// A run that ends (completed or stopped on purpose) leaves nothing to resume
+void finishExecutionCursor(const CompiledScript& script) {
+  if (cursorScript == &script) cursorScript = nullptr;
+  forceWrite = false;
+  if (!cursorWritten) return;
+  preferences.remove(CURSOR_KEY);
+  preferences.remove(CURSOR_STATE_KEY);
+  cursorWritten = false;
+}
+
+static bool loadCursor(PersistedCursor& cursor) {
+  if (!preferences.isKey(CURSOR_KEY)) return false;
+  if (preferences.getBytes(CURSOR_KEY, &cursor, sizeof(cursor)) != sizeof(cursor)) return false;
+  cursor.path[sizeof(cursor.path) - 1] = '\0';
+  cursor.language[sizeof(cursor.language) - 1] = '\0';
+  return cursor.magic == CURSOR_MAGIC;
+}
+
+bool hasExecutionCursor() {
+  PersistedCursor cursor;
+  return loadCursor(cursor);
+}
+
+// Puts back the variables, DEFAULTDELAY and keymap the run had at the cursor
+static bool restoreCursorState(const PersistedCursor& cursor) {
+  std::vector<uint8_t> state;
+  if (preferences.isKey(CURSOR_STATE_KEY)) {
+    state.resize(preferences.getBytesLength(CURSOR_STATE_KEY));
+    if (preferences.getBytes(CURSOR_STATE_KEY, state.data(), state.size()) != state.size()) return false;
+  }
+  std::map<String, ScriptValue> saved;
+  if (fnv1a(state) != cursor.stateHash || !deserializeVariables(state, saved)) return false;
+
+  for (auto const& [name, value] : saved) variables[name] = value;
+  defaultDelay = cursor.defaultDelay;
+  if (cursor.language[0] && currentLanguage != cursor.language) loadLanguage(cursor.language);
+  return true;
+}
+
+bool resumeExecutionCursor() {
+  PersistedCursor cursor;
+  if (!loadCursor(cursor) || !sdCardPresent) return false;
+  preferences.remove(CURSOR_KEY);
+  bool stateOk = restoreCursorState(cursor);
+  preferences.remove(CURSOR_STATE_KEY);
+  if (!stateOk) {
+    Serial.println("[Resume] " + String(cursor.path) + " variables missing or corrupt - cursor discarded");
+    lastError = "Resume cursor state corrupt";
+    errorCount++;
+    return false;
+  }
+
+  CompiledScriptPtr script;
+  ExecState state;
+  PackedScriptRef packed;
+  if (findPackedScript(cursor.path, packed)) {
+    // No file of its own to seek in: resume the whole cached script, the hash guards the line
+    if (packed.containerSize != cursor.fileSize || (uint32_t)packed.containerMtime != cursor.fileMtime) {
+      Serial.println("[Resume] " + String(cursor.path) + " library changed - cursor discarded");
+      return false;
+    }
+    script = linkScriptImports(getCachedScript(cursor.path));
+    if (!script || script->hash != cursor.scriptHash || cursor.line >= script->lineCount()) return false;
+    state.pc = cursor.line;
+    Serial.println("[Resume] " + String(cursor.path) + " from line " + String(cursor.line + 1));
+    executeCompiledScript(script, &state);
+    return true;
+  }
+
+  File f = SD.open(cursor.path, FILE_READ);
+  if (!f || f.size() != cursor.fileSize || (uint32_t)f.getLastWrite() != cursor.fileMtime ||
+      cursor.byteOffset >= cursor.fileSize) {
+    if (f) f.close();
+    Serial.println("[Resume] " + String(cursor.path) + " changed or missing - cursor discarded");
+    return false;
+  }
+
+  if (cursor.hasFunctions) {
+    // FUNCTION bodies may sit before the cursor; the cache has the whole file
+    f.close();
+    // Cursor lines index the linked script; a changed module changes its hash
+    script = linkScriptImports(getCachedScript(cursor.path));
+    if (!script || script->hash != cursor.scriptHash || cursor.line >= script->lineCount()) return false;
+    state.pc = cursor.line;
+  } else {
+    // Only the unexecuted tail is read and compiled
+    f.seek(cursor.byteOffset);
+    String remainder = f.readString();
+    f.close();
+    script = compileScript(remainder);
+    if (!script->text || script->lineCount() == 0) return false;
+    script->sourcePath = cursor.path;
+    script->sourceBase = cursor.byteOffset;
+    script->sourceFileSize = cursor.fileSize;
+    script->sourceMtime = cursor.fileMtime;
+  }
+
+  Serial.println("[Resume] " + String(cursor.path) + " from line " + String(cursor.line + 1) +
+                 " (byte " + String(cursor.byteOffset) + ")");
+  executeCompiledScript(script, &state);
+  return true;
+}
+
+String getExecutionCursorJson() {
+  PersistedCursor cursor;
+  if (!loadCursor(cursor)) return "{\"active\":false}";
+  return "{\"active\":true,\"path\":\"" + String(cursor.path) + "\",\"line\":" + String(cursor.line + 1) +
+         ",\"byteOffset\":" + String(cursor.byteOffset) + ",\"interval\":" + String(cursorInterval) + "}";
+}
@@ -0,0 +1,20 @@
+#ifndef EXECUTION_CURSOR_H
+#define EXECUTION_CURSOR_H
+
+#include "GlobalState.h"
+#include "DuckyInterpreter.h"
+
+// Persisted position (NVS) inside a file-backed script, so an unplugged or
+// browned-out run can RESUME from the last top-level line instead of line 1.
+// Written every cursorInterval top-level lines and at CHECKPOINT markers, with the
+// variable store, DEFAULTDELAY and LOCALE the run had reached.
+extern int cursorInterval;
+
+void requestCursorWrite();
+void noteExecutionCursor(const CompiledScript& script, int nextLine);
+void finishExecutionCursor(const CompiledScript& script);
+bool hasExecutionCursor();
+bool resumeExecutionCursor();
+String getExecutionCursorJson();
+
+#endif // EXECUTION_CURSOR_H
@@ -3,7 +3,14 @@
 #include <WiFi.h>
 #include "LEDManager.h"
 #include "LogManager.h"
+#include "ScriptCache.h"
+#include "ScriptLibrary.h"
+#include "ScriptSearch.h"
 #include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <esp_heap_caps.h>
 
 bool initSDCard() {
   SPI.begin(SD_SCK_PIN, SD_MISO_PIN, SD_MOSI_PIN, SD_CS_PIN);
@@ -78,6 +85,7 @@ void checkSDCard() {
       setLEDMode(0);
       setLED(0, 255, 0);
     }
+    clearScriptCache();
     loadAvailableLanguages();
     loadAvailableScripts();
     logCommand("SD_CARD", "SD card inserted");
@@ -98,6 +106,17 @@ void checkSDCard() {
   }
 }
 
+static bool languagesIndexed = false;
+static bool scriptsIndexed = false;
+
+void ensureAvailableLanguages() {
+  if (!languagesIndexed) loadAvailableLanguages();
+}
+
+void ensureAvailableScripts() {
+  if (!scriptsIndexed) loadAvailableScripts();
+}
+
 void loadAvailableLanguages() {
   if (!sdCardPresent) {
     Serial.println("[FS] Language discovery skipped: SD not present");
@@ -129,6 +148,7 @@ void loadAvailableLanguages() {
     file = root.openNextFile();
   }
   root.close();
+  languagesIndexed = true;
   Serial.println("[FS] Discovery complete. Total languages found: " + String(availableLanguages.size()));
 }
 
@@ -142,6 +162,8 @@ void loadAvailableScripts() {
   }
 
   availableScripts.clear();
+  clearScriptLibraries();
+  std::vector<String> libraryFiles;
 
   File file = root.openNextFile();
   while (file) {
@@ -150,11 +172,21 @@ void loadAvailableScripts() {
       if (fileName.endsWith(".txt")) {
         availableScripts.push_back(fileName);
         Serial.println("Found script: " + fileName);
+      } else if (fileName.endsWith(SCRIPT_LIBRARY_SUFFIX)) {
+        libraryFiles.push_back(fileName);
       }
     }
     file = root.openNextFile();
   }
   root.close();
+  // Marked first: findPackedScript would otherwise rescan from inside the scan
+  scriptsIndexed = true;
+
+  // After the scan, so loose files shadow packed entries of the same name
+  for (const String& library : libraryFiles) {
+    indexScriptLibrary(String(DIR_SCRIPTS) + "/" + library, availableScripts);
+  }
+  queueSearchIndexRescan();
 }
 
 bool loadLanguage(String language) {
@@ -199,6 +231,18 @@ bool loadLanguage(String language) {
 String loadScript(String filename) {
   if (!sdCardPresent) return "";
 
+  PackedScriptRef packed;
+  if (findPackedScript(filename, packed)) {
+    String content;
+    if (!readPackedScript(packed, content)) {
+      lastError = "Packed script unreadable: " + filename;
+      errorCount++;
+      return "";
+    }
+    Serial.println("Loaded packed script: " + filename);
+    return content;
+  }
+
   String filePath = String(DIR_SCRIPTS) + "/" + filename;
   File file = SD.open(filePath);
 
@@ -216,6 +260,20 @@ String loadScript(String filename) {
   return scriptContent;
 }
 
+bool scriptExists(String filename) {
+  PackedScriptRef packed;
+  return findPackedScript(filename, packed) || SD.exists(String(DIR_SCRIPTS) + "/" + filename);
+}
+
+// Concatenates the configured boot scripts; deferred until a boot run actually needs them
+String loadBootScripts(const std::vector<String>& files) {
+  String combined = "";
+  for (const String& file : files) {
+    combined += loadScript(file) + "\n";
+  }
+  return combined;
+}
+
 bool saveScript(String filename, String content) {
   if (!sdCardPresent) return false;
 
@@ -239,6 +297,8 @@ bool saveScript(String filename, String content) {
 
   size_t bytesWritten = file.print(content);
   file.close();
+  invalidateScriptCache(filePath);
+  queueSearchIndexUpdate(filename);
 
   if (bytesWritten > 0) {
     Serial.println("Script saved: " + filename + " (" + String(bytesWritten) + " bytes)");
@@ -259,6 +319,8 @@ bool deleteScript(String filename) {
 
   if (SD.exists(filePath)) {
     if (SD.remove(filePath)) {
+      invalidateScriptCache(filePath);
+      queueSearchIndexUpdate(filename);
       Serial.println("Script deleted: " + filename);
       loadAvailableScripts();
       return true;
@@ -357,7 +419,7 @@ void useFiles(std::vector<String> filePaths) {
   }
   
   if (!selectedFiles.empty()) {
-    variables["SELECTED_FILES"] = String(selectedFiles.size());
+    variables["SELECTED_FILES"] = (int64_t)selectedFiles.size();
   }
 }
 
@@ -385,6 +447,7 @@ void copyFile(String sourcePath, String destPath) {
     Serial.println("File marked for copy: " + sourcePath);
   } else {
     if (copySDFile(sourcePath, destPath)) {
+      invalidateTransferredScripts(sourcePath, destPath);
       Serial.println("File copied: " + sourcePath + " -> " + destPath);
     } else {
       Serial.println("Failed to copy file: " + sourcePath);
@@ -416,6 +479,7 @@ void cutFile(String sourcePath, String destPath) {
     Serial.println("File marked for cut: " + sourcePath);
   } else {
     if (moveSDFile(sourcePath, destPath)) {
+      invalidateTransferredScripts(sourcePath, destPath);
       Serial.println("File moved: " + sourcePath + " -> " + destPath);
     } else {
       Serial.println("Failed to move file: " + sourcePath);
@@ -446,6 +510,7 @@ void pasteFile(String destPath) {
     destFile += fileName;
 
     if (copySDFile(copiedFilePath, destFile)) {
+      invalidateTransferredScripts(copiedFilePath, destFile);
       Serial.println("File pasted: " + copiedFilePath + " -> " + destFile);
     } else {
       Serial.println("Failed to paste file: " + copiedFilePath);
@@ -459,6 +524,7 @@ void pasteFile(String destPath) {
     destFile += fileName;
 
     if (moveSDFile(cutFilePath, destFile)) {
+      invalidateTransferredScripts(cutFilePath, destFile);
       Serial.println("File moved: " + cutFilePath + " -> " + destFile);
       cutFilePath = "";
       fileCut = false;
@@ -470,6 +536,19 @@ void pasteFile(String destPath) {
   }
 }
 
+// The destination may be a directory, in which case the file kept its own name
+void invalidateTransferredScripts(String sourcePath, String destPath) {
+  invalidateScriptCache(sourcePath);
+  invalidateScriptCache(destPath);
+  invalidateScriptCache((destPath.endsWith("/") ? destPath : destPath + "/") + getFileNameFromPath(sourcePath));
+}
+
+String uploadPathFor(String filename) {
+  if (filename.endsWith(".txt") || filename.endsWith(SCRIPT_LIBRARY_SUFFIX)) return String(DIR_SCRIPTS) + "/" + filename;
+  if (filename.endsWith(".json")) return String(DIR_LANGUAGES) + "/" + filename;
+  return String(DIR_UPLOADS) + "/" + filename;
+}
+
 String getFileNameFromPath(String path) {
   int lastSlash = path.lastIndexOf('/');
   if (lastSlash != -1) {
@@ -485,13 +564,8 @@ String getParentDirectory(String path) {
   return path.substring(0, lastSlash);
 }
 
-bool copySDFile(String sourcePath, String destPath) {
-  File sourceFile = SD.open(sourcePath, FILE_READ);
-  if (!sourceFile) {
-    Serial.println("Failed to open source file: " + sourcePath);
-    return false;
-  }
-
+// Resolves a destination that names an existing directory to <dir>/<source name>
+static String resolveDestPath(String sourcePath, String destPath) {
   File destTest = SD.open(destPath);
   if (destTest && destTest.isDirectory()) {
     if (!destPath.endsWith("/")) {
@@ -500,6 +574,17 @@ bool copySDFile(String sourcePath, String destPath) {
     destPath += getFileNameFromPath(sourcePath);
   }
   destTest.close();
+  return destPath;
+}
+
+bool copySDFile(String sourcePath, String destPath, volatile size_t* progress, volatile bool* cancel) {
+  File sourceFile = SD.open(sourcePath, FILE_READ);
+  if (!sourceFile) {
+    Serial.println("Failed to open source file: " + sourcePath);
+    return false;
+  }
+
+  destPath = resolveDestPath(sourcePath, destPath);
 
   if (SD.exists(destPath)) {
     SD.remove(destPath);
@@ -512,31 +597,72 @@ bool copySDFile(String sourcePath, String destPath) {
     return false;
   }
 
-  uint8_t buffer[512];
+  // Large DMA-capable buffer: whole-cluster reads/writes instead of 512-byte round trips
+  size_t bufSize = FILE_COPY_BUFFER_SIZE;
+  uint8_t* buffer = (uint8_t*)heap_caps_malloc(bufSize, MALLOC_CAP_DMA);
+  if (!buffer) {
+    bufSize = 4096;
+    buffer = (uint8_t*)malloc(bufSize);
+  }
+  if (!buffer) {
+    Serial.println("Failed to allocate copy buffer");
+    sourceFile.close();
+    destFile.close();
+    return false;
+  }
+
+  bool ok = true;
   size_t bytesRead;
-  while ((bytesRead = sourceFile.read(buffer, sizeof(buffer))) > 0) {
-    destFile.write(buffer, bytesRead);
+  while ((bytesRead = sourceFile.read(buffer, bufSize)) > 0) {
+    if (cancel && *cancel) { ok = false; break; }
+    if (destFile.write(buffer, bytesRead) != bytesRead) { ok = false; break; }
+    if (progress) *progress = *progress + bytesRead;
   }
+  free(buffer);
 
   sourceFile.close();
   destFile.close();
 
-  return true;
+  if (!ok) SD.remove(destPath);
+  return ok;
 }
 
-bool moveSDFile(String sourcePath, String destPath) {
-  if (copySDFile(sourcePath, destPath)) {
-    if (SD.remove(sourcePath)) {
-      return true;
-    } else {
-      Serial.println("Failed to remove source file after copy: " + sourcePath);
-      return false;
+bool moveSDFile(String sourcePath, String destPath, volatile size_t* progress, volatile bool* cancel) {
+  String resolved = resolveDestPath(sourcePath, destPath);
+  if (!SD.exists(sourcePath)) {
+    Serial.println("Move source not found: " + sourcePath);
+    return false;
+  }
+  if (resolved == sourcePath) return true;
+
+  // The file lands in <dest>.part first; an existing destination is only replaced
+  // once the data is safely there. Same volume: a rename only rewrites directory entries.
+  String tempPath = resolved + STAGE_FILE_SUFFIX;
+  if (SD.exists(tempPath)) SD.remove(tempPath);
+  bool renamed = SD.rename(sourcePath, tempPath);
+  if (!renamed && !copySDFile(sourcePath, tempPath, progress, cancel)) return false;
+
+  if (SD.exists(resolved)) SD.remove(resolved);
+  if (!SD.rename(tempPath, resolved)) {
+    Serial.println("Failed to commit move, data kept in: " + tempPath);
+    return false;
+  }
+
+  if (renamed) {
+    if (progress) {
+      File moved = SD.open(resolved);
+      if (moved) { *progress = *progress + moved.size(); moved.close(); }
     }
+    return true;
   }
-  return false;
+  if (!SD.remove(sourcePath)) {
+    Serial.println("Failed to remove source file after copy: " + sourcePath);
+    return false;
+  }
+  return true;
 }
 
-bool deleteDirectory(String path) {
+bool deleteDirectory(String path, volatile size_t* progress, volatile bool* cancel) {
   File dir = SD.open(path);
   if (!dir) {
     return false;
@@ -544,15 +670,21 @@ bool deleteDirectory(String path) {
 
   if (!dir.isDirectory()) {
     dir.close();
-    return SD.remove(path);
+    bool removed = SD.remove(path);
+    if (removed && progress) *progress = *progress + 1;
+    return removed;
   }
 
   dir.rewindDirectory();
   File file = dir.openNextFile();
   while (file) {
+    if (cancel && *cancel) {
+      dir.close();
+      return false;
+    }
     String filepath = path + "/" + String(file.name());
     if (file.isDirectory()) {
-      if (!deleteDirectory(filepath)) {
+      if (!deleteDirectory(filepath, progress, cancel)) {
         dir.close();
         return false;
       }
@@ -561,6 +693,7 @@ bool deleteDirectory(String path) {
         dir.close();
         return false;
       }
+      if (progress) *progress = *progress + 1;
     }
     file = dir.openNextFile();
   }
@@ -670,3 +803,154 @@ bool uploadFileToServer(String localPath, String remoteUrl) {
     return false;
   }
 }
+
+// ============================================================
+// Staged double-buffered writer
+// ============================================================
+// The caller fills one buffer while the writer task flushes the other, so SD
+// latency overlaps with receiving the next chunk. Buffers are STAGE_BUFFER_SIZE
+// (a sector multiple), so every write except the last lands sector-aligned.
+// The producer always holds the free-semaphore of the buffer it is filling.
+struct StageChunk {
+  uint8_t idx;
+  size_t len;
+};
+
+static uint8_t* stageBuf[2] = {nullptr, nullptr};
+static SemaphoreHandle_t stageBufFree[2] = {nullptr, nullptr};
+static QueueHandle_t stageQueue = nullptr;
+static TaskHandle_t stageTask = nullptr;
+static File stageFile;
+static String stageTargetPath = "";
+static String stageTempPath = "";
+static uint8_t stageActive = 0;
+static size_t stageFill = 0;
+static volatile bool stageWriteError = false;
+static bool stageOpen = false;
+
+static void stageWriterTask(void* arg) {
+  StageChunk chunk;
+  for (;;) {
+    if (xQueueReceive(stageQueue, &chunk, portMAX_DELAY) != pdTRUE) continue;
+    if (!stageWriteError) {
+      size_t written = stageFile.write(stageBuf[chunk.idx], chunk.len);
+      if (written != chunk.len) stageWriteError = true;
+    }
+    xSemaphoreGive(stageBufFree[chunk.idx]);
+  }
+}
+
+static bool stageInit() {
+  if (stageTask) return true;
+
+  for (int b = 0; b < 2; b++) {
+    // DMA-capable memory is internal and word-aligned, which the SPI driver can use directly
+    stageBuf[b] = (uint8_t*)heap_caps_malloc(STAGE_BUFFER_SIZE, MALLOC_CAP_DMA);
+    if (!stageBuf[b]) {
+      Serial.println("[FS] Failed to allocate stage buffer");
+      return false;
+    }
+    stageBufFree[b] = xSemaphoreCreateBinary();
+    xSemaphoreGive(stageBufFree[b]);
+  }
+  stageQueue = xQueueCreate(2, sizeof(StageChunk));
+  if (xTaskCreatePinnedToCore(stageWriterTask, "sd_stage", 4096, NULL, 2, &stageTask, 0) != pdPASS) {
+    Serial.println("[FS] Failed to start stage writer task");
+    stageTask = nullptr;
+    return false;
+  }
+  return true;
+}
+
+static void stageSubmit() {
+  if (stageFill == 0) return;
+  StageChunk chunk = {stageActive, stageFill};
+  xQueueSend(stageQueue, &chunk, portMAX_DELAY);
+  stageActive ^= 1;
+  xSemaphoreTake(stageBufFree[stageActive], portMAX_DELAY);
+  stageFill = 0;
+}
+
+// Submits the partial buffer and waits until the writer task has gone idle
+static void stageDrain() {
+  stageSubmit();
+  xSemaphoreTake(stageBufFree[stageActive ^ 1], portMAX_DELAY);
+  xSemaphoreGive(stageBufFree[0]);
+  xSemaphoreGive(stageBufFree[1]);
+}
+
+bool stagedWriteActive() {
+  return stageOpen;
+}
+
+bool stagedWriteBegin(String targetPath) {
+  if (stageOpen) stagedWriteAbort();
+  if (!sdCardPresent || !stageInit()) return false;
+
+  stageTargetPath = targetPath;
+  stageTempPath = targetPath + STAGE_FILE_SUFFIX;
+  if (SD.exists(stageTempPath)) SD.remove(stageTempPath);
+
+  stageFile = SD.open(stageTempPath, FILE_WRITE);
+  if (!stageFile) {
+    Serial.println("[FS] Failed to create staging file: " + stageTempPath);
+    return false;
+  }
+
+  stageActive = 0;
+  stageFill = 0;
+  stageWriteError = false;
+  xSemaphoreTake(stageBufFree[stageActive], portMAX_DELAY);
+  stageOpen = true;
+  return true;
+}
+
+bool stagedWrite(const uint8_t* data, size_t len) {
+  if (!stageOpen) return false;
+  while (len > 0) {
+    size_t n = STAGE_BUFFER_SIZE - stageFill;
+    if (n > len) n = len;
+    memcpy(stageBuf[stageActive] + stageFill, data, n);
+    stageFill += n;
+    data += n;
+    len -= n;
+    if (stageFill == STAGE_BUFFER_SIZE) stageSubmit();
+  }
+  return !stageWriteError;
+}
+
+bool stagedWriteCommit() {
+  if (!stageOpen) return false;
+  stageDrain();
+  stageOpen = false;
+  stageFile.flush();
+  stageFile.close();
+
+  if (stageWriteError) {
+    Serial.println("[FS] Staged write failed, keeping original: " + stageTargetPath);
+    SD.remove(stageTempPath);
+    lastError = "SD write failed: " + stageTargetPath;
+    errorCount++;
+    return false;
+  }
+
+  // FAT rename does not overwrite, so the old file only goes once the new one is complete
+  if (SD.exists(stageTargetPath)) SD.remove(stageTargetPath);
+  invalidateScriptCache(stageTargetPath);
+  if (!SD.rename(stageTempPath, stageTargetPath)) {
+    Serial.println("[FS] Failed to commit staged file: " + stageTargetPath);
+    lastError = "Failed to commit: " + stageTargetPath;
+    errorCount++;
+    return false;
+  }
+  return true;
+}
+
+void stagedWriteAbort() {
+  if (!stageOpen) return;
+  stageDrain();
+  stageOpen = false;
+  stageFile.close();
+  SD.remove(stageTempPath);
+  Serial.println("[FS] Staged write aborted: " + stageTargetPath);
+}
@@ -8,8 +8,12 @@ bool initSDCard();
 void checkSDCard();
 void loadAvailableLanguages();
 void loadAvailableScripts();
+void ensureAvailableLanguages();  // Lazy variants: scan only on first use after boot
+void ensureAvailableScripts();
+String loadBootScripts(const std::vector<String>& files);
 bool loadLanguage(String language);
 String loadScript(String filename);
+bool scriptExists(String filename);  // Loose file or packed library entry
 bool saveScript(String filename, String content);
 bool deleteScript(String filename);
 
@@ -25,10 +29,22 @@ void pasteFile(String destPath);
 
 // Helpers
 String getFileNameFromPath(String path);
+String uploadPathFor(String filename);  // .txt/.pak -> scripts, .json -> languages, else uploads
 String getParentDirectory(String path);
-bool copySDFile(String sourcePath, String destPath);
-bool moveSDFile(String sourcePath, String destPath);
-bool deleteDirectory(String path);
+// progress/cancel are optional hooks used by background file jobs. These run on the
+// file job task and leave the script cache alone; loop-task callers invalidate it.
+bool copySDFile(String sourcePath, String destPath, volatile size_t* progress = nullptr, volatile bool* cancel = nullptr);
+bool moveSDFile(String sourcePath, String destPath, volatile size_t* progress = nullptr, volatile bool* cancel = nullptr);
+bool deleteDirectory(String path, volatile size_t* progress = nullptr, volatile bool* cancel = nullptr);
 bool ensureDirectoryExists(String path);
+void invalidateTransferredScripts(String sourcePath, String destPath);  // Loop task only
+
+// Staged writes: data goes to <path>.part through a double-buffered writer task
+// and replaces <path> only on commit, so an aborted write keeps the old file.
+bool stagedWriteBegin(String targetPath);
+bool stagedWrite(const uint8_t* data, size_t len);
+bool stagedWriteCommit();
+void stagedWriteAbort();
+bool stagedWriteActive();
 
 #endif // FS_MANAGER_H
@@ -0,0 +1,204 @@
+#include "FileJobManager.h"
+#include "FSManager.h"
+#include "LogManager.h"
+#include "ScriptCache.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <algorithm>
+
+struct FileJob {
+  int id;
+  String type;      // COPY, MOVE, DELETE
+  String source;
+  String dest;
+  String state;     // queued, running, done, failed, cancelled
+  volatile size_t bytesDone;
+  size_t bytesTotal;
+  volatile bool cancelRequested;
+  unsigned long queuedAt;
+  unsigned long finishedAt;
+};
+
+static std::vector<FileJob*> fileJobs;
+static SemaphoreHandle_t fileJobsLock = nullptr;
+static QueueHandle_t fileJobQueue = nullptr;
+static int nextFileJobId = 1;
+static volatile bool fileJobsTouchedIndex = false;
+// Cache invalidation owed on the loop task (source/dest pairs); under the lock
+static std::vector<String> finishedTransfers;
+static bool finishedDelete = false;
+
+static FileJob* findFileJob(int id) {
+  for (FileJob* job : fileJobs) {
+    if (job->id == id) return job;
+  }
+  return nullptr;
+}
+
+// Drops the oldest finished jobs once the table is full; caller holds the lock
+static void pruneFileJobs() {
+  for (auto it = fileJobs.begin(); it != fileJobs.end() && fileJobs.size() >= MAX_FILE_JOBS; ) {
+    FileJob* job = *it;
+    if (job->state == "done" || job->state == "failed" || job->state == "cancelled") {
+      delete job;
+      it = fileJobs.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+static void runFileJob(FileJob* job) {
+  bool ok = false;
+  if (job->type == "COPY") {
+    ok = copySDFile(job->source, job->dest, &job->bytesDone, &job->cancelRequested);
+  } else if (job->type == "MOVE") {
+    ok = moveSDFile(job->source, job->dest, &job->bytesDone, &job->cancelRequested);
+  } else if (job->type == "DELETE") {
+    ok = deleteDirectory(job->source, &job->bytesDone, &job->cancelRequested);
+  }
+
+  xSemaphoreTake(fileJobsLock, portMAX_DELAY);
+  if (job->cancelRequested) job->state = "cancelled";
+  else job->state = ok ? "done" : "failed";
+  job->finishedAt = millis();
+  if (job->type == "DELETE") {
+    finishedDelete = true;
+  } else {
+    finishedTransfers.push_back(job->source);
+    finishedTransfers.push_back(job->dest);
+  }
+  String summary = job->type + " #" + String(job->id) + " " + job->state + ": " + job->source;
+  xSemaphoreGive(fileJobsLock);
+
+  fileJobsTouchedIndex = true;
+  Serial.println("[Jobs] " + summary);
+}
+
+static void fileJobTask(void* arg) {
+  int id;
+  for (;;) {
+    if (xQueueReceive(fileJobQueue, &id, portMAX_DELAY) != pdTRUE) continue;
+
+    xSemaphoreTake(fileJobsLock, portMAX_DELAY);
+    FileJob* job = findFileJob(id);
+    bool runnable = job && job->state == "queued";
+    if (runnable) job->state = "running";
+    xSemaphoreGive(fileJobsLock);
+
+    if (runnable) runFileJob(job);
+  }
+}
+
+void setupFileJobs() {
+  if (fileJobQueue) return;
+  fileJobsLock = xSemaphoreCreateMutex();
+  fileJobQueue = xQueueCreate(MAX_FILE_JOBS, sizeof(int));
+  xTaskCreatePinnedToCore(fileJobTask, "file_jobs", 6144, NULL, 1, NULL, 0);
+}
+
+// Called from loop(): the script cache and script/language lists are only touched on the
+// main task, so the worker leaves finished jobs here instead of invalidating itself
+void processFileJobs() {
+  if (!fileJobsTouchedIndex) return;
+  fileJobsTouchedIndex = false;
+
+  std::vector<String> transfers;
+  xSemaphoreTake(fileJobsLock, portMAX_DELAY);
+  transfers.swap(finishedTransfers);
+  bool deleted = finishedDelete;
+  finishedDelete = false;
+  xSemaphoreGive(fileJobsLock);
+
+  if (deleted) clearScriptCache();  // Whole trees: cheaper than matching every path
+  for (size_t k = 0; k + 1 < transfers.size(); k += 2) invalidateTransferredScripts(transfers[k], transfers[k + 1]);
+  loadAvailableScripts();
+  loadAvailableLanguages();
+}
+
+int queueFileJob(String type, String source, String dest) {
+  if (!sdCardPresent) {
+    Serial.println("[Jobs] SD not present, rejecting " + type + ": " + source);
+    return -1;
+  }
+  if (!fileJobQueue) setupFileJobs();
+
+  if (!source.startsWith("/")) source = currentDirectory + source;
+  if (dest != "" && !dest.startsWith("/")) dest = currentDirectory + dest;
+
+  FileJob* job = new FileJob();
+  job->type = type;
+  job->source = source;
+  job->dest = dest;
+  job->state = "queued";
+  job->bytesDone = 0;
+  job->bytesTotal = 0;
+  job->cancelRequested = false;
+  job->queuedAt = millis();
+  job->finishedAt = 0;
+
+  if (type != "DELETE") {
+    File f = SD.open(source);
+    if (f) { job->bytesTotal = f.size(); f.close(); }
+  }
+
+  xSemaphoreTake(fileJobsLock, portMAX_DELAY);
+  pruneFileJobs();
+  if (fileJobs.size() >= MAX_FILE_JOBS) {
+    xSemaphoreGive(fileJobsLock);
+    delete job;
+    Serial.println("[Jobs] Queue full, rejecting " + type + ": " + source);
+    return -1;
+  }
+  job->id = nextFileJobId++;
+  fileJobs.push_back(job);
+  xSemaphoreGive(fileJobsLock);
+
+  // Never block the web server: ids of pruned (cancelled) jobs can still fill the queue
+  // while a long job runs; the worker skips them once it gets there.
+  int id = job->id;
+  if (xQueueSend(fileJobQueue, &id, 0) != pdTRUE) {
+    xSemaphoreTake(fileJobsLock, portMAX_DELAY);
+    fileJobs.erase(std::find(fileJobs.begin(), fileJobs.end(), job));
+    xSemaphoreGive(fileJobsLock);
+    delete job;
+    Serial.println("[Jobs] Queue full, rejecting " + type + ": " + source);
+    return -1;
+  }
+  logDebug("File job #" + String(id) + " queued: " + type + " " + source + " -> " + dest);
+  return id;
+}
+
+bool cancelFileJob(int id) {
+  xSemaphoreTake(fileJobsLock, portMAX_DELAY);
+  FileJob* job = findFileJob(id);
+  bool found = job && (job->state == "queued" || job->state == "running");
+  if (found) {
+    job->cancelRequested = true;
+    if (job->state == "queued") {
+      job->state = "cancelled";
+      job->finishedAt = millis();
+    }
+  }
+  xSemaphoreGive(fileJobsLock);
+  return found;
+}
+
+String getFileJobsJson() {
+  if (!fileJobsLock) return "[]";
+  String json = "[";
+  xSemaphoreTake(fileJobsLock, portMAX_DELAY);
+  for (size_t i = 0; i < fileJobs.size(); i++) {
+    FileJob* job = fileJobs[i];
+    if (i > 0) json += ",";
+    int progress = (job->state == "done") ? 100 :
+                   (job->bytesTotal > 0 ? (int)min((size_t)100, (job->bytesDone * 100) / job->bytesTotal) : 0);
+    json += "{\"id\":" + String(job->id) + ",\"type\":\"" + job->type + "\",\"source\":\"" + job->source +
+            "\",\"dest\":\"" + job->dest + "\",\"state\":\"" + job->state + "\",\"done\":" + String((unsigned long)job->bytesDone) +
+            ",\"total\":" + String((unsigned long)job->bytesTotal) + ",\"progress\":" + String(progress) + "}";
+  }
+  xSemaphoreGive(fileJobsLock);
+  json += "]";
+  return json;
+}
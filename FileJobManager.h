@@ -0,0 +1,13 @@
+#ifndef FILE_JOB_MANAGER_H
+#define FILE_JOB_MANAGER_H
+
+#include "GlobalState.h"
+
+// Background copy/move/delete jobs so large file operations never block the web server
+void setupFileJobs();
+void processFileJobs();
+int queueFileJob(String type, String source, String dest);
+bool cancelFileJob(int id);
+String getFileJobsJson();
+
+#endif // FILE_JOB_MANAGER_H
@@ -23,7 +23,7 @@ std::map<String, String> currentKeymap;
 String currentLanguage = "us";
 int defaultDelay = 0;
 int delayBetweenKeys = 0;
-std::map<String, String> variables;
+std::map<String, ScriptValue> variables;
 String lastCommand = "";
 bool scriptRunning = false;
 bool stopRequested = false;
@@ -79,10 +79,11 @@ unsigned long totalCommandsExecuted = 0;
 String detectedOS = "Unknown";
 
 // File Upload
-File uploadFile;
 String uploadFilename = "";
+UploadStats lastUpload = {0, 0, 0.0f, ""};
 
 std::vector<BackgroundTask> activeTasks;
+bool activeTasksChanged = false;
 int nextTaskId = 1;
 
 bool wifiToggleEnabled = true;
@@ -11,6 +11,7 @@
 #include <Adafruit_NeoPixel.h>
 #include <USB.h>
 #include "Config.h"
+#include "ScriptValue.h"
 
 // Hardware instances
 extern Adafruit_NeoPixel pixels;
@@ -36,7 +37,7 @@ extern std::map<String, String> currentKeymap;
 extern String currentLanguage;
 extern int defaultDelay;
 extern int delayBetweenKeys;
-extern std::map<String, String> variables;
+extern std::map<String, ScriptValue> variables;
 extern String lastCommand;
 extern bool scriptRunning;
 extern bool stopRequested;
@@ -90,9 +91,17 @@ extern unsigned long totalCommandsExecuted;
 extern String detectedOS;
 
 // File Upload
-extern File uploadFile;
 extern String uploadFilename;
 
+struct UploadStats {
+  unsigned long bytes;
+  unsigned long durationMs;
+  float kbps;
+  String error;  // Empty when the last upload was committed
+};
+
+extern UploadStats lastUpload;
+
 struct RowerState {
   std::vector<String> payloads;
   int currentPayloadIdx;
@@ -112,6 +121,7 @@ struct BackgroundTask {
 };
 
 extern std::vector<BackgroundTask> activeTasks;
+extern bool activeTasksChanged;  // Set on every add/remove; the automation watch list rebuilds from it
 extern int nextTaskId;
 
 extern bool wifiToggleEnabled;
@@ -57,8 +57,15 @@ void logDebug(String message) {
   }
 }
 
+static bool historyLoaded = false;
+
+void ensureCommandHistory() {
+  if (!historyLoaded) loadCommandHistory();
+}
+
 void loadCommandHistory() {
   if (!sdCardPresent) return;
+  historyLoaded = true;
 
   if (SD.exists(FILE_HISTORY)) {
     File file = SD.open(FILE_HISTORY);
@@ -97,6 +104,8 @@ void saveCommandHistory() {
 }
 
 void addToHistory(String command) {
+  // Saving rewrites the whole file, so the on-card history must be in memory first
+  ensureCommandHistory();
   commandHistory.push_back(command);
 
   if (commandHistory.size() > MAX_HISTORY_SIZE) {
@@ -113,3 +122,29 @@ void clearErrors() {
   Serial.println("[Log] Errors cleared");
   logDebug("Errors cleared by user");
 }
+
+struct BootStage {
+  const char* name;
+  unsigned long atMs;
+};
+
+static std::vector<BootStage> bootStages;
+
+void markBootStage(const char* name) {
+  unsigned long now = millis();
+  bootStages.push_back({name, now});
+  Serial.println("[Boot] " + String(name) + " @ " + String(now) + " ms");
+}
+
+String getBootReportJson() {
+  String json = "{\"stages\":[";
+  unsigned long prev = 0;
+  for (size_t i = 0; i < bootStages.size(); i++) {
+    if (i > 0) json += ",";
+    json += "{\"name\":\"" + String(bootStages[i].name) + "\",\"atMs\":" + String(bootStages[i].atMs) +
+            ",\"durationMs\":" + String(bootStages[i].atMs - prev) + "}";
+    prev = bootStages[i].atMs;
+  }
+  json += "]}";
+  return json;
+}
@@ -8,8 +8,13 @@ void closeLogFile();
 void logCommand(String type, String command);
 void logDebug(String message);  // Always-on verbose debug log to /logs/debug.txt
 void loadCommandHistory();
+void ensureCommandHistory();  // Loads history on first use instead of at boot
 void saveCommandHistory();
 void addToHistory(String command);
 void clearErrors();
 
+// Boot timeline: millis() since power-on at the end of each setup() stage
+void markBootStage(const char* name);
+String getBootReportJson();
+
 #endif // LOG_MANAGER_H
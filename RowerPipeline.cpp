@@ -0,0 +1,271 @@
+#include "RowerPipeline.h"
+#include "DuckyInterpreter.h"
+#include "ScriptCache.h"
+#include "ScriptJobManager.h"
+#include "ScriptLibrary.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Slot shared with the prefetch task, guarded by prefetchLock. The task clears busy
+// when done; a result from an older generation (rower restarted) is dropped.
+struct RowerPrefetch {
+  int index = -1;
+  uint32_t generation = 0;
+  String path;
+  bool packed = false;        // Read from a script library; resolved on the loop task
+  PackedScriptRef packedRef;
+  bool busy = false;
+  bool ready = false;
+  CompiledScriptPtr script;   // Null with ready set: missing file or out of memory
+  String error;               // Set by the task, reported by the loop task
+  unsigned long compileMs = 0;
+};
+
+struct RowerStats {
+  uint32_t hops = 0;
+  uint32_t prefetchHits = 0;  // Hop queued with a script the task had compiled
+  uint32_t cacheHits = 0;     // Hop already in the compiled script cache
+  uint32_t stalls = 0;        // Hops that had to wait for the prefetch to finish
+  uint32_t failed = 0;
+  uint32_t gaps[ROWER_GAP_HISTORY] = {};
+  uint32_t gapCount = 0;
+  uint64_t gapTotal = 0;
+  uint32_t gapMax = 0;
+  unsigned long lastCompileMs = 0;
+};
+
+enum HopFetch { HOP_READY, HOP_PENDING, HOP_MISSING };
+
+static RowerPrefetch prefetch;
+static RowerStats rowerStats;
+static SemaphoreHandle_t prefetchLock = nullptr;
+static TaskHandle_t prefetchTask = nullptr;
+static bool hopStalled = false;
+static int previousHopJob = -1;
+static int currentHopJob = -1;
+
+static void rowerPrefetchTask(void* arg) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    xSemaphoreTake(prefetchLock, portMAX_DELAY);
+    String path = prefetch.path;
+    uint32_t generation = prefetch.generation;
+    bool packed = prefetch.packed;
+    PackedScriptRef packedRef = prefetch.packedRef;
+    xSemaphoreGive(prefetchLock);
+
+    unsigned long start = millis();
+    String content;
+    bool loaded = false;
+    size_t fileSize = 0;
+    time_t mtime = 0;
+    if (packed) {
+      loaded = readPackedScript(packedRef, content, false);
+      fileSize = packedRef.containerSize;
+      mtime = packedRef.containerMtime;
+    } else {
+      File f = SD.open(path);
+      if (f && !f.isDirectory()) {
+        mtime = f.getLastWrite();
+        fileSize = f.size();
+        content = f.readString();
+        loaded = true;
+      }
+      if (f) f.close();
+    }
+
+    // lastError/errorCount belong to the loop task; failures travel back in the slot
+    CompiledScriptPtr script;
+    String error;
+    if (loaded) {
+      script = compileScript(content, &error);
+      if (script->text) {
+        script->sourcePath = path;
+        script->sourceFileSize = fileSize;
+        script->sourceMtime = mtime;
+      } else {
+        script.reset();
+      }
+    }
+
+    xSemaphoreTake(prefetchLock, portMAX_DELAY);
+    if (prefetch.generation == generation) {
+      prefetch.script = script;
+      prefetch.error = error;
+      prefetch.compileMs = millis() - start;
+      prefetch.ready = true;
+    }
+    prefetch.busy = false;
+    xSemaphoreGive(prefetchLock);
+  }
+}
+
+static void setupRowerPrefetch() {
+  if (prefetchLock) return;
+  prefetchLock = xSemaphoreCreateMutex();
+  if (xTaskCreatePinnedToCore(rowerPrefetchTask, "rower_fetch", 6144, NULL, 1, &prefetchTask, 0) != pdPASS) {
+    prefetchTask = nullptr;  // Hops then load synchronously through the cache
+  }
+}
+
+// Hands payload index to the prefetch task unless it is cached, already fetched, or the task is busy
+static void requestPrefetch(int index) {
+  if (!prefetchTask || index >= (int)rower.payloads.size()) return;
+  if (findCachedScript(rower.payloads[index])) return;
+
+  xSemaphoreTake(prefetchLock, portMAX_DELAY);
+  bool start = !prefetch.busy && prefetch.index != index;
+  if (start) {
+    prefetch.index = index;
+    prefetch.path = resolveScriptPath(rower.payloads[index]);
+    prefetch.packed = findPackedScript(prefetch.path, prefetch.packedRef);
+    prefetch.ready = false;
+    prefetch.script.reset();
+    prefetch.error = "";
+    prefetch.busy = true;
+  }
+  xSemaphoreGive(prefetchLock);
+  if (start) xTaskNotifyGive(prefetchTask);
+}
+
+static HopFetch takeHopScript(int index, CompiledScriptPtr& script, String& error) {
+  const String& name = rower.payloads[index];
+  script = findCachedScript(name);
+  if (script) {
+    rowerStats.cacheHits++;
+    return HOP_READY;
+  }
+  if (!prefetchTask) {
+    script = getCachedScript(name);
+    return script ? HOP_READY : HOP_MISSING;
+  }
+
+  bool taken = false;
+  xSemaphoreTake(prefetchLock, portMAX_DELAY);
+  if (prefetch.index == index && prefetch.ready) {
+    script = prefetch.script;
+    error = prefetch.error;
+    rowerStats.lastCompileMs = prefetch.compileMs;
+    prefetch.script.reset();
+    prefetch.error = "";
+    prefetch.ready = false;
+    prefetch.index = -1;
+    taken = true;
+  }
+  xSemaphoreGive(prefetchLock);
+
+  if (!taken) return HOP_PENDING;
+  if (!script) return HOP_MISSING;
+  addCachedScript(script);  // Later rower passes skip the SD read entirely
+  rowerStats.prefetchHits++;
+  return HOP_READY;
+}
+
+// Gap between one hop finishing and the next starting, once both job times exist
+static void recordHopGap() {
+  if (previousHopJob < 0 || currentHopJob < 0) return;
+  unsigned long prevStart, prevEnd, curStart, curEnd;
+  if (!getScriptJobTimes(previousHopJob, prevStart, prevEnd) || !getScriptJobTimes(currentHopJob, curStart, curEnd)) {
+    previousHopJob = -1;
+    return;
+  }
+  if (prevEnd == 0 || curStart == 0) return;
+
+  uint32_t gap = curStart - prevEnd;
+  rowerStats.gaps[rowerStats.gapCount % ROWER_GAP_HISTORY] = gap;
+  rowerStats.gapCount++;
+  rowerStats.gapTotal += gap;
+  if (gap > rowerStats.gapMax) rowerStats.gapMax = gap;
+  previousHopJob = -1;
+}
+
+void startRower(const std::vector<String>& payloads) {
+  setupRowerPrefetch();
+  rower.payloads = payloads;
+  rower.currentPayloadIdx = 0;
+  rower.active = true;
+  previousHopJob = -1;
+  currentHopJob = -1;
+  hopStalled = false;
+
+  xSemaphoreTake(prefetchLock, portMAX_DELAY);
+  prefetch.generation++;
+  prefetch.index = -1;
+  prefetch.ready = false;
+  prefetch.script.reset();
+  xSemaphoreGive(prefetchLock);
+
+  // The first payload compiles while the script that defined the rower finishes
+  requestPrefetch(0);
+}
+
+void processRower() {
+  if (!rower.active) return;
+  recordHopGap();
+
+  if (scriptJobActive("rower")) {
+    requestPrefetch(rower.currentPayloadIdx);
+    return;
+  }
+
+  if (rower.currentPayloadIdx >= (int)rower.payloads.size()) {
+    rower.active = false;
+    rower.payloads.clear();
+    Serial.println("Rower completed.");
+    return;
+  }
+
+  int index = rower.currentPayloadIdx;
+  CompiledScriptPtr script;
+  String error;
+  HopFetch fetch = takeHopScript(index, script, error);
+  if (fetch == HOP_PENDING) {
+    if (!hopStalled) rowerStats.stalls++;
+    hopStalled = true;
+    requestPrefetch(index);
+    return;
+  }
+  hopStalled = false;
+
+  String name = rower.payloads[index];
+  if (fetch == HOP_MISSING) {
+    rower.currentPayloadIdx++;
+    rowerStats.failed++;
+    lastError = "Rower payload not found: " + name;
+    if (error.length()) lastError = error + ": " + name;
+    errorCount++;
+    return;
+  }
+
+  int id = queueCompiledScriptJob("rower", name, script, SCRIPT_PRIORITY_LOW);
+  if (id < 0) return;  // Queue full: the script is cached now, retry on the next pass
+  rower.currentPayloadIdx++;
+  rowerStats.hops++;
+  previousHopJob = currentHopJob;
+  currentHopJob = id;
+  Serial.println("Rower executing next: " + name);
+
+  // Payload N+1 compiles while N types
+  requestPrefetch(rower.currentPayloadIdx);
+}
+
+String getRowerStatsJson() {
+  uint32_t recent = rowerStats.gapCount < ROWER_GAP_HISTORY ? rowerStats.gapCount : ROWER_GAP_HISTORY;
+  String json = "{\"active\":" + String(rower.active ? "true" : "false") +
+                ",\"index\":" + String(rower.currentPayloadIdx) + ",\"payloads\":" + String(rower.payloads.size()) +
+                ",\"prefetchTask\":" + String(prefetchTask ? "true" : "false") +
+                ",\"hops\":" + String(rowerStats.hops) + ",\"prefetchHits\":" + String(rowerStats.prefetchHits) +
+                ",\"cacheHits\":" + String(rowerStats.cacheHits) + ",\"stalls\":" + String(rowerStats.stalls) +
+                ",\"failed\":" + String(rowerStats.failed) + ",\"lastCompileMs\":" + String(rowerStats.lastCompileMs) +
+                ",\"gapCount\":" + String(rowerStats.gapCount) +
+                ",\"avgGapMs\":" + String(rowerStats.gapCount ? (uint32_t)(rowerStats.gapTotal / rowerStats.gapCount) : 0) +
+                ",\"maxGapMs\":" + String(rowerStats.gapMax) + ",\"recentGapsMs\":[";
+  // Oldest first
+  for (uint32_t k = 0; k < recent; k++) {
+    if (k > 0) json += ",";
+    json += String(rowerStats.gaps[(rowerStats.gapCount - recent + k) % ROWER_GAP_HISTORY]);
+  }
+  json += "]}";
+  return json;
+}
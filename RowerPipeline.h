@@ -0,0 +1,13 @@
+#ifndef ROWER_PIPELINE_H
+#define ROWER_PIPELINE_H
+
+#include "GlobalState.h"
+
+// BEGIN_ROWER payloads run one after another as low-priority script jobs. While
+// payload N types, payload N+1 is read and compiled on a core-0 task, and it is
+// queued the moment N finishes (processScriptJobs calls processRower between jobs).
+void startRower(const std::vector<String>& payloads);
+void processRower();
+String getRowerStatsJson();
+
+#endif // ROWER_PIPELINE_H
@@ -0,0 +1,340 @@
+#include "ScriptAnalyzer.h"
+#include "DuckyInterpreter.h"
+#include "ScriptSimulator.h"
+#include "ScriptModules.h"
+#include <ArduinoJson.h>
+#include <set>
+
+// Line prefixes executeCompiledScript / executeCommand act on
+static const char* const COMMAND_PREFIXES[] = {
+  "STRING ", "STRINGLN ", "DELAY ", "DEFAULTDELAY ", "DEFAULT_DELAY ", "REPEAT ", "VAR ",
+  "HOLD ", "HOLD_TILL_", "STOPHOLD", "KEYCODE ", "LOCALE ", "LOCALE_", "LED ", "LED_", "RGB ",
+  "BLINK_LED_", "BLINK_STOP", "WIFI_ON", "WIFI_OFF", "BLUETOOTH_ON", "BLUETOOTH_OFF",
+  "BLUETOOTH_DISCOVERY ", "RUN_WHEN_BLUETOOTH_FOUND=", "RUN_WHEN_BT_FOUND=", "BT_FOUND=",
+  "SET_BOOT_SCRIPT ", "UPLOAD_FILE ", "DOWNLOAD_FILE ", "HTTP_REQUEST = ", "HTTPS_REQUEST = ",
+  "GET_TIME", "GET_DAY", "RUN_AT_TIME = ", "RUN_AT_DAY = ", "RUN_WHEN_WIFI = ", "VID_", "PID_",
+  "MAN_", "PRODUCT_", "RANDOM_", "REBOOT", "SHUTDOWN", "SELFDESTRUCT", "JOIN_INTERNET",
+  "LEAVE_INTERNET", "SAVE_CREDENTIALS", "WAIT_FOR_SD", "WAIT_FOR_EVENT = ", "PING ", "USE_FILE ",
+  "COPY_FILE ", "CUT_FILE ", "PASTE_FILE", "DETECT_OS", "CD ", "SET_BUTTON_PIN ", "CHECKPOINT",
+  "RESUME", "RUN_PAYLOAD ", "END_ROWER"
+};
+
+// Whole-line key names executeCommand maps before the keymap fallback
+static const char* const KEY_NAMES[] = {
+  "CTRL", "CONTROL", "SHIFT", "ALT", "WINDOWS", "GUI", "ENTER", "TAB", "ESC", "ESCAPE", "DELETE",
+  "DEL", "BACKSPACE", "HOME", "END", "PAGEUP", "PAGEDOWN", "INSERT", "UP", "UPARROW", "DOWN",
+  "DOWNARROW", "LEFT", "LEFTARROW", "RIGHT", "RIGHTARROW", "CAPSLOCK", "NUMLOCK", "SCROLLLOCK",
+  "PRINTSCREEN", "PAUSE", "BREAK", "MENU", "APP"
+};
+
+enum BlockKind { BLOCK_IF, BLOCK_FOR, BLOCK_FUNCTION, BLOCK_ROWER, BLOCK_REBOOT, BLOCK_WHILE };
+static const char* const BLOCK_NAMES[] = {"IF", "FOR", "FUNCTION", "BEGIN_ROWER", "RUN_ON_REBOOT", "WHILE"};
+
+struct OpenBlock {
+  BlockKind kind;
+  int line;  // 1-based source line
+};
+
+struct Analysis {
+  JsonArray diagnostics;
+  int errors = 0;
+  int warnings = 0;
+  int dropped = 0;
+
+  void add(int line, const char* severity, const String& message) {
+    if (strcmp(severity, "error") == 0) errors++;
+    else if (strcmp(severity, "warning") == 0) warnings++;
+    if (diagnostics.size() >= ANALYZER_MAX_DIAGNOSTICS) {
+      dropped++;
+      return;
+    }
+    JsonObject d = diagnostics.createNestedObject();
+    d["line"] = line;
+    d["severity"] = severity;
+    d["message"] = message;
+  }
+};
+
+static bool startsWithAny(const String& line, const char* const* prefixes, size_t count) {
+  for (size_t k = 0; k < count; k++) {
+    if (line.startsWith(prefixes[k])) return true;
+  }
+  return false;
+}
+
+static bool isKeyName(const String& token) {
+  if (currentKeymap.find(token) != currentKeymap.end()) return true;
+  for (const char* name : KEY_NAMES) {
+    if (token == name) return true;
+  }
+  return false;
+}
+
+static String stripSigil(String name) {
+  name.trim();
+  if (name.startsWith("$")) name = name.substring(1);
+  return name;
+}
+
+static bool isIdentChar(char c) {
+  return isalnum((unsigned char)c) || c == '_';
+}
+
+// $name and ${name...} references that no VAR/FOR in the script defines
+static void checkVariableRefs(Analysis& a, int line, const String& text, const std::set<String>& defined) {
+  std::set<String> reported;
+  for (int k = 0; k < (int)text.length(); k++) {
+    if (text[k] != '$') continue;
+    int start = k + 1;
+    if (start < (int)text.length() && text[start] == '{') start++;
+    int end = start;
+    while (end < (int)text.length() && isIdentChar(text[end])) end++;
+    if (end == start) continue;
+    String name = text.substring(start, end);
+    if (defined.count(name) == 0 && reported.insert(name).second) {
+      a.add(line, "warning", "Variable '" + name + "' is never defined in this script");
+    }
+    k = end - 1;
+  }
+}
+
+static void checkTypedText(Analysis& a, int line, const String& text) {
+  if (currentKeymap.empty()) return;
+  String missing;
+  for (int k = 0; k < (int)text.length(); k++) {
+    String ch = String(text[k]);
+    if (currentKeymap.find(ch) == currentKeymap.end() && missing.indexOf(ch) == -1) missing += ch;
+  }
+  if (missing.length() > 0) {
+    a.add(line, "warning", "Not in keymap '" + currentLanguage + "', will be skipped: " + missing);
+  }
+}
+
+static void closeBlock(Analysis& a, std::vector<OpenBlock>& stack, int line, const String& closer, BlockKind kind, BlockKind alt) {
+  if (stack.empty()) {
+    a.add(line, "error", "'" + closer + "' without a matching '" + BLOCK_NAMES[kind] + "'");
+    return;
+  }
+  OpenBlock top = stack.back();
+  if (top.kind != kind && top.kind != alt) {
+    a.add(line, "error", "'" + closer + "' closes the " + BLOCK_NAMES[top.kind] + " opened on line " + String(top.line));
+  }
+  stack.pop_back();
+}
+
+String analyzeScriptJson(const String& source) {
+  CompiledScriptPtr script = compileScript(source);
+  if (!script->text) return "{\"valid\":false,\"message\":\"Out of memory compiling script\"}";
+
+  // Compiled index -> 1-based source line
+  std::vector<int> sourceLines(script->lineCount());
+  int lineNo = 1;
+  size_t scanned = 0;
+  for (size_t idx = 0; idx < script->lineCount(); idx++) {
+    size_t offset = script->sourceOffsets[idx];
+    for (; scanned < offset; scanned++) {
+      if (source[scanned] == '\n') lineNo++;
+    }
+    sourceLines[idx] = lineNo;
+  }
+
+  // Calls, constants and the estimate see imported modules; diagnostics stay on this file's lines
+  CompiledScriptPtr linked = linkScriptImports(script);
+  std::set<String> unresolvedImports;
+  for (size_t idx = 0; idx < linked->lineCount(); idx++) {
+    if (strncmp(linked->line(idx), "IMPORT ", 7) == 0) unresolvedImports.insert(linked->line(idx));
+  }
+
+  // Definitions first: loops and functions may use a variable above its VAR line
+  std::set<String> defined(BUILTIN_VARIABLES, BUILTIN_VARIABLES + BUILTIN_VARIABLE_COUNT);
+  for (size_t idx = 0; idx < linked->lineCount(); idx++) {
+    String line = linked->line(idx);
+    if (line.startsWith("VAR ")) {
+      int eq = line.indexOf('=');
+      if (eq > 4) defined.insert(stripSigil(line.substring(4, eq)));
+    } else if ((line.startsWith("VAR_") || line.startsWith("VARIABLE_")) && line.indexOf('=') > 0) {
+      defined.insert(stripSigil(line.substring(0, line.indexOf('='))));
+    } else if (line.startsWith("FOR ")) {
+      int from = line.indexOf("FROM ");
+      if (from > 4) defined.insert(stripSigil(line.substring(4, from)));
+    }
+  }
+  // Parameters and LOCALs; scoping is the executor's job, here they only count as defined
+  for (auto const& [fnLine, fn] : linked->functions) {
+    for (const String& slot : fn.slotNames) defined.insert(stripSigil(slot));
+  }
+
+  String simulation = simulateScriptJson(linked);
+  DynamicJsonDocument doc(ANALYZER_DOC_SIZE + simulation.length());
+  Analysis a;
+  a.diagnostics = doc.createNestedArray("diagnostics");
+
+  if (currentKeymap.empty()) a.add(0, "info", "No keymap loaded; key checks skipped");
+
+  std::vector<OpenBlock> stack;
+  int maxDepth = 0;
+  int instructions = 0;
+  bool hasCommand = false;
+
+  for (size_t idx = 0; idx < script->lineCount(); idx++) {
+    String line = script->line(idx);
+    const int ln = sourceLines[idx];
+    if (line.startsWith("REM") || line.startsWith("//")) continue;
+    instructions++;
+
+    // Rower payload lines are script names, not commands
+    if (!stack.empty() && stack.back().kind == BLOCK_ROWER) {
+      if (line == "END_ROWER") stack.pop_back();
+      continue;
+    }
+
+    if (line.startsWith("BEGIN_ROWER")) {
+      stack.push_back({BLOCK_ROWER, ln});
+    } else if (line.startsWith("END_RUN_ON_REBOOT")) {
+      closeBlock(a, stack, ln, "END_RUN_ON_REBOOT", BLOCK_REBOOT, BLOCK_REBOOT);
+    } else if (line.startsWith("RUN_ON_REBOOT")) {
+      stack.push_back({BLOCK_REBOOT, ln});
+    } else if (line.startsWith("FUNCTION ") || line.startsWith("DEF_")) {
+      stack.push_back({BLOCK_FUNCTION, ln});
+    } else if (line == "END_FUNCTION") {
+      closeBlock(a, stack, ln, line, BLOCK_FUNCTION, BLOCK_FUNCTION);
+    } else if (line == "RETURN" || line.startsWith("RETURN ") || line.startsWith("LOCAL ")) {
+      bool inFunction = false;
+      for (const OpenBlock& b : stack) if (b.kind == BLOCK_FUNCTION) inFunction = true;
+      if (line.startsWith("LOCAL ")) {
+        if (!inFunction) a.add(ln, "warning", "LOCAL outside a FUNCTION assigns a global");
+        if (line.indexOf('=') != -1) checkVariableRefs(a, ln, line.substring(line.indexOf('=') + 1), defined);
+      } else {
+        if (!inFunction) a.add(ln, "warning", "RETURN outside a FUNCTION does nothing");
+        if (line.startsWith("RETURN ")) checkVariableRefs(a, ln, line.substring(7), defined);
+        hasCommand = true;
+      }
+    } else if (line.startsWith("FOR ")) {
+      int from = line.indexOf("FROM ");
+      int to = line.indexOf("TO ");
+      int step = line.indexOf("STEP ");
+      if (from == -1 || to == -1) {
+        a.add(ln, "error", "FOR needs 'FOR $var FROM a TO b [STEP n]'; this loop is ignored");
+      } else if (step != -1 && line.substring(step + 5).toInt() <= 0) {
+        a.add(ln, "error", "STEP must be positive, or the loop never ends");
+      }
+      stack.push_back({BLOCK_FOR, ln});
+    } else if (line.startsWith("ENDFOR") || line.startsWith("END_FOR")) {
+      closeBlock(a, stack, ln, line, BLOCK_FOR, BLOCK_FOR);
+    } else if (line.startsWith("IMPORT ")) {
+      if (unresolvedImports.count(line)) a.add(ln, "error", "Module '" + line.substring(7) + "' not found on the SD card");
+    } else if (line.startsWith("WHILE ")) {
+      auto blockIt = script->whileBlocks.find(idx);
+      if (blockIt != script->whileBlocks.end()) {
+        const WhileBlock& block = blockIt->second;
+        if (block.left.length() == 0) a.add(ln, "error", "WHILE needs a condition");
+        if (block.maxIterations == 0 && block.timeoutMs == 0) {
+          a.add(ln, "warning", "MAX 0 without a TIMEOUT: only the condition or STOP ends this loop");
+        }
+      }
+      checkVariableRefs(a, ln, line, defined);
+      stack.push_back({BLOCK_WHILE, ln});
+    } else if (line == "END_WHILE") {
+      closeBlock(a, stack, ln, line, BLOCK_WHILE, BLOCK_WHILE);
+    } else if (line.startsWith("ELIF") || line == "ELSE" || line == "ELSE:") {
+      if (stack.empty() || stack.back().kind != BLOCK_IF) a.add(ln, "error", "'" + line + "' without a matching IF");
+      if (line.startsWith("ELIF")) checkVariableRefs(a, ln, line, defined);
+    } else if (line.startsWith("ENDIF") || line.startsWith("END_IF")) {
+      closeBlock(a, stack, ln, line, BLOCK_IF, BLOCK_REBOOT);
+    } else if (line.startsWith("IF")) {
+      if (line == "IF" || line == "IF ") a.add(ln, "error", "IF needs a condition");
+      checkVariableRefs(a, ln, line, defined);
+      stack.push_back({BLOCK_IF, ln});
+    } else if (line == "STRING" || line == "STRINGLN") {
+      a.add(ln, "error", "Empty " + line + " command");
+      hasCommand = true;
+    } else if (line.startsWith("STRING ") || line.startsWith("STRINGLN ")) {
+      String text = line.substring(line.indexOf(' ') + 1);
+      checkTypedText(a, ln, text);
+      checkVariableRefs(a, ln, text, defined);
+      hasCommand = true;
+    } else if (line.startsWith("DELAY ") || line.startsWith("DEFAULTDELAY ") || line.startsWith("DEFAULT_DELAY ")) {
+      String value = line.substring(line.indexOf(' ') + 1);
+      value.trim();
+      if (value.endsWith("ms")) value = value.substring(0, value.length() - 2);
+      value.trim();
+      // DEFAULTDELAY 0 switches the per-command delay off; DELAY 0 is a no-op
+      bool isDefault = !line.startsWith("DELAY ");
+      if (value.toInt() < 0 || (value.toInt() == 0 && (!isDefault || value != "0"))) {
+        a.add(ln, "error", "Invalid delay value '" + value + "'");
+      }
+      hasCommand = true;
+    } else if (line.startsWith("REPEAT ")) {
+      if (line.substring(7).toInt() <= 0) a.add(ln, "error", "Invalid REPEAT count");
+      if (!hasCommand) a.add(ln, "warning", "REPEAT has no previous command to repeat");
+    } else if (line.startsWith("VAR ")) {
+      if (line.indexOf('=') == -1) a.add(ln, "error", "VAR needs 'VAR $name = value'");
+      else checkVariableRefs(a, ln, line.substring(line.indexOf('=') + 1), defined);
+      hasCommand = true;
+    } else if (startsWithAny(line, COMMAND_PREFIXES, sizeof(COMMAND_PREFIXES) / sizeof(COMMAND_PREFIXES[0])) ||
+               ((line.startsWith("VAR_") || line.startsWith("VARIABLE_")) && line.indexOf('=') > 0) ||
+               line.startsWith("WIFI_OFF_WHEN_WIFI=") || line.startsWith("WIFI_ON_WHEN_WIFI=") ||
+               line.startsWith("BLUETOOTH_OFF_WHEN_WIFI=") || line.startsWith("BLUETOOTH_ON_WHEN_WIFI=")) {
+      hasCommand = true;
+    } else {
+      String call, args;
+      parseFunctionCall(line, call, args);
+      auto funcIt = linked->functionTable.find(call);
+      if (funcIt != linked->functionTable.end()) {
+        const FunctionInfo& fn = linked->functions[funcIt->second];
+        int argCount = 0;
+        if (args.length() > 0) {
+          argCount = 1;
+          for (int k = 0; k < (int)args.length(); k++) if (args[k] == ',') argCount++;
+        }
+        if (argCount > fn.paramCount) {
+          a.add(ln, "warning", "'" + call + "' takes " + String(fn.paramCount) + " argument(s); extra ones are ignored");
+        }
+        if (args.length() > 0) checkVariableRefs(a, ln, args, defined);
+      } else if (line.endsWith(")") && line.indexOf('(') > 0 && call.indexOf(' ') == -1) {
+        a.add(ln, "error", "Call to undefined function '" + call + "'");
+      } else if (!currentKeymap.empty()) {
+        int space = line.indexOf(' ');
+        String first = space == -1 ? line : line.substring(0, space);
+        if (!isKeyName(first)) {
+          a.add(ln, "error", "Unknown command '" + first + "'");
+        } else if (space != -1) {
+          // Chords look every token up in the keymap directly
+          String rest = line.substring(space + 1);
+          int s1 = 0, s2;
+          do {
+            s2 = rest.indexOf(' ', s1);
+            String key = s2 == -1 ? rest.substring(s1) : rest.substring(s1, s2);
+            if (key.length() > 0 && currentKeymap.find(key) == currentKeymap.end()) {
+              a.add(ln, "error", "Key '" + key + "' is not in keymap '" + currentLanguage + "'");
+            }
+            s1 = s2 + 1;
+          } while (s2 != -1);
+        }
+      }
+      hasCommand = true;
+    }
+    if ((int)stack.size() > maxDepth) maxDepth = stack.size();
+  }
+
+  for (const OpenBlock& b : stack) {
+    a.add(b.line, "error", String(BLOCK_NAMES[b.kind]) + " is never closed");
+  }
+
+  doc["valid"] = a.errors == 0;
+  doc["errors"] = a.errors;
+  doc["warnings"] = a.warnings;
+  doc["truncated"] = a.dropped;
+  JsonObject metrics = doc.createNestedObject("metrics");
+  metrics["sourceLines"] = lineNo;
+  metrics["instructions"] = instructions;
+  metrics["functions"] = linked->functionTable.size();
+  metrics["variables"] = defined.size();
+  metrics["maxDepth"] = maxDepth;
+  metrics["keymap"] = currentLanguage;
+  doc["simulation"] = serialized(simulation);
+
+  String json;
+  serializeJson(doc, json);
+  return json;
+}
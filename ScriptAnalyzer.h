@@ -0,0 +1,12 @@
+#ifndef SCRIPT_ANALYZER_H
+#define SCRIPT_ANALYZER_H
+
+#include "GlobalState.h"
+
+// Static analysis over the executor's compile pass: block balance, unknown
+// commands, undefined variables/functions and keys missing from the active
+// keymap, reported per source line, plus instruction metrics and the dry-run
+// estimate from ScriptSimulator.
+String analyzeScriptJson(const String& source);
+
+#endif // SCRIPT_ANALYZER_H
@@ -0,0 +1,101 @@
+#include "ScriptArena.h"
+#include <esp_heap_caps.h>
+
+ScriptArena scriptArena;
+
+struct ArenaRunStats {
+  uint32_t runs = 0;
+  size_t lastPeak = 0;
+  uint8_t fragBefore = 0;  // % of free internal heap not in the largest block
+  uint8_t fragAfter = 0;
+  size_t largestBefore = 0;
+  size_t largestAfter = 0;
+};
+static ArenaRunStats runStats;
+
+void* ScriptArena::alloc(size_t bytes, size_t align) {
+  if (bytes == 0) bytes = 1;
+  while (current < chunks.size()) {
+    Chunk& c = chunks[current];
+    size_t start = (c.used + align - 1) & ~(align - 1);
+    if (start + bytes <= c.size) {
+      c.used = start + bytes;
+      size_t total = inUse();
+      if (total > peak) peak = total;
+      return c.data + start;
+    }
+    if (current + 1 < chunks.size()) {
+      chunks[++current].used = 0;
+    } else {
+      break;
+    }
+  }
+
+  size_t size = max((size_t)SCRIPT_ARENA_CHUNK, bytes + align);
+  uint8_t* data = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!data) data = (uint8_t*)malloc(size);
+  if (!data) return nullptr;
+  chunks.push_back({data, size, 0});
+  current = chunks.size() - 1;
+  return alloc(bytes, align);
+}
+
+ScriptArena::Mark ScriptArena::mark() const {
+  if (chunks.empty()) return {0, 0};
+  return {current, chunks[current].used};
+}
+
+void ScriptArena::rewind(const Mark& m) {
+  if (m.chunk >= chunks.size()) return;
+  current = m.chunk;
+  chunks[current].used = m.used;
+}
+
+void ScriptArena::reset() {
+  // The first chunk stays so steady-state runs never touch the heap
+  for (size_t k = 1; k < chunks.size(); k++) free(chunks[k].data);
+  if (chunks.size() > 1) chunks.resize(1);
+  if (!chunks.empty()) chunks[0].used = 0;
+  current = 0;
+}
+
+size_t ScriptArena::inUse() const {
+  size_t total = 0;
+  for (size_t k = 0; k <= current && k < chunks.size(); k++) total += chunks[k].used;
+  return total;
+}
+
+size_t ScriptArena::capacity() const {
+  size_t total = 0;
+  for (const Chunk& c : chunks) total += c.size;
+  return total;
+}
+
+static uint8_t internalFragmentation(size_t& largest) {
+  size_t freeBytes = heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  largest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  return freeBytes ? 100 - (largest * 100) / freeBytes : 0;
+}
+
+void scriptArenaBeginRun() {
+  scriptArena.reset();
+  scriptArena.peak = 0;
+  runStats.fragBefore = internalFragmentation(runStats.largestBefore);
+}
+
+void scriptArenaEndRun() {
+  runStats.runs++;
+  runStats.lastPeak = scriptArena.peak;
+  scriptArena.reset();
+  runStats.fragAfter = internalFragmentation(runStats.largestAfter);
+}
+
+String getScriptArenaStatsJson() {
+  size_t largest = 0;
+  uint8_t fragNow = internalFragmentation(largest);
+  return "{\"runs\":" + String(runStats.runs) + ",\"lastPeak\":" + String(runStats.lastPeak) +
+         ",\"capacity\":" + String(scriptArena.capacity()) + ",\"chunks\":" + String(scriptArena.chunkCount()) +
+         ",\"fragBefore\":" + String(runStats.fragBefore) + ",\"fragAfter\":" + String(runStats.fragAfter) +
+         ",\"largestBefore\":" + String(runStats.largestBefore) + ",\"largestAfter\":" + String(runStats.largestAfter) +
+         ",\"fragNow\":" + String(fragNow) + ",\"largestNow\":" + String(largest) + "}";
+}
@@ -0,0 +1,113 @@
+#ifndef SCRIPT_ARENA_H
+#define SCRIPT_ARENA_H
+
+#include "GlobalState.h"
+
+// Read-only view into a NUL-separated CompiledScript line (or any buffer that
+// outlives it). Mirrors the String calls the executor uses, without copying.
+struct StrView {
+  const char* p = "";
+  size_t len = 0;
+
+  StrView() = default;
+  StrView(const char* s) : p(s), len(strlen(s)) {}
+  StrView(const char* s, size_t n) : p(s), len(n) {}
+
+  size_t length() const { return len; }
+  char operator[](size_t k) const { return p[k]; }
+  bool operator==(const char* s) const { return strlen(s) == len && memcmp(p, s, len) == 0; }
+  bool operator!=(const char* s) const { return !(*this == s); }
+  bool startsWith(const char* prefix) const {
+    size_t n = strlen(prefix);
+    return n <= len && memcmp(p, prefix, n) == 0;
+  }
+  bool endsWith(const char* suffix) const {
+    size_t n = strlen(suffix);
+    return n <= len && memcmp(p + len - n, suffix, n) == 0;
+  }
+  int indexOf(char c, size_t from = 0) const {
+    for (size_t k = from; k < len; k++) if (p[k] == c) return k;
+    return -1;
+  }
+  int indexOf(const char* needle, size_t from = 0) const {
+    size_t n = strlen(needle);
+    for (size_t k = from; k + n <= len; k++) if (memcmp(p + k, needle, n) == 0) return k;
+    return -1;
+  }
+  StrView substring(size_t from) const { return from >= len ? StrView(p + len, 0) : StrView(p + from, len - from); }
+  StrView substring(size_t from, size_t to) const {
+    if (to > len) to = len;
+    return from >= to ? StrView(p + to, 0) : StrView(p + from, to - from);
+  }
+  StrView trimmed() const {
+    size_t a = 0, b = len;
+    while (a < b && isspace((unsigned char)p[a])) a++;
+    while (b > a && isspace((unsigned char)p[b - 1])) b--;
+    return StrView(p + a, b - a);
+  }
+  long toInt() const {
+    StrView t = trimmed();
+    size_t k = 0;
+    bool neg = k < t.len && t.p[k] == '-';
+    if (neg || (k < t.len && t.p[k] == '+')) k++;
+    long v = 0;
+    for (; k < t.len && isdigit((unsigned char)t.p[k]); k++) v = v * 10 + (t.p[k] - '0');
+    return neg ? -v : v;
+  }
+  String toString() const {
+    String s;
+    s.concat(p, len);
+    return s;
+  }
+};
+
+// Bump allocator for interpreter temporaries. Chunks (PSRAM when present) are
+// kept across runs; reset() drops everything in one step when a script ends.
+// ArenaScope rewinds nested scratch use, so callers outside a run are safe too.
+class ScriptArena {
+ public:
+  struct Mark {
+    size_t chunk;
+    size_t used;
+  };
+
+  void* alloc(size_t bytes, size_t align = alignof(void*));
+  template <typename T>
+  T* allocArray(size_t n) { return (T*)alloc(n * sizeof(T), alignof(T)); }
+  Mark mark() const;
+  void rewind(const Mark& m);
+  void reset();
+
+  size_t inUse() const;
+  size_t capacity() const;
+  size_t chunkCount() const { return chunks.size(); }
+  size_t peak = 0;
+
+ private:
+  struct Chunk {
+    uint8_t* data;
+    size_t size;
+    size_t used;
+  };
+  std::vector<Chunk> chunks;
+  size_t current = 0;
+};
+
+class ArenaScope {
+ public:
+  explicit ArenaScope(ScriptArena& a) : arena(a), saved(a.mark()) {}
+  ~ArenaScope() { arena.rewind(saved); }
+
+ private:
+  ScriptArena& arena;
+  ScriptArena::Mark saved;
+};
+
+extern ScriptArena scriptArena;
+
+// Bracket one script execution: record heap fragmentation, then reset the arena
+void scriptArenaBeginRun();
+void scriptArenaEndRun();
+String getScriptArenaStatsJson();
+
+#endif // SCRIPT_ARENA_H
@@ -0,0 +1,144 @@
+#include "ScriptCache.h"
+#include "ScriptLibrary.h"
+#include <list>
+
+struct ScriptCacheEntry {
+  String path;
+  time_t mtime;
+  size_t fileSize;
+  unsigned long validatedAt;
+  CompiledScriptPtr script;
+};
+
+static std::list<ScriptCacheEntry> scriptCache;  // Front = most recently used
+static size_t scriptCacheBytes = 0;
+static unsigned long scriptCacheHits = 0;
+static unsigned long scriptCacheMisses = 0;
+
+String resolveScriptPath(String filename) {
+  if (filename.startsWith("/")) return filename;
+  return String(DIR_SCRIPTS) + "/" + filename;
+}
+
+static size_t entryBytes(const CompiledScriptPtr& script) {
+  return script->textSize + script->lineOffsets.size() * sizeof(uint32_t);
+}
+
+static void evictScriptCache() {
+  while (!scriptCache.empty() &&
+         (scriptCache.size() > SCRIPT_CACHE_MAX_ENTRIES || scriptCacheBytes > SCRIPT_CACHE_MAX_BYTES)) {
+    scriptCacheBytes -= entryBytes(scriptCache.back().script);
+    scriptCache.pop_back();
+  }
+}
+
+CompiledScriptPtr findCachedScript(String filename) {
+  if (!sdCardPresent) return nullptr;
+  String path = resolveScriptPath(filename);
+
+  for (auto it = scriptCache.begin(); it != scriptCache.end(); ++it) {
+    if (it->path != path) continue;
+
+    // Writes made through this device invalidate directly; the stat only catches
+    // edits made with the card in another machine. Packed scripts stat their library.
+    if (millis() - it->validatedAt >= SCRIPT_CACHE_REVALIDATE_MS) {
+      PackedScriptRef packed;
+      File f = SD.open(findPackedScript(path, packed) ? packed.container : path);
+      bool fresh = f && f.size() == it->fileSize && f.getLastWrite() == it->mtime;
+      if (f) f.close();
+      if (!fresh) {
+        scriptCacheBytes -= entryBytes(it->script);
+        scriptCache.erase(it);
+        break;
+      }
+      it->validatedAt = millis();
+    }
+
+    scriptCacheHits++;
+    scriptCache.splice(scriptCache.begin(), scriptCache, it);
+    return scriptCache.front().script;
+  }
+  return nullptr;
+}
+
+void addCachedScript(CompiledScriptPtr script) {
+  if (!script || !script->text || script->sourcePath.length() == 0) return;
+  invalidateScriptCache(script->sourcePath);
+  ScriptCacheEntry entry;
+  entry.path = script->sourcePath;
+  entry.mtime = script->sourceMtime;
+  entry.fileSize = script->sourceFileSize;
+  entry.validatedAt = millis();
+  entry.script = script;
+  scriptCacheBytes += entryBytes(script);
+  scriptCache.push_front(entry);
+  evictScriptCache();
+}
+
+CompiledScriptPtr getCachedScript(String filename) {
+  CompiledScriptPtr cached = findCachedScript(filename);
+  if (cached || !sdCardPresent) return cached;
+
+  scriptCacheMisses++;
+  String path = resolveScriptPath(filename);
+  time_t mtime;
+  size_t fileSize;
+  String content;
+  PackedScriptRef packed;
+  if (findPackedScript(path, packed)) {
+    if (!readPackedScript(packed, content)) return nullptr;
+    mtime = packed.containerMtime;
+    fileSize = packed.containerSize;
+  } else {
+    File f = SD.open(path);
+    if (!f || f.isDirectory()) {
+      if (f) f.close();
+      return nullptr;
+    }
+    mtime = f.getLastWrite();
+    fileSize = f.size();
+    content = f.readString();
+    f.close();
+  }
+
+  CompiledScriptPtr script = compileScript(content);
+  if (!script->text) return nullptr;
+  script->sourcePath = path;
+  script->sourceFileSize = fileSize;
+  script->sourceMtime = mtime;
+
+  addCachedScript(script);
+  return script;
+}
+
+// Returns false when the script is missing or empty
+bool runCachedScript(String filename) {
+  CompiledScriptPtr script = getCachedScript(filename);
+  if (!script || script->lineCount() == 0) return false;
+  executeCompiledScript(script);
+  return true;
+}
+
+void invalidateScriptCache(String filename) {
+  String path = resolveScriptPath(filename);
+  for (auto it = scriptCache.begin(); it != scriptCache.end(); ++it) {
+    if (it->path == path) {
+      scriptCacheBytes -= entryBytes(it->script);
+      scriptCache.erase(it);
+      return;
+    }
+  }
+}
+
+void clearScriptCache() {
+  scriptCache.clear();
+  scriptCacheBytes = 0;
+}
+
+String getScriptCacheStatsJson() {
+  unsigned long lookups = scriptCacheHits + scriptCacheMisses;
+  int hitRate = lookups > 0 ? (int)((scriptCacheHits * 100) / lookups) : 0;
+  return "{\"entries\":" + String(scriptCache.size()) + ",\"bytes\":" + String(scriptCacheBytes) +
+         ",\"hits\":" + String(scriptCacheHits) + ",\"misses\":" + String(scriptCacheMisses) +
+         ",\"hitRate\":" + String(hitRate) + "}";
+}
@@ -0,0 +1,20 @@
+#ifndef SCRIPT_CACHE_H
+#define SCRIPT_CACHE_H
+
+#include "GlobalState.h"
+#include "DuckyInterpreter.h"
+
+// LRU cache of compiled scripts keyed by path, size and mtime. Names without a
+// leading '/' resolve under DIR_SCRIPTS, same as loadScript().
+CompiledScriptPtr getCachedScript(String filename);
+// Hit-only lookup (no SD read on a miss) and insertion of a script compiled
+// elsewhere, e.g. by the rower prefetch task. Loop task only: the cache is not locked.
+CompiledScriptPtr findCachedScript(String filename);
+void addCachedScript(CompiledScriptPtr script);
+String resolveScriptPath(String filename);
+bool runCachedScript(String filename);
+void invalidateScriptCache(String filename);
+void clearScriptCache();
+String getScriptCacheStatsJson();
+
+#endif // SCRIPT_CACHE_H
@@ -0,0 +1,302 @@
+#include "ScriptCheckpoint.h"
+#include <esp_heap_caps.h>
+
+#define CHECKPOINT_MAGIC 0x50434B44UL  // "DKCP"
+#define CHECKPOINT_VERSION 4  // v2: typed variables, v3: WHILE frames, v4: call frames with locals
+
+struct CheckpointHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t headerSize;
+  uint32_t scriptHash;
+  uint32_t sourceBytes;
+  uint32_t textSize;
+  uint32_t lineCount;
+  uint32_t functionCount;
+  int32_t pc;
+  int32_t skipDepth;
+  uint8_t skipActive;
+  uint8_t reserved[3];
+  uint32_t loopDepth;
+  uint32_t callDepth;
+  uint32_t ifDepth;
+  uint32_t variableCount;
+  int32_t defaultDelay;
+  uint32_t bodyBytes;
+  uint32_t bodyChecksum;  // FNV-1a over everything after the header
+};
+
+// ============================================================
+// Streaming writer/reader with a running checksum
+// ============================================================
+class CheckpointWriter {
+ public:
+  explicit CheckpointWriter(File& f) : file(f) {}
+  void put(const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t k = 0; k < len; k++) checksum = (checksum ^ p[k]) * 16777619UL;
+    if (file.write(p, len) != len) failed = true;
+    bytes += len;
+  }
+  void putU32(uint32_t v) { put(&v, sizeof(v)); }
+  void putI32(int32_t v) { put(&v, sizeof(v)); }
+  void putString(const String& s) {
+    putU32(s.length());
+    put(s.c_str(), s.length());
+  }
+  void putValue(const ScriptValue& v) {
+    uint8_t type = v.type;
+    put(&type, 1);
+    if (v.type == VALUE_STRING) putString(v.s);
+    else if (v.type == VALUE_DOUBLE) put(&v.d, sizeof(v.d));
+    else put(&v.i, sizeof(v.i));
+  }
+
+  File& file;
+  uint32_t checksum = 2166136261UL;
+  uint32_t bytes = 0;
+  bool failed = false;
+};
+
+class CheckpointReader {
+ public:
+  explicit CheckpointReader(File& f) : file(f) {}
+  bool get(void* data, size_t len) {
+    if (failed || file.read((uint8_t*)data, len) != (int)len) {
+      failed = true;
+      return false;
+    }
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t k = 0; k < len; k++) checksum = (checksum ^ p[k]) * 16777619UL;
+    return true;
+  }
+  uint32_t getU32() { uint32_t v = 0; get(&v, sizeof(v)); return v; }
+  int32_t getI32() { int32_t v = 0; get(&v, sizeof(v)); return v; }
+  String getString() {
+    uint32_t len = getU32();
+    if (failed || len > (uint32_t)file.available()) {
+      failed = true;
+      return "";
+    }
+    String s;
+    s.reserve(len);
+    char buf[64];
+    while (len > 0) {
+      size_t n = min((uint32_t)sizeof(buf), len);
+      if (!get(buf, n)) return "";
+      s.concat(buf, n);
+      len -= n;
+    }
+    return s;
+  }
+  ScriptValue getValue() {
+    uint8_t type = VALUE_STRING;
+    get(&type, 1);
+    if (type == VALUE_STRING) return ScriptValue(getString());
+    ScriptValue v;
+    v.type = (ScriptValueType)type;
+    if (type == VALUE_DOUBLE) get(&v.d, sizeof(v.d));
+    else if (type == VALUE_INT || type == VALUE_BOOL) get(&v.i, sizeof(v.i));
+    else failed = true;
+    return v;
+  }
+
+  File& file;
+  uint32_t checksum = 2166136261UL;
+  bool failed = false;
+};
+
+// ============================================================
+// Save
+// ============================================================
+bool saveScriptCheckpoint(const CompiledScript& script, const ExecState& state) {
+  if (!sdCardPresent) return false;
+  File f = SD.open(FILE_CHECKPOINT, FILE_WRITE);
+  if (!f) return false;
+
+  CheckpointHeader header = {};
+  header.magic = CHECKPOINT_MAGIC;
+  header.version = CHECKPOINT_VERSION;
+  header.headerSize = sizeof(CheckpointHeader);
+  header.scriptHash = script.hash;
+  header.sourceBytes = script.sourceBytes;
+  header.textSize = script.textSize;
+  header.lineCount = script.lineCount();
+  header.functionCount = script.functionTable.size();
+  header.pc = state.pc;
+  header.skipDepth = state.skipDepth;
+  header.skipActive = state.skipActive ? 1 : 0;
+  header.loopDepth = state.loopStack.size();
+  header.callDepth = state.callStack.size();
+  header.ifDepth = state.ifHandledStack.size();
+  header.variableCount = variables.size();
+  header.defaultDelay = defaultDelay;
+
+  // Header goes first as a placeholder and is rewritten once the body checksum is known
+  f.write((const uint8_t*)&header, sizeof(header));
+
+  CheckpointWriter w(f);
+  w.put(script.text, script.textSize);
+  w.put(script.lineOffsets.data(), script.lineOffsets.size() * sizeof(uint32_t));
+  for (auto const& [name, line] : script.functionTable) {
+    w.putString(name);
+    w.putI32(line);
+  }
+  for (const LoopState& loop : state.loopStack) {
+    w.putI32(loop.startLine);
+    w.putI32(loop.currentIteration);
+    w.putI32(loop.totalIterations);
+    w.putI32(loop.step);
+    w.putString(loop.varName);
+    uint8_t isWhile = loop.isWhile ? 1 : 0;
+    w.put(&isWhile, 1);
+    w.putU32(loop.isWhile ? millis() - loop.startedMs : 0);  // Elapsed, so TIMEOUT spans the reboot
+  }
+  for (const CallFrame& frame : state.callStack) {
+    w.putI32(frame.returnLine);
+    w.putI32(frame.functionLine);
+    w.putI32(frame.loopDepth);
+    w.putI32(frame.ifDepth);
+    w.putString(frame.resultVar);
+    w.putU32(frame.locals.size());
+    for (const ScriptValue& local : frame.locals) w.putValue(local);
+  }
+  for (bool handled : state.ifHandledStack) {
+    uint8_t b = handled ? 1 : 0;
+    w.put(&b, 1);
+  }
+  for (auto const& [name, value] : variables) {
+    w.putString(name);
+    w.putValue(value);
+  }
+
+  header.bodyBytes = w.bytes;
+  header.bodyChecksum = w.checksum;
+  bool ok = !w.failed && f.seek(0) && f.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+  f.close();
+  if (!ok) SD.remove(FILE_CHECKPOINT);
+  return ok;
+}
+
+bool hasScriptCheckpoint() {
+  return sdCardPresent && SD.exists(FILE_CHECKPOINT);
+}
+
+// ============================================================
+// Load + resume
+// ============================================================
+static bool loadScriptCheckpoint(CompiledScriptPtr& script, ExecState& state, int& savedDelay,
+                                 std::map<String, ScriptValue>& savedVariables) {
+  File f = SD.open(FILE_CHECKPOINT, FILE_READ);
+  if (!f) return false;
+
+  CheckpointHeader header;
+  if (f.read((uint8_t*)&header, sizeof(header)) != sizeof(header) || header.magic != CHECKPOINT_MAGIC ||
+      header.version != CHECKPOINT_VERSION || header.headerSize != sizeof(header) ||
+      header.bodyBytes != f.size() - sizeof(header) || header.pc < 0 || (uint32_t)header.pc >= header.lineCount) {
+    f.close();
+    return false;
+  }
+
+  script = std::make_shared<CompiledScript>();
+  script->hash = header.scriptHash;
+  script->sourceBytes = header.sourceBytes;
+  script->textSize = header.textSize;
+  script->text = (char*)heap_caps_malloc(header.textSize + 1, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!script->text) script->text = (char*)malloc(header.textSize + 1);
+  if (!script->text) {
+    f.close();
+    return false;
+  }
+
+  CheckpointReader r(f);
+  r.get(script->text, header.textSize);
+  script->text[header.textSize] = '\0';
+  script->lineOffsets.resize(header.lineCount);
+  r.get(script->lineOffsets.data(), header.lineCount * sizeof(uint32_t));
+  for (uint32_t k = 0; k < header.functionCount && !r.failed; k++) {
+    String name = r.getString();
+    script->functionTable[name] = r.getI32();
+  }
+
+  state.pc = header.pc;
+  state.skipDepth = header.skipDepth;
+  state.skipActive = header.skipActive != 0;
+  for (uint32_t k = 0; k < header.loopDepth && !r.failed; k++) {
+    LoopState loop;
+    loop.startLine = r.getI32();
+    loop.currentIteration = r.getI32();
+    loop.totalIterations = r.getI32();
+    loop.step = r.getI32();
+    loop.varName = r.getString();
+    uint8_t isWhile = 0;
+    r.get(&isWhile, 1);
+    loop.isWhile = isWhile != 0;
+    loop.startedMs = millis() - r.getU32();
+    state.loopStack.push_back(loop);
+  }
+  for (uint32_t k = 0; k < header.callDepth && !r.failed; k++) {
+    CallFrame frame;
+    frame.returnLine = r.getI32();
+    frame.functionLine = r.getI32();
+    frame.loopDepth = r.getI32();
+    frame.ifDepth = r.getI32();
+    frame.resultVar = r.getString();
+    uint32_t localCount = r.getU32();
+    for (uint32_t l = 0; l < localCount && !r.failed; l++) frame.locals.push_back(r.getValue());
+    state.callStack.push_back(std::move(frame));
+  }
+  // A loop's call depth is the number of frames entered before it was pushed
+  for (size_t k = 0; k < state.loopStack.size(); k++) {
+    int depth = 0;
+    for (const CallFrame& frame : state.callStack) if (frame.loopDepth <= (int)k) depth++;
+    state.loopStack[k].callDepth = depth;
+  }
+  for (uint32_t k = 0; k < header.ifDepth && !r.failed; k++) {
+    uint8_t b = 0;
+    r.get(&b, 1);
+    state.ifHandledStack.push_back(b != 0);
+  }
+  for (uint32_t k = 0; k < header.variableCount && !r.failed; k++) {
+    String name = r.getString();
+    savedVariables[name] = r.getValue();
+  }
+  savedDelay = header.defaultDelay;
+  f.close();
+
+  if (r.failed || r.checksum != header.bodyChecksum) return false;
+  for (uint32_t offset : script->lineOffsets) {
+    if (offset >= header.textSize) return false;
+  }
+  linkCompiledScript(*script);
+  for (const CallFrame& frame : state.callStack) {
+    auto fnIt = script->functions.find(frame.functionLine);
+    if (fnIt == script->functions.end() || fnIt->second.slotNames.size() != frame.locals.size()) return false;
+  }
+  return true;
+}
+
+// Consumes the checkpoint (deleted before running so a crash cannot loop) and
+// continues the script at the saved line.
+bool resumeScriptCheckpoint() {
+  if (!hasScriptCheckpoint()) return false;
+
+  CompiledScriptPtr script;
+  ExecState state;
+  int savedDelay = 0;
+  std::map<String, ScriptValue> savedVariables;
+  bool ok = loadScriptCheckpoint(script, state, savedDelay, savedVariables);
+  SD.remove(FILE_CHECKPOINT);
+  if (!ok) {
+    Serial.println("[Resume] Checkpoint invalid or corrupt - discarded");
+    lastError = "Resume checkpoint corrupt";
+    errorCount++;
+    return false;
+  }
+
+  for (auto const& [name, value] : savedVariables) variables[name] = value;
+  defaultDelay = savedDelay;
+  Serial.println("[Resume] Continuing script at line " + String(state.pc + 1));
+  executeCompiledScript(script, &state);
+  return true;
+}
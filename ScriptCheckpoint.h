@@ -0,0 +1,14 @@
+#ifndef SCRIPT_CHECKPOINT_H
+#define SCRIPT_CHECKPOINT_H
+
+#include "GlobalState.h"
+#include "DuckyInterpreter.h"
+
+// Binary snapshot of a running script (compiled text, line table, function table,
+// interpreter stacks, variables) so a USB identity reboot resumes mid-script
+// without re-parsing. One checkpoint at a time, consumed on load.
+bool saveScriptCheckpoint(const CompiledScript& script, const ExecState& state);
+bool hasScriptCheckpoint();
+bool resumeScriptCheckpoint();
+
+#endif // SCRIPT_CHECKPOINT_H
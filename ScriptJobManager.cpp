@@ -0,0 +1,244 @@
+#include "ScriptJobManager.h"
+#include "DuckyInterpreter.h"
+#include "ScriptCache.h"
+#include "ScriptCheckpoint.h"
+#include "ExecutionCursor.h"
+#include "LogManager.h"
+#include "RowerPipeline.h"
+#include <algorithm>
+
+struct ScriptJob {
+  int id;
+  String origin;    // web, boot, reboot, resume, rower, automation, payload, test
+  String label;
+  String source;    // Inline script text, or empty when filename is set
+  String filename;  // Resolved through the compiled script cache
+  CompiledScriptPtr compiled;  // Already compiled (rower prefetch); wins over source/filename
+  bool resume;      // Continue from a saved checkpoint or execution cursor instead
+  int priority;
+  String state;     // queued, running, done, failed, cancelled
+  unsigned long queuedAt;
+  unsigned long startedAt;
+  unsigned long finishedAt;
+};
+
+// Queued jobs appear in run order; finished ones are kept for latency reporting
+static std::vector<ScriptJob*> scriptJobs;
+static int nextScriptJobId = 1;
+
+static bool isFinished(const ScriptJob* job) {
+  return job->state == "done" || job->state == "failed" || job->state == "cancelled";
+}
+
+static ScriptJob* findScriptJob(int id) {
+  for (ScriptJob* job : scriptJobs) {
+    if (job->id == id) return job;
+  }
+  return nullptr;
+}
+
+static size_t queuedScriptJobCount() {
+  size_t count = 0;
+  for (ScriptJob* job : scriptJobs) {
+    if (job->state == "queued") count++;
+  }
+  return count;
+}
+
+// Drops the oldest finished jobs once the table is full
+static void pruneScriptJobs() {
+  for (auto it = scriptJobs.begin(); it != scriptJobs.end() && scriptJobs.size() >= MAX_SCRIPT_JOBS; ) {
+    if (isFinished(*it)) {
+      delete *it;
+      it = scriptJobs.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+static int addScriptJob(ScriptJob* job) {
+  pruneScriptJobs();
+  if (queuedScriptJobCount() >= MAX_SCRIPT_QUEUE || scriptJobs.size() >= MAX_SCRIPT_JOBS) {
+    Serial.println("[Script] Queue full, rejecting " + job->origin + " job: " + job->label);
+    delete job;
+    return -1;
+  }
+  job->id = nextScriptJobId++;
+  job->state = "queued";
+  job->queuedAt = millis();
+  job->startedAt = 0;
+  job->finishedAt = 0;
+
+  // Behind every queued job of the same or higher priority
+  auto pos = scriptJobs.end();
+  for (auto it = scriptJobs.begin(); it != scriptJobs.end(); ++it) {
+    if ((*it)->state == "queued" && (*it)->priority < job->priority) {
+      pos = it;
+      break;
+    }
+  }
+  scriptJobs.insert(pos, job);
+  logDebug("Script job #" + String(job->id) + " queued (" + job->origin + "): " + job->label);
+  return job->id;
+}
+
+int queueScriptJob(String origin, String label, String source, int priority) {
+  ScriptJob* job = new ScriptJob();
+  job->origin = origin;
+  job->label = label;
+  job->source = source;
+  job->priority = priority;
+  return addScriptJob(job);
+}
+
+int queueScriptFileJob(String origin, String filename, int priority) {
+  ScriptJob* job = new ScriptJob();
+  job->origin = origin;
+  job->label = filename;
+  job->filename = filename;
+  job->priority = priority;
+  return addScriptJob(job);
+}
+
+int queueCompiledScriptJob(String origin, String label, CompiledScriptPtr script, int priority) {
+  ScriptJob* job = new ScriptJob();
+  job->origin = origin;
+  job->label = label;
+  job->compiled = script;
+  job->priority = priority;
+  return addScriptJob(job);
+}
+
+int queueResumeJob(String kind) {
+  ScriptJob* job = new ScriptJob();
+  job->origin = "resume";
+  job->label = kind;
+  job->resume = true;
+  job->priority = SCRIPT_PRIORITY_HIGH;
+  return addScriptJob(job);
+}
+
+// Queued jobs only: a script holds the loop task, web server included, until it
+// ends, so no request ever sees its job running
+bool cancelScriptJob(int id) {
+  ScriptJob* job = findScriptJob(id);
+  if (!job || job->state != "queued") return false;
+  job->state = "cancelled";
+  job->source = "";
+  job->compiled.reset();
+  job->finishedAt = millis();
+  return true;
+}
+
+// position counts queued jobs only; 0 runs next. A job stays inside its own
+// priority band: behind higher-priority jobs, ahead of lower-priority ones.
+bool moveScriptJob(int id, int position) {
+  ScriptJob* job = findScriptJob(id);
+  if (!job || job->state != "queued") return false;
+  scriptJobs.erase(std::find(scriptJobs.begin(), scriptJobs.end(), job));
+
+  int bandStart = 0;
+  int bandEnd = 0;
+  for (ScriptJob* other : scriptJobs) {
+    if (other->state != "queued") continue;
+    if (other->priority > job->priority) bandStart++;
+    if (other->priority >= job->priority) bandEnd++;
+  }
+  position = constrain(position, bandStart, bandEnd);
+
+  auto pos = scriptJobs.end();
+  int seen = 0;
+  for (auto it = scriptJobs.begin(); it != scriptJobs.end(); ++it) {
+    if ((*it)->state != "queued") continue;
+    if (seen++ == position) {
+      pos = it;
+      break;
+    }
+  }
+  scriptJobs.insert(pos, job);
+  return true;
+}
+
+String getScriptJobState(int id) {
+  ScriptJob* job = findScriptJob(id);
+  return job ? job->state : String();
+}
+
+bool scriptJobActive(String origin) {
+  for (ScriptJob* job : scriptJobs) {
+    if (job->origin == origin && (job->state == "queued" || job->state == "running")) return true;
+  }
+  return false;
+}
+
+bool getScriptJobTimes(int id, unsigned long& startedAt, unsigned long& finishedAt) {
+  ScriptJob* job = findScriptJob(id);
+  if (!job) return false;
+  startedAt = job->startedAt;
+  finishedAt = job->finishedAt;
+  return true;
+}
+
+static ScriptJob* nextQueuedScriptJob() {
+  for (ScriptJob* job : scriptJobs) {
+    if (job->state == "queued") return job;
+  }
+  return nullptr;
+}
+
+static void runScriptJob(ScriptJob* job) {
+  job->state = "running";
+  job->startedAt = millis();
+
+  bool ok;
+  if (job->resume) {
+    ok = (job->label == "cursor") ? resumeExecutionCursor() : resumeScriptCheckpoint();
+  } else if (job->compiled) {
+    ok = job->compiled->lineCount() > 0;
+    if (ok) executeCompiledScript(job->compiled);
+    job->compiled.reset();
+  } else if (job->filename.length() > 0) {
+    ok = runCachedScript(job->filename);
+  } else {
+    CompiledScriptPtr compiled = compileScript(job->source);
+    job->source = "";
+    ok = compiled->lineCount() > 0;
+    if (ok) executeCompiledScript(compiled);
+  }
+
+  job->finishedAt = millis();
+  job->state = ok ? "done" : "failed";
+  Serial.println("[Script] Job #" + String(job->id) + " " + job->state + " (" + job->origin + ": " + job->label +
+                 ") wait " + String(job->startedAt - job->queuedAt) + "ms, run " +
+                 String(job->finishedAt - job->startedAt) + "ms");
+}
+
+// Called from loop(). Queued jobs run back to back in this call; the web server is
+// serviced between jobs so cancel/reorder requests still land. The rower queues its
+// next (prefetched) hop here too, so it starts without waiting for another loop().
+void processScriptJobs() {
+  ScriptJob* job;
+  while (!scriptRunning && (job = nextQueuedScriptJob()) != nullptr) {
+    runScriptJob(job);
+    processRower();
+    server.handleClient();
+  }
+}
+
+String getScriptJobsJson() {
+  String json = "[";
+  unsigned long now = millis();
+  for (size_t i = 0; i < scriptJobs.size(); i++) {
+    ScriptJob* job = scriptJobs[i];
+    if (i > 0) json += ",";
+    unsigned long waitMs = (job->startedAt ? job->startedAt : (job->finishedAt ? job->finishedAt : now)) - job->queuedAt;
+    unsigned long runMs = job->startedAt ? (job->finishedAt ? job->finishedAt : now) - job->startedAt : 0;
+    json += "{\"id\":" + String(job->id) + ",\"origin\":\"" + job->origin + "\",\"label\":\"" + job->label +
+            "\",\"priority\":" + String(job->priority) + ",\"state\":\"" + job->state +
+            "\",\"waitMs\":" + String(waitMs) + ",\"runMs\":" + String(runMs) +
+            ",\"latencyMs\":" + String(job->finishedAt ? job->finishedAt - job->queuedAt : 0) + "}";
+  }
+  json += "]";
+  return json;
+}
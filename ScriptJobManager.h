@@ -0,0 +1,25 @@
+#ifndef SCRIPT_JOB_MANAGER_H
+#define SCRIPT_JOB_MANAGER_H
+
+#include "GlobalState.h"
+#include "DuckyInterpreter.h"
+
+#define SCRIPT_PRIORITY_LOW 0
+#define SCRIPT_PRIORITY_NORMAL 1
+#define SCRIPT_PRIORITY_HIGH 2
+
+// Bounded priority queue of script runs. Jobs run on the loop task one after
+// another; higher priority first, FIFO within a priority, unless reordered.
+int queueScriptJob(String origin, String label, String source, int priority);
+int queueScriptFileJob(String origin, String filename, int priority);
+int queueCompiledScriptJob(String origin, String label, CompiledScriptPtr script, int priority);
+int queueResumeJob(String kind);  // "checkpoint" (USB identity reboot) or "cursor" (RESUME)
+bool cancelScriptJob(int id);  // Queued jobs only
+bool moveScriptJob(int id, int position);  // Clamped to the job's priority band
+String getScriptJobState(int id);  // Empty if unknown
+bool scriptJobActive(String origin);
+bool getScriptJobTimes(int id, unsigned long& startedAt, unsigned long& finishedAt);
+void processScriptJobs();
+String getScriptJobsJson();
+
+#endif // SCRIPT_JOB_MANAGER_H
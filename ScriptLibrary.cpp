@@ -0,0 +1,370 @@
+#include "ScriptLibrary.h"
+#include "FSManager.h"
+#include "ScriptCache.h"
+#include <esp_heap_caps.h>
+#include <algorithm>
+#include <atomic>
+
+#define LIBRARY_MAGIC 0x4B50444CUL  // "LDPK"
+#define LIBRARY_VERSION 1
+
+// Layout: header, entryCount index records (u8 nameLen, name, u32 offset,
+// u32 length, u32 hash), then the script bodies. Offsets are file positions.
+struct LibraryHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t headerSize;
+  uint32_t entryCount;
+  uint32_t indexBytes;
+  uint32_t dataOffset;
+  uint32_t dataBytes;
+};
+
+struct ScriptLibrary {
+  String path;
+  size_t fileSize;
+  time_t mtime;
+  uint32_t dataOffset;
+  uint32_t dataBytes;
+  uint8_t* memory;  // Whole data region in PSRAM, or null
+};
+
+struct PackedEntry {
+  uint16_t library;
+  uint32_t offset;
+  uint32_t length;
+  uint32_t hash;
+};
+
+static std::vector<ScriptLibrary> libraries;
+static std::map<String, PackedEntry> packedIndex;
+static unsigned long memoryReads = 0;
+// Card reads also come from the rower prefetch task on core 0
+static std::atomic<uint32_t> cardReads{0};
+static std::atomic<uint32_t> hashFailures{0};
+
+static uint32_t fnv1a(const uint8_t* data, size_t len, uint32_t hash = 2166136261UL) {
+  for (size_t k = 0; k < len; k++) hash = (hash ^ data[k]) * 16777619UL;
+  return hash;
+}
+
+void clearScriptLibraries() {
+  for (ScriptLibrary& lib : libraries) {
+    if (lib.memory) heap_caps_free(lib.memory);
+  }
+  libraries.clear();
+  packedIndex.clear();
+}
+
+// Reads and bounds-checks the header, then the whole index in one read. The index
+// size comes from the card, so it must fit between the header and the data.
+static bool readLibraryIndex(File& f, const String& path, LibraryHeader& header, std::vector<uint8_t>& index) {
+  if (f.read((uint8_t*)&header, sizeof(header)) != sizeof(header) || header.magic != LIBRARY_MAGIC ||
+      header.version != LIBRARY_VERSION || header.headerSize < sizeof(header) ||
+      (uint64_t)header.headerSize + header.indexBytes > header.dataOffset || header.dataOffset > f.size() ||
+      (uint64_t)header.dataOffset + header.dataBytes > f.size() || !f.seek(header.headerSize)) {
+    Serial.println("[FS] Not a script library: " + path);
+    return false;
+  }
+  index.resize(header.indexBytes);
+  if (f.read(index.data(), index.size()) != (int)index.size()) {
+    Serial.println("[FS] Truncated script library index: " + path);
+    return false;
+  }
+  return true;
+}
+
+// Walks the index records; stops at the first one that runs past the index
+template <typename Visit>
+static void forEachLibraryEntry(const LibraryHeader& header, const std::vector<uint8_t>& index, Visit visit) {
+  size_t pos = 0;
+  for (uint32_t k = 0; k < header.entryCount && pos < index.size(); k++) {
+    uint8_t nameLen = index[pos++];
+    if (pos + nameLen + 12 > index.size()) break;
+    String name;
+    name.concat((const char*)&index[pos], nameLen);
+    pos += nameLen;
+
+    PackedEntry entry;
+    memcpy(&entry.offset, &index[pos], 4);
+    memcpy(&entry.length, &index[pos + 4], 4);
+    memcpy(&entry.hash, &index[pos + 8], 4);
+    pos += 12;
+
+    if (entry.offset < header.dataOffset || (uint64_t)entry.offset + entry.length > (uint64_t)header.dataOffset + header.dataBytes) continue;
+    visit(name, entry);
+  }
+}
+
+bool indexScriptLibrary(String path, std::vector<String>& names) {
+  File f = SD.open(path);
+  if (!f) return false;
+
+  LibraryHeader header;
+  std::vector<uint8_t> index;
+  if (!readLibraryIndex(f, path, header, index)) {
+    f.close();
+    return false;
+  }
+
+  ScriptLibrary lib = {path, f.size(), f.getLastWrite(), header.dataOffset, header.dataBytes, nullptr};
+  uint16_t libraryIdx = libraries.size();
+  uint32_t added = 0;
+  forEachLibraryEntry(header, index, [&](const String& name, PackedEntry entry) {
+    // A loose file or an earlier library of the same name wins
+    if (std::find(names.begin(), names.end(), name) != names.end()) return;
+    entry.library = libraryIdx;
+    packedIndex[name] = entry;
+    names.push_back(name);
+    added++;
+  });
+
+  if (header.dataBytes > 0 && header.dataBytes <= SCRIPT_LIBRARY_PSRAM_MAX_BYTES) {
+    lib.memory = (uint8_t*)heap_caps_malloc(header.dataBytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (lib.memory && (!f.seek(header.dataOffset) || f.read(lib.memory, header.dataBytes) != (int)header.dataBytes)) {
+      heap_caps_free(lib.memory);
+      lib.memory = nullptr;
+    }
+  }
+  f.close();
+
+  libraries.push_back(lib);
+  Serial.println("[FS] Script library " + path + ": " + String(added) + " scripts" + (lib.memory ? " (PSRAM)" : ""));
+  return true;
+}
+
+bool findPackedScript(String filename, PackedScriptRef& ref) {
+  String prefix = String(DIR_SCRIPTS) + "/";
+  if (filename.startsWith(prefix)) {
+    filename = filename.substring(prefix.length());
+  } else if (filename.startsWith("/")) {
+    return false;
+  }
+
+  ensureAvailableScripts();
+  auto it = packedIndex.find(filename);
+  if (it == packedIndex.end()) return false;
+
+  const ScriptLibrary& lib = libraries[it->second.library];
+  ref.container = lib.path;
+  ref.offset = it->second.offset;
+  ref.length = it->second.length;
+  ref.hash = it->second.hash;
+  ref.containerSize = lib.fileSize;
+  ref.containerMtime = lib.mtime;
+  return true;
+}
+
+bool readPackedScript(const PackedScriptRef& ref, String& content, bool useMemory) {
+  content = "";
+  if (!content.reserve(ref.length)) return false;
+
+  const uint8_t* memory = nullptr;
+  if (useMemory) {
+    for (const ScriptLibrary& lib : libraries) {
+      if (lib.memory && lib.path == ref.container && lib.mtime == ref.containerMtime) {
+        memory = lib.memory + (ref.offset - lib.dataOffset);
+        break;
+      }
+    }
+  }
+
+  uint32_t hash;
+  if (memory) {
+    content.concat((const char*)memory, ref.length);
+    hash = fnv1a(memory, ref.length);
+    memoryReads++;
+  } else {
+    File f = SD.open(ref.container);
+    if (!f || !f.seek(ref.offset)) {
+      if (f) f.close();
+      return false;
+    }
+    uint8_t buf[512];
+    uint32_t left = ref.length;
+    hash = 2166136261UL;
+    while (left > 0) {
+      size_t n = min((uint32_t)sizeof(buf), left);
+      if (f.read(buf, n) != (int)n) {
+        f.close();
+        content = "";
+        return false;
+      }
+      content.concat((const char*)buf, n);
+      hash = fnv1a(buf, n, hash);
+      left -= n;
+    }
+    f.close();
+    cardReads++;
+  }
+
+  if (hash != ref.hash) {
+    hashFailures++;
+    content = "";
+    return false;
+  }
+  return true;
+}
+
+bool packScriptLibrary(String name, bool removeLoose, String& message) {
+  if (!sdCardPresent) {
+    message = "SD card not present";
+    return false;
+  }
+  if (name.length() == 0 || name.indexOf('/') >= 0 || name.startsWith(".")) {
+    message = "Invalid library name";
+    return false;
+  }
+
+  // Loose files first, then whatever the library being replaced holds that no loose
+  // file overrides, so repacking under the same name never drops scripts
+  std::vector<String> files;
+  std::vector<uint32_t> sizes;
+  std::vector<uint32_t> sourceOffsets;  // Position in the existing library, 0 for loose files
+  std::vector<uint32_t> sourceHashes;
+  File root = SD.open(DIR_SCRIPTS);
+  if (!root) {
+    message = "Failed to open scripts directory";
+    return false;
+  }
+  for (File file = root.openNextFile(); file; file = root.openNextFile()) {
+    String fileName = file.name();
+    if (!file.isDirectory() && fileName.endsWith(".txt") && fileName.length() <= 255) {
+      files.push_back(fileName);
+      sizes.push_back(file.size());
+      sourceOffsets.push_back(0);
+      sourceHashes.push_back(0);
+    }
+    file.close();
+  }
+  root.close();
+  if (files.empty()) {
+    message = "No loose scripts to pack";
+    return false;
+  }
+  const size_t looseCount = files.size();
+
+  String path = String(DIR_SCRIPTS) + "/" + name + SCRIPT_LIBRARY_SUFFIX;
+  if (SD.exists(path)) {
+    File existing = SD.open(path);
+    LibraryHeader oldHeader;
+    std::vector<uint8_t> oldIndex;
+    bool readable = existing && readLibraryIndex(existing, path, oldHeader, oldIndex);
+    if (existing) existing.close();
+    if (!readable) {
+      message = "Refusing to replace unreadable library " + path;
+      return false;
+    }
+    forEachLibraryEntry(oldHeader, oldIndex, [&](const String& entryName, const PackedEntry& entry) {
+      if (std::find(files.begin(), files.end(), entryName) != files.end()) return;
+      files.push_back(entryName);
+      sizes.push_back(entry.length);
+      sourceOffsets.push_back(entry.offset);
+      sourceHashes.push_back(entry.hash);
+    });
+  }
+
+  LibraryHeader header = {LIBRARY_MAGIC, LIBRARY_VERSION, sizeof(LibraryHeader), (uint32_t)files.size(), 0, 0, 0};
+  for (size_t k = 0; k < files.size(); k++) {
+    header.indexBytes += 1 + files[k].length() + 12;
+    header.dataBytes += sizes[k];
+  }
+  header.dataOffset = header.headerSize + header.indexBytes;
+
+  // Index records are written with zero hashes first and patched once the bodies are copied
+  std::vector<uint32_t> hashes(files.size(), 0);
+  auto writeIndex = [&](File& out) {
+    uint32_t offset = header.dataOffset;
+    for (size_t k = 0; k < files.size(); k++) {
+      uint8_t nameLen = files[k].length();
+      out.write(&nameLen, 1);
+      out.write((const uint8_t*)files[k].c_str(), nameLen);
+      out.write((const uint8_t*)&offset, 4);
+      out.write((const uint8_t*)&sizes[k], 4);
+      out.write((const uint8_t*)&hashes[k], 4);
+      offset += sizes[k];
+    }
+  };
+
+  String tempPath = path + STAGE_FILE_SUFFIX;
+  if (SD.exists(tempPath)) SD.remove(tempPath);
+  File out = SD.open(tempPath, FILE_WRITE);
+  if (!out) {
+    message = "Failed to create " + tempPath;
+    return false;
+  }
+  out.write((const uint8_t*)&header, sizeof(header));
+  writeIndex(out);
+
+  bool ok = true;
+  std::vector<uint8_t> buffer(4096);
+  for (size_t k = 0; k < files.size() && ok; k++) {
+    bool kept = k >= looseCount;
+    File in = SD.open(kept ? path : String(DIR_SCRIPTS) + "/" + files[k]);
+    if (in && kept && !in.seek(sourceOffsets[k])) {
+      in.close();
+      in = File();
+    }
+    uint32_t left = sizes[k];
+    uint32_t hash = 2166136261UL;
+    while (in && left > 0) {
+      size_t n = min((uint32_t)buffer.size(), left);
+      if (in.read(buffer.data(), n) != (int)n || out.write(buffer.data(), n) != n) break;
+      hash = fnv1a(buffer.data(), n, hash);
+      left -= n;
+    }
+    if (in) in.close();
+    hashes[k] = hash;
+    if (left > 0) {
+      ok = false;
+      message = "Failed to copy " + files[k];
+    } else if (kept && hash != sourceHashes[k]) {
+      ok = false;
+      message = "Existing library entry " + files[k] + " is corrupt";
+    }
+  }
+  if (ok && out.seek(header.headerSize)) {
+    writeIndex(out);
+  } else if (ok) {
+    ok = false;
+    message = "Failed to write library index";
+  }
+  out.close();
+
+  if (!ok) {
+    SD.remove(tempPath);
+    lastError = message;
+    errorCount++;
+    return false;
+  }
+  if (SD.exists(path)) SD.remove(path);
+  if (!SD.rename(tempPath, path)) {
+    message = "Failed to commit " + path;
+    lastError = message;
+    errorCount++;
+    return false;
+  }
+
+  if (removeLoose) {
+    for (size_t k = 0; k < looseCount; k++) {
+      String filePath = String(DIR_SCRIPTS) + "/" + files[k];
+      SD.remove(filePath);
+      invalidateScriptCache(filePath);
+    }
+  }
+  loadAvailableScripts();
+  message = "Packed " + String(looseCount) + " scripts, kept " + String(files.size() - looseCount) + " (" +
+            String(header.dataBytes) + " bytes) in " + path;
+  Serial.println(message);
+  return true;
+}
+
+String getScriptLibraryStatsJson() {
+  size_t memoryBytes = 0;
+  for (const ScriptLibrary& lib : libraries) {
+    if (lib.memory) memoryBytes += lib.dataBytes;
+  }
+  return "{\"libraries\":" + String(libraries.size()) + ",\"scripts\":" + String(packedIndex.size()) +
+         ",\"memoryBytes\":" + String(memoryBytes) + ",\"memoryReads\":" + String(memoryReads) +
+         ",\"cardReads\":" + String(cardReads.load()) + ",\"hashFailures\":" + String(hashFailures.load()) + "}";
+}
@@ -0,0 +1,32 @@
+#ifndef SCRIPT_LIBRARY_H
+#define SCRIPT_LIBRARY_H
+
+#include "GlobalState.h"
+
+// Packed script libraries: DIR_SCRIPTS/*.pak files holding many scripts behind a
+// header index of name, offset, length and FNV-1a hash. loadAvailableScripts indexes
+// them in the same directory scan; a loose .txt of the same name takes precedence.
+// Libraries up to SCRIPT_LIBRARY_PSRAM_MAX_BYTES are kept whole in PSRAM.
+struct PackedScriptRef {
+  String container;       // Path of the .pak file
+  uint32_t offset = 0;
+  uint32_t length = 0;
+  uint32_t hash = 0;
+  size_t containerSize = 0;
+  time_t containerMtime = 0;
+};
+
+void clearScriptLibraries();
+// Adds the library's scripts that are not already listed to names
+bool indexScriptLibrary(String path, std::vector<String>& names);
+// filename may be a bare name or a path under DIR_SCRIPTS, as with loadScript
+bool findPackedScript(String filename, PackedScriptRef& ref);
+// useMemory = false reads from the card only (safe off the loop task)
+bool readPackedScript(const PackedScriptRef& ref, String& content, bool useMemory = true);
+// Packs the loose scripts in DIR_SCRIPTS into DIR_SCRIPTS/<name>.pak. Scripts already
+// in a library of that name are carried over unless a loose file replaces them, and an
+// unreadable library is never overwritten; removeLoose deletes the packed .txt files
+bool packScriptLibrary(String name, bool removeLoose, String& message);
+String getScriptLibraryStatsJson();
+
+#endif // SCRIPT_LIBRARY_H
@@ -0,0 +1,130 @@
+#include "ScriptModules.h"
+#include "ScriptCache.h"
+#include <esp_heap_caps.h>
+#include <set>
+
+struct LinkedLine {
+  const char* text;
+  uint32_t sourceOffset;
+};
+
+// Module path as written after IMPORT, quotes optional
+static String importTarget(const char* line) {
+  String target = String(line + 7);
+  target.trim();
+  if (target.length() >= 2 && target.startsWith("\"") && target.endsWith("\"")) {
+    target = target.substring(1, target.length() - 1);
+  }
+  return target;
+}
+
+static bool hasImports(const CompiledScript& script) {
+  for (size_t j = 0; j < script.lineCount(); j++) {
+    if (strncmp(script.line(j), "IMPORT ", 7) == 0) return true;
+  }
+  return false;
+}
+
+static bool isConstantLine(const char* line) {
+  return strncmp(line, "VAR ", 4) == 0 || strncmp(line, "VAR_", 4) == 0 || strncmp(line, "VARIABLE_", 9) == 0;
+}
+
+// Packs the collected lines into one buffer, the same layout compileScript builds
+static CompiledScriptPtr packLinkedScript(const CompiledScript& base, const std::vector<LinkedLine>& lines, uint32_t hash) {
+  size_t total = 0;
+  for (const LinkedLine& l : lines) total += strlen(l.text) + 1;
+
+  CompiledScriptPtr linked = std::make_shared<CompiledScript>();
+  linked->text = (char*)heap_caps_malloc(total + 1, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!linked->text) linked->text = (char*)malloc(total + 1);
+  if (!linked->text) return nullptr;
+
+  size_t out = 0;
+  linked->lineOffsets.reserve(lines.size());
+  linked->sourceOffsets.reserve(lines.size());
+  for (const LinkedLine& l : lines) {
+    size_t len = strlen(l.text);
+    linked->lineOffsets.push_back(out);
+    linked->sourceOffsets.push_back(l.sourceOffset);
+    memcpy(linked->text + out, l.text, len + 1);
+    out += len + 1;
+  }
+  linked->textSize = out;
+  linked->sourceBytes = base.sourceBytes;
+  linked->hash = hash;
+  linked->sourcePath = base.sourcePath;
+  linked->sourceBase = base.sourceBase;
+  linked->sourceFileSize = base.sourceFileSize;
+  linked->sourceMtime = base.sourceMtime;
+  linkCompiledScript(*linked);
+  return linked;
+}
+
+// chain holds the module paths being linked above this one, to break cycles
+static CompiledScriptPtr linkImports(CompiledScriptPtr script, std::vector<String>& chain) {
+  if (!script || !script->text || !hasImports(*script)) return script;
+
+  std::vector<CompiledScriptPtr> modules;  // Keeps borrowed line text alive until packed
+  std::vector<LinkedLine> lines;
+  std::vector<LinkedLine> appended;
+  std::set<String> defined;
+  for (auto const& [name, line] : script->functionTable) defined.insert(name);
+  uint32_t hash = script->hash;
+
+  for (size_t j = 0; j < script->lineCount(); j++) {
+    const char* line = script->line(j);
+    uint32_t offset = script->sourceOffsets[j];
+    if (strncmp(line, "IMPORT ", 7) != 0) {
+      lines.push_back({line, offset});
+      continue;
+    }
+
+    CompiledScriptPtr module = chain.size() < IMPORT_MAX_DEPTH ? getCachedScript(importTarget(line)) : nullptr;
+    if (!module) {
+      lines.push_back({line, offset});  // Reported by executeCommand when reached
+      continue;
+    }
+    if (std::find(chain.begin(), chain.end(), module->sourcePath) != chain.end()) continue;  // Already linking it
+
+    chain.push_back(module->sourcePath);
+    module = linkImports(module, chain);
+    chain.pop_back();
+    if (!module) continue;
+    modules.push_back(module);
+    hash = (hash ^ module->hash) * 16777619UL;
+
+    // Constants run where the IMPORT stood (a resumed cursor restarts at the IMPORT);
+    // FUNCTION blocks go after the caller's last line, where the executor jumps over them
+    for (size_t k = 0; k < module->lineCount(); k++) {
+      const char* mLine = module->line(k);
+      auto fnIt = module->functions.find(k);
+      if (fnIt != module->functions.end()) {
+        int endLine = fnIt->second.endLine;
+        if (endLine < 0) break;
+        String funcName, params;
+        parseFunctionCall(String(mLine + 9), funcName, params);
+        if (defined.insert(funcName).second) {
+          for (int m = k; m <= endLine; m++) appended.push_back({module->line(m), (uint32_t)script->sourceBytes});
+        }
+        k = endLine;
+      } else if (isConstantLine(mLine)) {
+        lines.push_back({mLine, offset});
+      }
+    }
+  }
+
+  lines.insert(lines.end(), appended.begin(), appended.end());
+  CompiledScriptPtr linked = packLinkedScript(*script, lines, hash);
+  if (!linked) {
+    lastError = "Out of memory linking imports";
+    errorCount++;
+    return script;
+  }
+  return linked;
+}
+
+CompiledScriptPtr linkScriptImports(CompiledScriptPtr script) {
+  std::vector<String> chain;
+  if (script && script->sourcePath.length() > 0) chain.push_back(script->sourcePath);
+  return linkImports(script, chain);
+}
@@ -0,0 +1,15 @@
+#ifndef SCRIPT_MODULES_H
+#define SCRIPT_MODULES_H
+
+#include "GlobalState.h"
+#include "DuckyInterpreter.h"
+
+// IMPORT "lib/common.txt" links a module into the calling script: its top-level
+// VAR/VAR_ lines replace the IMPORT line and its FUNCTION blocks are appended
+// (functions the caller defines itself win). Modules come compiled from the
+// script cache, so a shared library costs one SD read and one compile until the
+// file changes. Returns the script itself when it has no IMPORT lines; IMPORTs
+// that cannot be resolved stay in place and report an error when reached.
+CompiledScriptPtr linkScriptImports(CompiledScriptPtr script);
+
+#endif // SCRIPT_MODULES_H
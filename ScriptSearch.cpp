@@ -0,0 +1,441 @@
+#include "ScriptSearch.h"
+#include "FSManager.h"
+#include "ScriptLibrary.h"
+#include <ArduinoJson.h>
+#include <algorithm>
+#include <math.h>
+
+#define SEARCH_INDEX_MAGIC 0x58495344UL  // "DSIX"
+#define SEARCH_INDEX_VERSION 1
+#define SEARCH_NAME_WEIGHT 5  // Extra term frequency for tokens in the script's own name
+
+// Layout: header, docCount records (u8 nameLen, name, u32 size, u32 stamp),
+// then tokenCount records (u8 len, token, u32 postings, postings x (u16 doc, u16 tf)).
+struct SearchIndexHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t headerSize;
+  uint32_t docCount;
+  uint32_t tokenCount;
+};
+
+struct SearchDoc {
+  String name;      // Empty for a removed document whose id is free
+  uint32_t size;
+  uint32_t stamp;   // Loose file: mtime; packed script: content hash
+};
+
+struct Posting {
+  uint16_t doc;
+  uint16_t tf;
+};
+
+static std::vector<SearchDoc> docs;
+static std::map<String, std::vector<Posting>> postings;
+static std::vector<String> pendingScripts;   // Touched by a save/upload/delete, indexed first
+static std::vector<String> verifyScripts;    // Rescan: checked by size/stamp, reread only when changed
+static size_t verifyPos = 0;
+static bool rescanRequested = false;
+static bool searchLoaded = false;
+static bool searchDirty = false;
+static unsigned long searchChangedAt = 0;
+static unsigned long indexedScripts = 0;
+static unsigned long searches = 0;
+static unsigned long lastSearchUs = 0;
+
+static void markSearchChanged() {
+  searchDirty = true;
+  searchChangedAt = millis();
+}
+
+// Lowercase runs of [a-z0-9_] of at least two characters; longer runs are cut
+static void tokenize(const String& text, std::map<String, uint16_t>& counts, uint16_t weight = 1) {
+  String token;
+  size_t len = text.length();
+  for (size_t k = 0; k <= len; k++) {
+    char c = k < len ? tolower(text[k]) : ' ';
+    if (isalnum((unsigned char)c) || c == '_') {
+      if (token.length() < SEARCH_MAX_TOKEN_LENGTH) token += c;
+      continue;
+    }
+    if (token.length() >= 2) {
+      auto it = counts.find(token);
+      if (it != counts.end()) {
+        it->second = min(65535, it->second + weight);
+      } else if (counts.size() < SEARCH_MAX_TOKENS_PER_SCRIPT) {
+        counts[token] = weight;
+      }
+    }
+    token = "";
+  }
+}
+
+static int findDoc(const String& name) {
+  for (size_t k = 0; k < docs.size(); k++) {
+    if (docs[k].name == name) return k;
+  }
+  return -1;
+}
+
+static void removeDoc(int id) {
+  for (auto it = postings.begin(); it != postings.end();) {
+    std::vector<Posting>& list = it->second;
+    list.erase(std::remove_if(list.begin(), list.end(), [id](const Posting& p) { return p.doc == id; }), list.end());
+    if (list.empty()) it = postings.erase(it);
+    else ++it;
+  }
+  docs[id].name = "";
+  markSearchChanged();
+}
+
+static bool statScript(const String& name, uint32_t& size, uint32_t& stamp) {
+  PackedScriptRef packed;
+  if (findPackedScript(name, packed)) {
+    size = packed.length;
+    stamp = packed.hash;
+    return true;
+  }
+  File f = SD.open(String(DIR_SCRIPTS) + "/" + name);
+  bool found = f && !f.isDirectory();
+  if (found) {
+    size = f.size();
+    stamp = (uint32_t)f.getLastWrite();
+  }
+  if (f) f.close();
+  return found;
+}
+
+static bool readScriptText(const String& name, String& content) {
+  PackedScriptRef packed;
+  if (findPackedScript(name, packed)) return readPackedScript(packed, content);
+  File f = SD.open(String(DIR_SCRIPTS) + "/" + name);
+  if (!f || f.isDirectory()) {
+    if (f) f.close();
+    return false;
+  }
+  content = f.readString();
+  f.close();
+  return true;
+}
+
+// Reindexes one script if its size or stamp changed; drops it when it is gone
+static void indexScript(const String& name) {
+  int id = findDoc(name);
+  uint32_t size, stamp;
+  if (!statScript(name, size, stamp)) {
+    if (id >= 0) removeDoc(id);
+    return;
+  }
+  if (id >= 0 && docs[id].size == size && docs[id].stamp == stamp) return;
+
+  String content;
+  if (!readScriptText(name, content)) return;
+  if (id >= 0) removeDoc(id);
+
+  std::map<String, uint16_t> counts;
+  tokenize(name, counts, SEARCH_NAME_WEIGHT);
+  tokenize(content, counts);
+
+  // Ids are u16 in the postings; removed documents leave a free slot
+  id = findDoc("");
+  if (id < 0) {
+    if (docs.size() >= 65535) return;
+    id = docs.size();
+    docs.push_back(SearchDoc());
+  }
+  docs[id] = {name, size, stamp};
+  for (const auto& kv : counts) postings[kv.first].push_back({(uint16_t)id, kv.second});
+  indexedScripts++;
+  markSearchChanged();
+}
+
+static void loadSearchIndex() {
+  searchLoaded = true;
+  if (!sdCardPresent) return;
+  File f = SD.open(FILE_SEARCH_INDEX);
+  if (!f) {
+    rescanRequested = true;  // First use on this card: index everything in the background
+    return;
+  }
+
+  SearchIndexHeader header;
+  bool ok = f.read((uint8_t*)&header, sizeof(header)) == sizeof(header) && header.magic == SEARCH_INDEX_MAGIC &&
+            header.version == SEARCH_INDEX_VERSION && f.seek(header.headerSize);
+  char name[256];
+  for (uint32_t k = 0; ok && k < header.docCount; k++) {
+    uint8_t len = 0;
+    SearchDoc doc;
+    ok = f.read(&len, 1) == 1 && f.read((uint8_t*)name, len) == len &&
+         f.read((uint8_t*)&doc.size, 4) == 4 && f.read((uint8_t*)&doc.stamp, 4) == 4;
+    name[len] = '\0';
+    doc.name = name;
+    docs.push_back(doc);
+  }
+  for (uint32_t k = 0; ok && k < header.tokenCount; k++) {
+    uint8_t len = 0;
+    uint32_t count = 0;
+    ok = f.read(&len, 1) == 1 && f.read((uint8_t*)name, len) == len && f.read((uint8_t*)&count, 4) == 4 &&
+         count <= header.docCount;
+    if (!ok) break;
+    name[len] = '\0';
+    std::vector<Posting>& list = postings[String(name)];
+    list.resize(count);
+    ok = f.read((uint8_t*)list.data(), count * sizeof(Posting)) == (int)(count * sizeof(Posting));
+    for (size_t p = 0; ok && p < list.size(); p++) ok = list[p].doc < docs.size();
+  }
+  f.close();
+
+  if (!ok) {
+    Serial.println("[Search] Index unreadable, rebuilding");
+    docs.clear();
+    postings.clear();
+    rescanRequested = true;
+    return;
+  }
+  Serial.println("[Search] Loaded index: " + String(docs.size()) + " scripts, " + String(postings.size()) + " tokens");
+}
+
+// Written compacted (removed ids renumbered) to a .part file, then renamed over the old one
+static void saveSearchIndex() {
+  searchDirty = false;
+  if (!sdCardPresent) return;
+
+  std::vector<int> remap(docs.size(), -1);
+  SearchIndexHeader header = {SEARCH_INDEX_MAGIC, SEARCH_INDEX_VERSION, sizeof(SearchIndexHeader), 0, (uint32_t)postings.size()};
+  for (size_t k = 0; k < docs.size(); k++) {
+    if (docs[k].name.length() > 0) remap[k] = header.docCount++;
+  }
+
+  String tempPath = String(FILE_SEARCH_INDEX) + STAGE_FILE_SUFFIX;
+  if (SD.exists(tempPath)) SD.remove(tempPath);
+  File f = SD.open(tempPath, FILE_WRITE);
+  if (!f) {
+    Serial.println("[Search] Failed to write " + tempPath);
+    return;
+  }
+  f.write((const uint8_t*)&header, sizeof(header));
+  for (const SearchDoc& doc : docs) {
+    if (doc.name.length() == 0) continue;
+    uint8_t len = min((size_t)255, (size_t)doc.name.length());
+    f.write(&len, 1);
+    f.write((const uint8_t*)doc.name.c_str(), len);
+    f.write((const uint8_t*)&doc.size, 4);
+    f.write((const uint8_t*)&doc.stamp, 4);
+  }
+  for (auto& kv : postings) {
+    uint8_t len = kv.first.length();
+    uint32_t count = kv.second.size();
+    f.write(&len, 1);
+    f.write((const uint8_t*)kv.first.c_str(), len);
+    f.write((const uint8_t*)&count, 4);
+    for (Posting p : kv.second) {
+      p.doc = remap[p.doc];
+      f.write((const uint8_t*)&p, sizeof(p));
+    }
+  }
+  f.close();
+
+  if (SD.exists(FILE_SEARCH_INDEX)) SD.remove(FILE_SEARCH_INDEX);
+  if (!SD.rename(tempPath, FILE_SEARCH_INDEX)) {
+    Serial.println("[Search] Failed to commit " + String(FILE_SEARCH_INDEX));
+    return;
+  }
+
+  // Keep the in-memory ids in step with the file
+  std::vector<SearchDoc> compacted;
+  for (const SearchDoc& doc : docs) {
+    if (doc.name.length() > 0) compacted.push_back(doc);
+  }
+  for (auto& kv : postings) {
+    for (Posting& p : kv.second) p.doc = remap[p.doc];
+  }
+  docs.swap(compacted);
+}
+
+// Scripts still to be read: queued updates plus the rest of the rescan. A rescan that
+// has not started yet will visit every listed script.
+static size_t scriptsToIndex() {
+  return pendingScripts.size() + (rescanRequested ? availableScripts.size() : verifyScripts.size() - verifyPos);
+}
+
+// Snapshot of the script list; documents no longer listed are dropped right away
+static void startRescan() {
+  ensureAvailableScripts();
+  rescanRequested = false;  // After the scan, which requests a rescan itself
+  verifyScripts = availableScripts;
+  verifyPos = 0;
+  for (size_t k = 0; k < docs.size(); k++) {
+    if (docs[k].name.length() > 0 && std::find(verifyScripts.begin(), verifyScripts.end(), docs[k].name) == verifyScripts.end()) {
+      removeDoc(k);
+    }
+  }
+}
+
+void queueSearchIndexUpdate(String filename) {
+  if (filename.startsWith(String(DIR_SCRIPTS) + "/")) filename = filename.substring(strlen(DIR_SCRIPTS) + 1);
+  if (!filename.endsWith(".txt") || filename.indexOf('/') >= 0) return;
+  if (std::find(pendingScripts.begin(), pendingScripts.end(), filename) == pendingScripts.end()) {
+    pendingScripts.push_back(filename);
+  }
+}
+
+void queueSearchIndexRescan() {
+  rescanRequested = true;
+}
+
+void processSearchIndex() {
+  if (!searchLoaded) {
+    if (pendingScripts.empty()) return;
+    loadSearchIndex();
+  }
+  if (!sdCardPresent) return;
+
+  int budget = SEARCH_INDEX_BATCH;
+  while (budget > 0 && !pendingScripts.empty()) {
+    String name = pendingScripts.front();
+    pendingScripts.erase(pendingScripts.begin());
+    indexScript(name);
+    budget--;
+  }
+  if (rescanRequested) startRescan();
+  while (budget > 0 && verifyPos < verifyScripts.size()) {
+    indexScript(verifyScripts[verifyPos++]);
+    budget--;
+  }
+  if (verifyPos >= verifyScripts.size() && !verifyScripts.empty()) {
+    verifyScripts.clear();
+    verifyPos = 0;
+  }
+
+  bool settled = pendingScripts.empty() && verifyScripts.empty();
+  if (searchDirty && settled && millis() - searchChangedAt >= SEARCH_SAVE_DELAY_MS) saveSearchIndex();
+}
+
+struct SearchHit {
+  uint16_t doc;
+  uint32_t matched;  // Bit per query word
+  float score;
+};
+
+String searchScriptsJson(String query, int limit) {
+  unsigned long start = micros();
+  // Queued scripts are left to processSearchIndex so a search never reads script
+  // bodies beyond its own hits; the reply says how much is still being indexed
+  if (!searchLoaded) loadSearchIndex();
+  searches++;
+
+  // Query words in order, kept distinct; the last one is a prefix while still being typed
+  std::vector<String> words;
+  String lowered = query;
+  lowered.toLowerCase();
+  std::map<String, uint16_t> seen;
+  String word;
+  for (size_t k = 0; k <= lowered.length() && words.size() < 32; k++) {
+    char c = k < lowered.length() ? lowered[k] : ' ';
+    if (isalnum((unsigned char)c) || c == '_') {
+      if (word.length() < SEARCH_MAX_TOKEN_LENGTH) word += c;
+    } else {
+      if (word.length() >= 2 && seen.find(word) == seen.end()) {
+        seen[word] = 1;
+        words.push_back(word);
+      }
+      word = "";
+    }
+  }
+  bool prefixLast = lowered.length() > 0 && lowered[lowered.length() - 1] != ' ';
+
+  size_t liveDocs = 0;
+  for (const SearchDoc& doc : docs) {
+    if (doc.name.length() > 0) liveDocs++;
+  }
+
+  // tf-idf per word, summed; documents matching more of the words rank first
+  std::map<uint16_t, SearchHit> hits;
+  for (size_t w = 0; w < words.size(); w++) {
+    auto addPostings = [&](const std::vector<Posting>& list) {
+      float idf = logf(1.0f + (float)liveDocs / list.size());
+      for (const Posting& p : list) {
+        SearchHit& hit = hits[p.doc];
+        hit.doc = p.doc;
+        hit.matched |= 1UL << w;
+        hit.score += (1.0f + logf(p.tf)) * idf;
+      }
+    };
+    if (prefixLast && w + 1 == words.size()) {
+      for (auto it = postings.lower_bound(words[w]); it != postings.end() && it->first.startsWith(words[w]); ++it) {
+        addPostings(it->second);
+      }
+    } else {
+      auto it = postings.find(words[w]);
+      if (it != postings.end()) addPostings(it->second);
+    }
+  }
+
+  std::vector<SearchHit> ranked;
+  for (const auto& kv : hits) ranked.push_back(kv.second);
+  std::sort(ranked.begin(), ranked.end(), [](const SearchHit& a, const SearchHit& b) {
+    int ca = __builtin_popcount(a.matched), cb = __builtin_popcount(b.matched);
+    return ca != cb ? ca > cb : a.score > b.score;
+  });
+  if (limit <= 0 || limit > SEARCH_MAX_RESULTS) limit = SEARCH_MAX_RESULTS;
+  if ((int)ranked.size() > limit) ranked.resize(limit);
+
+  DynamicJsonDocument doc(SEARCH_DOC_SIZE);
+  doc["query"] = query;
+  doc["total"] = hits.size();
+  doc["indexing"] = scriptsToIndex();
+  doc["rescan"] = rescanRequested || verifyPos < verifyScripts.size();
+  JsonArray results = doc.createNestedArray("hits");
+
+  // Only the returned hits are read, for their first matching line
+  for (const SearchHit& hit : ranked) {
+    JsonObject result = results.createNestedObject();
+    result["name"] = docs[hit.doc].name;
+    result["score"] = roundf(hit.score * 100) / 100;
+    result["matched"] = __builtin_popcount(hit.matched);
+
+    String content;
+    if (!readScriptText(docs[hit.doc].name, content)) continue;
+    int lineStart = 0;
+    for (int lineNo = 1; lineStart <= (int)content.length(); lineNo++) {
+      int lineEnd = content.indexOf('\n', lineStart);
+      if (lineEnd < 0) lineEnd = content.length();
+      String line = content.substring(lineStart, lineEnd);
+      String lower = line;
+      lower.toLowerCase();
+      bool found = false;
+      for (const String& w : words) {
+        if (lower.indexOf(w) >= 0) {
+          found = true;
+          break;
+        }
+      }
+      if (found) {
+        line.trim();
+        if (line.length() > 120) line = line.substring(0, 120);
+        result["line"] = lineNo;
+        result["snippet"] = line;
+        break;
+      }
+      lineStart = lineEnd + 1;
+    }
+  }
+
+  lastSearchUs = micros() - start;
+  doc["elapsedUs"] = lastSearchUs;
+  String json;
+  serializeJson(doc, json);
+  return json;
+}
+
+String getSearchIndexStatsJson() {
+  size_t liveDocs = 0;
+  for (const SearchDoc& doc : docs) {
+    if (doc.name.length() > 0) liveDocs++;
+  }
+  return "{\"loaded\":" + String(searchLoaded ? "true" : "false") + ",\"scripts\":" + String(liveDocs) +
+         ",\"tokens\":" + String(postings.size()) + ",\"pending\":" + String(pendingScripts.size()) +
+         ",\"verifying\":" + String(verifyScripts.size() - verifyPos) + ",\"rescanQueued\":" + String(rescanRequested ? "true" : "false") +
+         ",\"indexing\":" + String(scriptsToIndex()) + ",\"indexed\":" + String(indexedScripts) +
+         ",\"searches\":" + String(searches) + ",\"lastSearchUs\":" + String(lastSearchUs) + "}";
+}
@@ -0,0 +1,18 @@
+#ifndef SCRIPT_SEARCH_H
+#define SCRIPT_SEARCH_H
+
+#include "GlobalState.h"
+
+// Full-text search over DIR_SCRIPTS and packed libraries: an inverted index of
+// lowercase tokens to scripts, persisted to FILE_SEARCH_INDEX and loaded on first
+// use. Saves, uploads and deletes queue the one script they touched; a script
+// rescan re-checks every script by size and mtime (packed: hash). Both are worked
+// off a few scripts per loop pass, and the file is rewritten once changes settle.
+void queueSearchIndexUpdate(String filename);
+void queueSearchIndexRescan();
+void processSearchIndex();
+// Ranked hits with the first matching line; the last query word also matches as a prefix
+String searchScriptsJson(String query, int limit = SEARCH_MAX_RESULTS);
+String getSearchIndexStatsJson();
+
+#endif // SCRIPT_SEARCH_H
@@ -0,0 +1,368 @@
+#include "ScriptSimulator.h"
+#include "USBManager.h"
+#include <algorithm>
+
+// Cost of one command: time spent sending reports vs. waiting
+struct SimCost {
+  uint32_t typingMs = 0;
+  uint32_t waitMs = 0;
+  uint32_t reports = 0;
+  uint32_t chars = 0;
+  uint32_t keys = 0;
+  uint32_t missing = 0;
+};
+
+struct SimWait {
+  uint32_t count = 0;
+  uint32_t totalMs = 0;
+};
+
+struct SimRun {
+  int keyDelay = 0;
+  uint32_t typingMs = 0;
+  uint32_t waitMs = 0;
+  uint32_t defaultDelayMs = 0;
+  uint32_t hidReports = 0;
+  uint32_t charsTyped = 0;
+  uint32_t keyPresses = 0;
+  uint32_t missingKeys = 0;
+  uint32_t commands = 0;
+  uint32_t assumedBranches = 0;
+  uint32_t assumedLoops = 0;
+  uint32_t externalCommands = 0;
+  uint32_t reboots = 0;
+  uint32_t steps = 0;
+  bool truncated = false;
+  int endedAt = 0;
+  SimCost lastCost;  // What REPEAT resends
+  std::vector<int> unboundedWaits;
+  std::map<int, SimWait> waits;  // By compiled line index
+};
+
+// The run being priced while simulateScriptJson has the executor in dry-run mode
+static SimRun* activeRun = nullptr;
+
+// Commands whose duration depends on the network, the SD card or the host
+static const char* const EXTERNAL_PREFIXES[] = {
+  "JOIN_INTERNET", "LEAVE_INTERNET", "HTTP_REQUEST", "HTTPS_REQUEST", "DOWNLOAD_FILE",
+  "UPLOAD_FILE", "PING ", "WIFI_ON", "WIFI_OFF", "BLUETOOTH_ON", "BLUETOOTH_OFF",
+  "BLUETOOTH_DISCOVERY", "DETECT_OS", "RUN_PAYLOAD", "COPY_FILE", "CUT_FILE", "PASTE_FILE",
+  "GET_TIME", "GET_DAY", "SAVE_CREDENTIALS", "LOCALE"
+};
+
+// Single-key aliases resolved by executeCommand before the keymap fallback
+static const struct { const char* name; const char* key; } KEY_ALIASES[] = {
+  {"CONTROL", "CTRL"}, {"WINDOWS", "GUI"}, {"ESCAPE", "ESC"}, {"DEL", "DELETE"},
+  {"UPARROW", "UP"}, {"DOWNARROW", "DOWN"}, {"LEFTARROW", "LEFT"}, {"RIGHTARROW", "RIGHT"},
+  {"BREAK", "PAUSE"}, {"MENU", "APP"}
+};
+
+static bool findKey(const String& name, KeyCode& kc) {
+  auto it = currentKeymap.find(name);
+  if (it == currentKeymap.end()) return false;
+  kc = parseKeyCode(it->second);
+  return true;
+}
+
+static int modifierBits(uint8_t modifier) {
+  return __builtin_popcount(modifier);
+}
+
+// fastTypeString: modifier presses + key + releaseAll, 2 ms hold, then the key gap
+static void typeCost(SimCost& cost, const String& text, int keyDelay) {
+  for (size_t i = 0; i < text.length(); i++) {
+    KeyCode kc;
+    if (!findKey(String(text.charAt(i)), kc)) {
+      cost.missing++;
+      continue;
+    }
+    cost.reports += modifierBits(kc.modifier) + (kc.key > 0 ? 1 : 0) + 1;
+    cost.typingMs += 2 + (keyDelay > 0 ? keyDelay : 2);
+    cost.chars++;
+  }
+}
+
+// fastPressKey: a bare modifier taps each bit for 5 ms, anything else is one 5 ms chord
+static void pressCost(SimCost& cost, const String& key) {
+  KeyCode kc;
+  if (!findKey(key, kc)) {
+    cost.missing++;
+    return;
+  }
+  int bits = modifierBits(kc.modifier);
+  if (kc.key == 0 && bits > 0) {
+    cost.reports += 2 * bits;
+    cost.typingMs += 5 * bits;
+  } else {
+    cost.reports += bits + (kc.key > 0 ? 1 : 0) + 1;
+    cost.typingMs += 5;
+  }
+  cost.keys++;
+}
+
+static void comboCost(SimCost& cost, const std::vector<String>& keys) {
+  uint8_t modifier = 0;
+  bool mainKey = false;
+  for (const String& key : keys) {
+    KeyCode kc;
+    if (!findKey(key, kc)) {
+      cost.missing++;
+      continue;
+    }
+    modifier |= kc.modifier;
+    if (kc.key > 0) mainKey = true;
+  }
+  cost.reports += modifierBits(modifier) + (mainKey ? 1 : 0) + 1;
+  cost.typingMs += 5;
+  cost.keys++;
+}
+
+static std::vector<String> splitTokens(const String& text) {
+  std::vector<String> tokens;
+  int s1 = 0, s2 = text.indexOf(' ');
+  while (s2 != -1) {
+    if (s2 > s1) tokens.push_back(text.substring(s1, s2));
+    s1 = s2 + 1;
+    s2 = text.indexOf(' ', s1);
+  }
+  if (s1 < (int)text.length()) tokens.push_back(text.substring(s1));
+  return tokens;
+}
+
+// Prices one line the way executeCommand would run it (REPEAT is handled by the caller)
+static SimCost priceCommand(SimRun& run, const String& line, int lineIdx) {
+  SimCost cost;
+
+  if (line.startsWith("STRING ") || line.startsWith("STRINGLN ")) {
+    bool newline = line.startsWith("STRINGLN ");
+    typeCost(cost, processVariables(line.substring(newline ? 9 : 7)), run.keyDelay);
+    if (newline) pressCost(cost, "ENTER");
+    return cost;
+  }
+
+  if (line.startsWith("DELAY ")) {
+    String delayStr = line.substring(6);
+    delayStr.trim();
+    if (delayStr.endsWith("ms")) {
+      delayStr = delayStr.substring(0, delayStr.length() - 2);
+      delayStr.trim();
+    }
+    int delayTime = delayStr.toInt();
+    if (delayTime > 0) cost.waitMs = delayTime;
+    return cost;
+  }
+
+  if (line == "HOLD_TILL_STRING") return cost;
+
+  if (line.startsWith("HOLD_TILL_") || line.startsWith("WAIT_FOR_")) {
+    run.unboundedWaits.push_back(lineIdx);
+    return cost;
+  }
+
+  if (line.startsWith("HOLD ")) {
+    std::vector<String> keys = splitTokens(line.substring(5));
+    int dur = -1;
+    if (keys.size() > 1) {
+      const String& last = keys.back();
+      bool isNum = last.length() > 0;
+      for (size_t k = 0; k < last.length(); k++) if (!isdigit(last[k])) { isNum = false; break; }
+      if (isNum) {
+        dur = last.toInt();
+        keys.pop_back();
+      }
+    }
+    for (const String& key : keys) {
+      KeyCode kc;
+      if (!findKey(key, kc)) continue;
+      cost.reports += modifierBits(kc.modifier) + (kc.key > 0 ? 1 : 0);
+      cost.keys++;
+    }
+    if (dur > 0) {
+      cost.waitMs = dur * 1000;
+      cost.reports++;
+    }
+    return cost;
+  }
+
+  if (line == "STOPHOLD") {
+    cost.reports++;
+    return cost;
+  }
+
+  if (line.startsWith("KEYCODE ")) {
+    std::vector<String> codes = splitTokens(line.substring(8));
+    if (codes.size() >= 2) {
+      uint8_t modifier = strtol(codes[0].c_str(), NULL, 16) & 0x0F;
+      uint8_t key = strtol(codes[1].c_str(), NULL, 16);
+      cost.reports += modifierBits(modifier) + (key > 0 ? 1 : 0) + 1;
+      cost.typingMs += 5;
+      cost.keys++;
+    }
+    return cost;
+  }
+
+  if (line == "REBOOT" || line == "SHUTDOWN" || line == "SELFDESTRUCT" || line.startsWith("SELFDESTRUCT ")) {
+    run.endedAt = lineIdx + 1;
+    return cost;
+  }
+
+  for (const char* prefix : EXTERNAL_PREFIXES) {
+    if (line.startsWith(prefix)) {
+      run.externalCommands++;
+      return cost;
+    }
+  }
+
+  for (auto const& alias : KEY_ALIASES) {
+    if (line == alias.name) {
+      pressCost(cost, alias.key);
+      return cost;
+    }
+  }
+
+  // handleKeyInput fallback — only lines that start with a key reach the host
+  std::vector<String> keys = splitTokens(line);
+  if (keys.empty() || currentKeymap.find(keys[0]) == currentKeymap.end()) return cost;
+  if (keys.size() == 1) pressCost(cost, keys[0]);
+  else comboCost(cost, keys);
+  return cost;
+}
+
+static void applyCost(SimRun& run, const SimCost& cost, int lineIdx, uint32_t times) {
+  if (times == 0) return;
+  run.typingMs += cost.typingMs * times;
+  run.waitMs += cost.waitMs * times;
+  run.hidReports += cost.reports * times;
+  run.charsTyped += cost.chars * times;
+  run.keyPresses += cost.keys * times;
+  run.missingKeys += cost.missing * times;
+  if (cost.waitMs > 0) {
+    SimWait& wait = run.waits[lineIdx];
+    wait.count += times;
+    wait.totalMs += cost.waitMs * times;
+  }
+}
+
+// Compiled line number plus its byte offset in the source, so the editor can map it
+static String lineRefJson(const CompiledScript& script, int lineIdx) {
+  uint32_t offset = lineIdx < (int)script.sourceOffsets.size() ? script.sourceBase + script.sourceOffsets[lineIdx] : 0;
+  return "{\"line\":" + String(lineIdx + 1) + ",\"offset\":" + String(offset);
+}
+
+// State changes the rest of the script reads; the executor runs these for real
+static bool isStateCommand(const String& line) {
+  if (line.startsWith("VAR ") || line.startsWith("LOCAL ") ||
+      line.startsWith("DEFAULTDELAY ") || line.startsWith("DEFAULT_DELAY ")) return true;
+  int eqIdx = line.indexOf('=');
+  if (eqIdx < 0) return false;
+  String name = line.substring(0, eqIdx);
+  name.trim();
+  return name == "VAR" || name.startsWith("VAR_") || name.startsWith("VARIABLE_");
+}
+
+bool simulationStep(int lineIdx) {
+  if (activeRun->endedAt != 0) return false;
+  if (++activeRun->steps > SIMULATION_MAX_STEPS) {
+    activeRun->truncated = true;
+    return false;
+  }
+  return true;
+}
+
+bool simulateCommand(const String& line, int lineIdx) {
+  SimRun& run = *activeRun;
+  run.commands++;
+  bool state = isStateCommand(line);
+  int gap = defaultDelay;
+  if (line.startsWith("DEFAULTDELAY ") || line.startsWith("DEFAULT_DELAY ")) {
+    gap = line.substring(line.indexOf(' ') + 1).toInt();
+  }
+
+  if (line.startsWith("REPEAT ")) {
+    int count = line.substring(7).toInt();
+    applyCost(run, run.lastCost, lineIdx, count > 0 ? count : 0);
+  } else {
+    run.lastCost = state ? SimCost() : priceCommand(run, line, lineIdx);
+    applyCost(run, run.lastCost, lineIdx, 1);
+  }
+  run.defaultDelayMs += gap > 0 ? gap : 0;
+  return !state;
+}
+
+// Conditions depend on the live host and radios, so every such IF takes its first branch
+bool simulateLiveCondition(int lineIdx) {
+  activeRun->assumedBranches++;
+  return true;
+}
+
+// Like IF, a WHILE condition is live state: each loop is priced as a single pass
+bool simulateWhilePass(int lineIdx, int pass) {
+  if (pass > 0) return false;
+  activeRun->assumedLoops++;
+  return true;
+}
+
+void simulateExternal(int lineIdx, bool reboot) {
+  if (reboot) activeRun->reboots++;
+  else activeRun->externalCommands++;
+}
+
+void simulationHalted(int lineIdx) {
+  if (activeRun->endedAt == 0 && !activeRun->truncated) activeRun->endedAt = lineIdx + 1;
+}
+
+String simulateScriptJson(CompiledScriptPtr script, int keyDelay) {
+  if (!script || !script->text) return "{\"success\":false,\"message\":\"Nothing to simulate\"}";
+  if (scriptRunning) return "{\"success\":false,\"message\":\"A script is running\"}";
+
+  SimRun run;
+  run.keyDelay = keyDelay >= 0 ? keyDelay : delayBetweenKeys;
+
+  // The dry run assigns variables and DEFAULTDELAY for real; put them back afterwards
+  std::map<String, ScriptValue> savedVariables = variables;
+  int savedDefaultDelay = defaultDelay;
+  String savedError = lastError;
+  int savedErrorCount = errorCount;
+  int savedLineNum = currentLineNum;
+
+  activeRun = &run;
+  executeCompiledScript(script, nullptr, true);
+  activeRun = nullptr;
+
+  variables.swap(savedVariables);
+  defaultDelay = savedDefaultDelay;
+  lastError = savedError;
+  errorCount = savedErrorCount;
+  currentLineNum = savedLineNum;
+
+  // Longest waits by total time on their line
+  std::vector<std::pair<int, SimWait>> waits(run.waits.begin(), run.waits.end());
+  std::sort(waits.begin(), waits.end(), [](const std::pair<int, SimWait>& a, const std::pair<int, SimWait>& b) {
+    return a.second.totalMs > b.second.totalMs;
+  });
+  if (waits.size() > SIMULATION_TOP_WAITS) waits.resize(SIMULATION_TOP_WAITS);
+
+  String json = "{\"success\":true,\"estimatedMs\":" + String(run.typingMs + run.waitMs + run.defaultDelayMs) +
+                ",\"typingMs\":" + String(run.typingMs) + ",\"waitMs\":" + String(run.waitMs) +
+                ",\"defaultDelayMs\":" + String(run.defaultDelayMs) + ",\"keyDelay\":" + String(run.keyDelay) +
+                ",\"hidReports\":" + String(run.hidReports) + ",\"charsTyped\":" + String(run.charsTyped) +
+                ",\"keyPresses\":" + String(run.keyPresses) + ",\"missingKeys\":" + String(run.missingKeys) +
+                ",\"commands\":" + String(run.commands) + ",\"steps\":" + String(run.steps) +
+                ",\"assumedBranches\":" + String(run.assumedBranches) +
+                ",\"assumedLoops\":" + String(run.assumedLoops) +
+                ",\"externalCommands\":" + String(run.externalCommands) + ",\"reboots\":" + String(run.reboots) +
+                ",\"endedAt\":" + String(run.endedAt) + ",\"truncated\":" + String(run.truncated ? "true" : "false") +
+                ",\"longestWaits\":[";
+  for (size_t w = 0; w < waits.size(); w++) {
+    if (w > 0) json += ",";
+    json += lineRefJson(*script, waits[w].first) + ",\"count\":" + String(waits[w].second.count) +
+            ",\"totalMs\":" + String(waits[w].second.totalMs) + "}";
+  }
+  json += "],\"unboundedWaits\":[";
+  for (size_t w = 0; w < run.unboundedWaits.size() && w < SIMULATION_TOP_WAITS; w++) {
+    if (w > 0) json += ",";
+    json += lineRefJson(*script, run.unboundedWaits[w]) + "}";
+  }
+  json += "]}";
+  return json;
+}
@@ -0,0 +1,23 @@
+#ifndef SCRIPT_SIMULATOR_H
+#define SCRIPT_SIMULATOR_H
+
+#include "GlobalState.h"
+#include "DuckyInterpreter.h"
+
+// Dry run of a compiled script on a virtual clock. executeCompiledScript walks the
+// script in simulate mode and hands each command to the hooks below, which price it
+// with the USBManager report timings instead of sending HID reports or touching
+// WiFi/BT/SD. Variables, FOR counters and calls run for real and are restored
+// afterwards; IF_* conditions take their first branch and WHILE loops one pass.
+// keyDelay < 0 uses the current delayBetweenKeys.
+String simulateScriptJson(CompiledScriptPtr script, int keyDelay = -1);
+
+// Executor hooks, only called during simulateScriptJson
+bool simulationStep(int lineIdx);                         // false stops the run
+bool simulateCommand(const String& line, int lineIdx);    // false: a state change to run for real
+bool simulateLiveCondition(int lineIdx);                  // Branch to take for an IF_* condition
+bool simulateWhilePass(int lineIdx, int pass);            // Whether to enter the body again
+void simulateExternal(int lineIdx, bool reboot);          // Rower/reboot payloads, USB identity change
+void simulationHalted(int lineIdx);                       // The executor stopped before the end
+
+#endif // SCRIPT_SIMULATOR_H
@@ -0,0 +1,62 @@
+#include "ScriptValue.h"
+
+ScriptValue ScriptValue::parse(const String& text) {
+  size_t len = text.length();
+  if (len == 0 || len > 20) return ScriptValue(text);
+  if (text == "true") return ScriptValue(true);
+  if (text == "false") return ScriptValue(false);
+
+  const char* p = text.c_str();
+  size_t k = (p[0] == '-') ? 1 : 0;
+  size_t digits = 0;
+  int dots = 0;
+  for (size_t j = k; j < len; j++) {
+    if (isdigit((unsigned char)p[j])) digits++;
+    else if (p[j] == '.') dots++;
+    else return ScriptValue(text);
+  }
+  if (digits == 0 || dots > 1) return ScriptValue(text);
+
+  ScriptValue v = dots ? ScriptValue(strtod(p, nullptr)) : ScriptValue((int64_t)strtoll(p, nullptr, 10));
+  if (v.toString() != text) return ScriptValue(text);
+  return v;
+}
+
+int64_t ScriptValue::asInt() const {
+  switch (type) {
+    case VALUE_INT:
+    case VALUE_BOOL: return i;
+    case VALUE_DOUBLE: return (int64_t)d;
+    default: return strtoll(s.c_str(), nullptr, 10);
+  }
+}
+
+double ScriptValue::asDouble() const {
+  switch (type) {
+    case VALUE_INT:
+    case VALUE_BOOL: return (double)i;
+    case VALUE_DOUBLE: return d;
+    default: return strtod(s.c_str(), nullptr);
+  }
+}
+
+String ScriptValue::toString() const {
+  char buf[32];
+  switch (type) {
+    case VALUE_INT:
+      snprintf(buf, sizeof(buf), "%lld", (long long)i);
+      return String(buf);
+    case VALUE_BOOL:
+      return i ? "true" : "false";
+    case VALUE_DOUBLE: {
+      // Up to 6 decimals without trailing zeros: 2.5, not 2.50
+      snprintf(buf, sizeof(buf), "%.6f", d);
+      char* end = buf + strlen(buf) - 1;
+      while (end > buf && *end == '0') *end-- = '\0';
+      if (*end == '.') *end = '\0';
+      return String(buf);
+    }
+    default:
+      return s;
+  }
+}
@@ -0,0 +1,43 @@
+#ifndef SCRIPT_VALUE_H
+#define SCRIPT_VALUE_H
+
+#include <Arduino.h>
+
+// Script variable value. Numbers stay numeric through loops and VAR arithmetic
+// and only become text when interpolated (processVariables).
+enum ScriptValueType : uint8_t { VALUE_STRING, VALUE_INT, VALUE_DOUBLE, VALUE_BOOL };
+
+struct ScriptValue {
+  ScriptValueType type = VALUE_STRING;
+  union {
+    int64_t i;
+    double d;
+  };
+  String s;
+
+  ScriptValue() : i(0) {}
+  ScriptValue(const String& v) : i(0), s(v) {}
+  ScriptValue(const char* v) : i(0), s(v) {}
+  ScriptValue(int64_t v) : type(VALUE_INT), i(v) {}
+  ScriptValue(int v) : type(VALUE_INT), i(v) {}
+  ScriptValue(double v) : type(VALUE_DOUBLE), d(v) {}
+  ScriptValue(bool v) : type(VALUE_BOOL), i(v ? 1 : 0) {}
+
+  // Typed literal when the text round-trips exactly ("42", "-1.5", "true"),
+  // otherwise the text itself — "007" and "1.50" stay strings.
+  static ScriptValue parse(const String& text);
+
+  bool isNumber() const { return type == VALUE_INT || type == VALUE_DOUBLE; }
+  int64_t asInt() const;
+  double asDouble() const;
+  String toString() const;
+
+  // Loop counter fast path: no allocation once the slot holds an integer
+  void setInt(int64_t v) {
+    if (type == VALUE_STRING && s.length()) s = String();
+    type = VALUE_INT;
+    i = v;
+  }
+};
+
+#endif // SCRIPT_VALUE_H
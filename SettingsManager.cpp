@@ -0,0 +1,287 @@
+#include "SettingsManager.h"
+#include "LogManager.h"
+
+#define SETTINGS_BLOB_KEY "settings"
+#define SETTINGS_VERSION 2     // v2: boot script list moved to its own key
+#define BOOT_SCRIPTS_KEY "boot_script"  // Same NVS string the per-key layout used
+
+// On-flash layout. Every version starts with the version/size header; bump
+// SETTINGS_VERSION when fields change and extend loadSettings() to upgrade the
+// older blob. Fields appended within a version keep their defaults when an
+// older, shorter blob is read.
+struct PersistedSettingsHeader {
+  uint16_t version;
+  uint16_t size;
+};
+
+struct PersistedSettings {
+  uint16_t version;
+  uint16_t size;
+  char apSsid[33];
+  char apPassword[65];
+  char language[24];
+  int32_t wifiScanTime;
+  uint8_t ledEnabled;
+  uint8_t loggingEnabled;
+  uint8_t autoConnect;
+  uint8_t saveCreds;
+  uint8_t btDiscovery;
+  uint8_t wifiToggle;
+  uint8_t btToggle;
+  uint8_t usbRndVid;
+  uint8_t usbRndPid;
+  char usbVid[8];
+  char usbPid[8];
+  char usbMfr[33];
+  char usbProd[33];
+  char btName[33];
+};
+
+// v1 kept the boot script list inline, capped at 255 characters
+struct PersistedSettingsV1 {
+  uint16_t version;
+  uint16_t size;
+  char apSsid[33];
+  char apPassword[65];
+  char language[24];
+  char bootScripts[256];
+  int32_t wifiScanTime;
+  uint8_t ledEnabled;
+  uint8_t loggingEnabled;
+  uint8_t autoConnect;
+  uint8_t saveCreds;
+  uint8_t btDiscovery;
+  uint8_t wifiToggle;
+  uint8_t btToggle;
+  uint8_t usbRndVid;
+  uint8_t usbRndPid;
+  char usbVid[8];
+  char usbPid[8];
+  char usbMfr[33];
+  char usbProd[33];
+  char btName[33];
+};
+
+static PersistedSettings settings;
+static String savedBootScripts;
+static uint32_t dirtySettings = 0;
+static unsigned long settingsDirtySince = 0;
+
+static const char* legacySettingKeys[] = {
+  "ap_ssid", "ap_password", "language", "wifi_scan_time", "led_enabled", "logging_enabled",
+  "autoconnect", "save_creds", "bt_discovery", "usb_vid", "usb_pid",
+  "usb_rndVid", "usb_rndPid", "usb_mfr", "usb_prod", "bt_name", "wifi_toggle", "bt_toggle"
+};
+
+static void copyField(char* dest, size_t size, const String& value) {
+  strncpy(dest, value.c_str(), size - 1);
+  dest[size - 1] = '\0';
+}
+
+static String joinBootScripts() {
+  String bootFiles = "";
+  for (size_t i = 0; i < currentBootScriptFiles.size(); i++) {
+    if (i > 0) bootFiles += ",";
+    bootFiles += currentBootScriptFiles[i];
+  }
+  return bootFiles;
+}
+
+// One-time import of the per-key layout used before the settings blob existed;
+// with the keys gone this yields the defaults
+static void migrateLegacySettings() {
+  copyField(settings.apSsid, sizeof(settings.apSsid), preferences.getString("ap_ssid", DEFAULT_AP_SSID));
+  copyField(settings.apPassword, sizeof(settings.apPassword), preferences.getString("ap_password", DEFAULT_AP_PASSWORD));
+  copyField(settings.language, sizeof(settings.language), preferences.getString("language", "us"));
+  settings.wifiScanTime = preferences.getInt("wifi_scan_time", WIFI_SCAN_TIMEOUT);
+  settings.ledEnabled = preferences.getBool("led_enabled", true);
+  settings.loggingEnabled = preferences.getBool("logging_enabled", false);
+  settings.autoConnect = preferences.getBool("autoconnect", false);
+  settings.saveCreds = preferences.getBool("save_creds", false);
+  settings.btDiscovery = preferences.getBool("bt_discovery", false);
+  settings.wifiToggle = preferences.getBool("wifi_toggle", true);
+  settings.btToggle = preferences.getBool("bt_toggle", false);
+  copyField(settings.usbVid, sizeof(settings.usbVid), preferences.getString("usb_vid", "0x303a"));
+  copyField(settings.usbPid, sizeof(settings.usbPid), preferences.getString("usb_pid", "0x0002"));
+  settings.usbRndVid = preferences.getBool("usb_rndVid", false);
+  settings.usbRndPid = preferences.getBool("usb_rndPid", false);
+  copyField(settings.usbMfr, sizeof(settings.usbMfr), preferences.getString("usb_mfr", "Espressif"));
+  copyField(settings.usbProd, sizeof(settings.usbProd), preferences.getString("usb_prod", "ESP32-S3"));
+  copyField(settings.btName, sizeof(settings.btName), preferences.getString("bt_name", "ESP32-S3"));
+}
+
+static void upgradeFromV1(const PersistedSettingsV1& v1) {
+  memcpy(settings.apSsid, v1.apSsid, sizeof(settings.apSsid));
+  memcpy(settings.apPassword, v1.apPassword, sizeof(settings.apPassword));
+  memcpy(settings.language, v1.language, sizeof(settings.language));
+  settings.wifiScanTime = v1.wifiScanTime;
+  settings.ledEnabled = v1.ledEnabled;
+  settings.loggingEnabled = v1.loggingEnabled;
+  settings.autoConnect = v1.autoConnect;
+  settings.saveCreds = v1.saveCreds;
+  settings.btDiscovery = v1.btDiscovery;
+  settings.wifiToggle = v1.wifiToggle;
+  settings.btToggle = v1.btToggle;
+  settings.usbRndVid = v1.usbRndVid;
+  settings.usbRndPid = v1.usbRndPid;
+  memcpy(settings.usbVid, v1.usbVid, sizeof(settings.usbVid));
+  memcpy(settings.usbPid, v1.usbPid, sizeof(settings.usbPid));
+  memcpy(settings.usbMfr, v1.usbMfr, sizeof(settings.usbMfr));
+  memcpy(settings.usbProd, v1.usbProd, sizeof(settings.usbProd));
+  memcpy(settings.btName, v1.btName, sizeof(settings.btName));
+  char bootScripts[sizeof(v1.bootScripts)];
+  memcpy(bootScripts, v1.bootScripts, sizeof(bootScripts));
+  bootScripts[sizeof(bootScripts) - 1] = '\0';
+  if (bootScripts[0] && !preferences.isKey(BOOT_SCRIPTS_KEY)) preferences.putString(BOOT_SCRIPTS_KEY, bootScripts);
+}
+
+// Reads the blob by its header: the current version (possibly shorter, from before
+// fields were appended) loads over the defaults, older versions are upgraded.
+// Returns false when the blob is missing or unreadable.
+static bool readSettingsBlob() {
+  size_t length = preferences.getBytesLength(SETTINGS_BLOB_KEY);
+  if (length < sizeof(PersistedSettingsHeader)) return false;
+  std::vector<uint8_t> blob(length);
+  if (preferences.getBytes(SETTINGS_BLOB_KEY, blob.data(), length) != length) return false;
+  PersistedSettingsHeader header;
+  memcpy(&header, blob.data(), sizeof(header));
+  if (header.size != length) return false;
+
+  if (header.version == SETTINGS_VERSION && header.size <= sizeof(settings)) {
+    memcpy(&settings, blob.data(), header.size);
+  } else if (header.version == 1 && header.size == sizeof(PersistedSettingsV1)) {
+    PersistedSettingsV1 v1;
+    memcpy(&v1, blob.data(), sizeof(v1));
+    upgradeFromV1(v1);
+    Serial.println("[Settings] Upgraded settings blob v1 -> v" + String(SETTINGS_VERSION));
+  } else {
+    return false;
+  }
+  settings.apSsid[sizeof(settings.apSsid) - 1] = '\0';
+  settings.apPassword[sizeof(settings.apPassword) - 1] = '\0';
+  settings.language[sizeof(settings.language) - 1] = '\0';
+  settings.usbVid[sizeof(settings.usbVid) - 1] = '\0';
+  settings.usbPid[sizeof(settings.usbPid) - 1] = '\0';
+  settings.usbMfr[sizeof(settings.usbMfr) - 1] = '\0';
+  settings.usbProd[sizeof(settings.usbProd) - 1] = '\0';
+  settings.btName[sizeof(settings.btName) - 1] = '\0';
+  return true;
+}
+
+static bool writeSettingsBlob() {
+  settings.version = SETTINGS_VERSION;
+  settings.size = sizeof(settings);
+  return preferences.putBytes(SETTINGS_BLOB_KEY, &settings, sizeof(settings)) == sizeof(settings);
+}
+
+void loadSettings() {
+  bool hadBlob = preferences.isKey(SETTINGS_BLOB_KEY);
+  memset(&settings, 0, sizeof(settings));
+  migrateLegacySettings();  // Defaults, or the legacy keys if they are still there
+
+  if (!hadBlob) {
+    Serial.println("[Settings] No settings blob, migrating legacy keys");
+    if (writeSettingsBlob()) {
+      for (const char* key : legacySettingKeys) {
+        if (preferences.isKey(key)) preferences.remove(key);
+      }
+    }
+  } else if (!readSettingsBlob()) {
+    // Left in place, so firmware that understands it can still read it
+    memset(&settings, 0, sizeof(settings));
+    migrateLegacySettings();
+    Serial.println("[Settings] Settings blob unreadable or from newer firmware, using defaults");
+    lastError = "Settings blob unreadable, using defaults";
+    errorCount++;
+  } else if (settings.version != SETTINGS_VERSION || settings.size != sizeof(settings)) {
+    writeSettingsBlob();
+  }
+  savedBootScripts = preferences.getString(BOOT_SCRIPTS_KEY, "");
+
+  ap_ssid = settings.apSsid;
+  ap_password = settings.apPassword;
+  currentLanguage = settings.language;
+  wifiScanTime = settings.wifiScanTime;
+  ledEnabled = settings.ledEnabled;
+  loggingEnabled = settings.loggingEnabled;
+  autoConnectEnabled = settings.autoConnect;
+  saveOnConnectEnabled = settings.saveCreds;
+  btDiscoveryEnabled = settings.btDiscovery;
+  wifiToggleEnabled = settings.wifiToggle;
+  bluetoothToggleEnabled = settings.btToggle;
+  currentUSBConfig.vid = settings.usbVid;
+  currentUSBConfig.pid = settings.usbPid;
+  currentUSBConfig.rndVid = settings.usbRndVid;
+  currentUSBConfig.rndPid = settings.usbRndPid;
+  currentUSBConfig.mfr = settings.usbMfr;
+  currentUSBConfig.prod = settings.usbProd;
+  bluetoothName = settings.btName;
+  dirtySettings = 0;
+}
+
+String getSavedBootScripts() {
+  return savedBootScripts;
+}
+
+void markSettingDirty(uint32_t fields) {
+  dirtySettings |= fields;
+  settingsDirtySince = millis();
+}
+
+// Called from loop(): writes the blob once changes have settled
+void processSettings() {
+  if (dirtySettings == 0) return;
+  if (millis() - settingsDirtySince < SETTINGS_COMMIT_DELAY) return;
+  commitSettings();
+}
+
+bool commitSettings() {
+  if (dirtySettings == 0) return true;
+
+  if (dirtySettings & SETTING_AP) {
+    copyField(settings.apSsid, sizeof(settings.apSsid), ap_ssid);
+    copyField(settings.apPassword, sizeof(settings.apPassword), ap_password);
+  }
+  if (dirtySettings & SETTING_LANGUAGE) copyField(settings.language, sizeof(settings.language), currentLanguage);
+  if (dirtySettings & SETTING_BOOT_SCRIPT) {
+    // Any length, as the per-key layout allowed; an empty list removes the key
+    String bootFiles = joinBootScripts();
+    bool ok = bootFiles.length() == 0 ? (!preferences.isKey(BOOT_SCRIPTS_KEY) || preferences.remove(BOOT_SCRIPTS_KEY))
+                                      : preferences.putString(BOOT_SCRIPTS_KEY, bootFiles) == bootFiles.length();
+    if (!ok) {
+      Serial.println("[Settings] Failed to write boot script list");
+      lastError = "Failed to save boot scripts";
+      errorCount++;
+      return false;
+    }
+    savedBootScripts = bootFiles;
+  }
+  if (dirtySettings & SETTING_SCAN_TIME) settings.wifiScanTime = wifiScanTime;
+  if (dirtySettings & SETTING_LED) settings.ledEnabled = ledEnabled;
+  if (dirtySettings & SETTING_LOGGING) settings.loggingEnabled = loggingEnabled;
+  if (dirtySettings & SETTING_AUTOCONNECT) settings.autoConnect = autoConnectEnabled;
+  if (dirtySettings & SETTING_SAVE_CREDS) settings.saveCreds = saveOnConnectEnabled;
+  if (dirtySettings & SETTING_BT_DISCOVERY) settings.btDiscovery = btDiscoveryEnabled;
+  if (dirtySettings & SETTING_USB) {
+    copyField(settings.usbVid, sizeof(settings.usbVid), currentUSBConfig.vid);
+    copyField(settings.usbPid, sizeof(settings.usbPid), currentUSBConfig.pid);
+    settings.usbRndVid = currentUSBConfig.rndVid;
+    settings.usbRndPid = currentUSBConfig.rndPid;
+    copyField(settings.usbMfr, sizeof(settings.usbMfr), currentUSBConfig.mfr);
+    copyField(settings.usbProd, sizeof(settings.usbProd), currentUSBConfig.prod);
+  }
+  if (dirtySettings & SETTING_BT_NAME) copyField(settings.btName, sizeof(settings.btName), bluetoothName);
+  if (dirtySettings & SETTING_WIFI_TOGGLE) settings.wifiToggle = wifiToggleEnabled;
+  if (dirtySettings & SETTING_BT_TOGGLE) settings.btToggle = bluetoothToggleEnabled;
+
+  if (!writeSettingsBlob()) {
+    Serial.println("[Settings] Failed to write settings blob");
+    lastError = "Failed to save settings";
+    errorCount++;
+    return false;
+  }
+
+  Serial.println("[Settings] Saved (dirty mask 0x" + String(dirtySettings, HEX) + ")");
+  dirtySettings = 0;
+  return true;
+}
@@ -0,0 +1,31 @@
+#ifndef SETTINGS_MANAGER_H
+#define SETTINGS_MANAGER_H
+
+#include "GlobalState.h"
+
+// Dirty bits, one per persisted field group
+#define SETTING_AP            (1UL << 0)   // ap_ssid, ap_password
+#define SETTING_LANGUAGE      (1UL << 1)
+#define SETTING_BOOT_SCRIPT   (1UL << 2)
+#define SETTING_SCAN_TIME     (1UL << 3)
+#define SETTING_LED           (1UL << 4)
+#define SETTING_LOGGING       (1UL << 5)
+#define SETTING_AUTOCONNECT   (1UL << 6)
+#define SETTING_SAVE_CREDS    (1UL << 7)
+#define SETTING_BT_DISCOVERY  (1UL << 8)
+#define SETTING_USB           (1UL << 9)   // vid, pid, random flags, manufacturer, product
+#define SETTING_BT_NAME       (1UL << 10)
+#define SETTING_WIFI_TOGGLE   (1UL << 11)
+#define SETTING_BT_TOGGLE     (1UL << 12)
+#define SETTING_ALL           0x1FFFUL
+
+// All settings live in one versioned NVS blob (the boot script list, which has no
+// length cap, keeps its own key); changes are coalesced and written
+// once SETTINGS_COMMIT_DELAY ms after the last markSettingDirty() call.
+void loadSettings();
+void markSettingDirty(uint32_t fields);
+void processSettings();
+bool commitSettings();
+String getSavedBootScripts();
+
+#endif // SETTINGS_MANAGER_H
@@ -0,0 +1,125 @@
+#include "TaskScheduler.h"
+#include "ClockManager.h"
+#include <algorithm>
+
+struct TimedEntry {
+  time_t deadline;
+  int taskId;
+};
+
+static std::map<int, BackgroundTask> timedTasks;  // Scheduled and pending, by id
+static std::vector<TimedEntry> timerHeap;          // Min-heap on deadline
+static std::vector<int> pendingTimedTasks;         // Waiting for a valid clock
+static unsigned long lastClockCheck = 0;
+
+static const char* const DAY_NAMES[] = {
+  "Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday"
+};
+
+static bool laterDeadline(const TimedEntry& a, const TimedEntry& b) {
+  return a.deadline > b.deadline;
+}
+
+// "HH", "HH:MM" or "HH:MM:SS". The trigger window is the whole hour/minute/second
+// the payload names, so a task created inside its window fires immediately, as
+// the old prefix match did.
+static time_t nextTimeDeadline(const String& payload, time_t now) {
+  int parts[3] = {0, 0, 0};
+  int count = 0;
+  int start = 0;
+  while (count < 3) {
+    int sep = payload.indexOf(':', start);
+    String part = (sep == -1) ? payload.substring(start) : payload.substring(start, sep);
+    part.trim();
+    if (part.length() == 0) return -1;
+    for (size_t i = 0; i < part.length(); i++) {
+      if (!isDigit(part[i])) return -1;
+    }
+    parts[count++] = part.toInt();
+    if (sep == -1) break;
+    start = sep + 1;
+  }
+  if (parts[0] > 23 || parts[1] > 59 || parts[2] > 59) return -1;
+
+  struct tm t;
+  clockLocalTime("us", now, &t);
+  time_t midnight = now - (t.tm_hour * 3600 + t.tm_min * 60 + t.tm_sec);
+  time_t windowStart = midnight + parts[0] * 3600 + parts[1] * 60 + parts[2];
+  long window = (count == 1) ? 3600 : (count == 2) ? 60 : 1;
+
+  if (now >= windowStart + window) windowStart += 86400;
+  return (now >= windowStart) ? now : windowStart;
+}
+
+static time_t nextDayDeadline(const String& payload, time_t now) {
+  int target = -1;
+  for (int i = 0; i < 7; i++) {
+    if (payload.equalsIgnoreCase(DAY_NAMES[i])) target = i;
+  }
+  if (target == -1) return -1;
+
+  struct tm t;
+  clockLocalTime("us", now, &t);
+  int daysAhead = (target - t.tm_wday + 7) % 7;
+  if (daysAhead == 0) return now;
+  time_t midnight = now - (t.tm_hour * 3600 + t.tm_min * 60 + t.tm_sec);
+  return midnight + (time_t)daysAhead * 86400;
+}
+
+static bool pushDeadline(const BackgroundTask& task, time_t now) {
+  time_t deadline = (task.type == "TIME_TRIGGER") ? nextTimeDeadline(task.payload, now)
+                                                  : nextDayDeadline(task.payload, now);
+  if (deadline < 0) {
+    Serial.println("[Task] Invalid " + task.type + " payload: " + task.payload);
+    return false;
+  }
+  timerHeap.push_back({deadline, task.id});
+  std::push_heap(timerHeap.begin(), timerHeap.end(), laterDeadline);
+  return true;
+}
+
+bool scheduleTimedTask(const BackgroundTask& task) {
+  if (!isClockSynced()) {
+    pendingTimedTasks.push_back(task.id);
+  } else if (!pushDeadline(task, clockNow())) {
+    return false;
+  }
+  timedTasks[task.id] = task;
+  return true;
+}
+
+bool cancelTimedTask(int taskId) {
+  return timedTasks.erase(taskId) > 0;
+}
+
+const std::map<int, BackgroundTask>& getTimedTasks() {
+  return timedTasks;
+}
+
+void processTimedTasks(TimedTaskCallback onDue) {
+  if (!pendingTimedTasks.empty() && millis() - lastClockCheck >= TIMER_CLOCK_RETRY_MS) {
+    lastClockCheck = millis();
+    if (isClockSynced()) {
+      time_t now = clockNow();
+      for (int taskId : pendingTimedTasks) {
+        auto it = timedTasks.find(taskId);
+        if (it != timedTasks.end() && !pushDeadline(it->second, now)) timedTasks.erase(it);
+      }
+      pendingTimedTasks.clear();
+    }
+  }
+
+  if (timerHeap.empty()) return;
+  time_t now = clockNow();
+  // Deadlines are absolute, so a stalled loop fires late rather than never.
+  while (!timerHeap.empty() && timerHeap.front().deadline <= now) {
+    int taskId = timerHeap.front().taskId;
+    std::pop_heap(timerHeap.begin(), timerHeap.end(), laterDeadline);
+    timerHeap.pop_back();
+    auto it = timedTasks.find(taskId);
+    if (it == timedTasks.end()) continue;  // Cancelled
+    BackgroundTask task = it->second;
+    timedTasks.erase(it);
+    onDue(task);
+  }
+}
@@ -0,0 +1,19 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include "GlobalState.h"
+#include <map>
+
+// Min-heap of absolute deadlines for TIME_TRIGGER / DAY_TRIGGER tasks. Timed tasks
+// live here, not in activeTasks, so the loop only compares the earliest deadline
+// against the clock; due tasks are removed and handed to the callback. Cancelled
+// tasks leave their heap entry behind and are skipped when it comes due.
+// Deadlines are computed in the default ("us") region, as getTime("us") was.
+typedef void (*TimedTaskCallback)(const BackgroundTask& task);
+
+bool scheduleTimedTask(const BackgroundTask& task);
+bool cancelTimedTask(int taskId);
+const std::map<int, BackgroundTask>& getTimedTasks();  // By id, for /api/tasks
+void processTimedTasks(TimedTaskCallback onDue);
+
+#endif // TASK_SCHEDULER_H
@@ -1,6 +1,13 @@
 #include "USBManager.h"
 #include "DuckyInterpreter.h"
 
+static std::vector<HidStroke>* hidRecording = nullptr;
+
+static const uint8_t MODIFIER_KEYS[8] = {
+  KEY_LEFT_CTRL, KEY_LEFT_SHIFT, KEY_LEFT_ALT, KEY_LEFT_GUI,
+  KEY_RIGHT_CTRL, KEY_RIGHT_SHIFT, KEY_RIGHT_ALT, KEY_RIGHT_GUI
+};
+
 KeyCode parseKeyCode(String keyCodeStr) {
   KeyCode result = {0, 0};
 
@@ -24,6 +31,8 @@ void fastPressKey(String key) {
   if (currentKeymap.find(key) != currentKeymap.end()) {
     KeyCode kc = parseKeyCode(currentKeymap[key]);
 
+    if (hidRecording) hidRecording->push_back({kc.modifier, kc.key, 5, (uint8_t)(kc.key == 0 && kc.modifier > 0), 0});
+
     if (kc.key == 0 && kc.modifier > 0) {
       if (kc.modifier & 0x01) { keyboard.press(KEY_LEFT_CTRL); delay(5); keyboard.release(KEY_LEFT_CTRL); }
       if (kc.modifier & 0x02) { keyboard.press(KEY_LEFT_SHIFT); delay(5); keyboard.release(KEY_LEFT_SHIFT); }
@@ -79,6 +88,8 @@ void fastPressKeyCombination(std::vector<String> keys) {
     }
   }
 
+  if (hidRecording) hidRecording->push_back({combinedModifier, mainKey, 5, 0, 0});
+
   if (combinedModifier > 0) {
     if (combinedModifier & 0x01) keyboard.press(KEY_LEFT_CTRL);
     if (combinedModifier & 0x02) keyboard.press(KEY_LEFT_SHIFT);
@@ -111,6 +122,8 @@ void fastTypeString(String text) {
     if (currentKeymap.find(ch) != currentKeymap.end()) {
       KeyCode kc = parseKeyCode(currentKeymap[ch]);
 
+      if (hidRecording) hidRecording->push_back({kc.modifier, kc.key, 2, 0, (uint16_t)(delayBetweenKeys > 0 ? delayBetweenKeys : 2)});
+
       if (kc.modifier > 0) {
         if (kc.modifier & 0x01) keyboard.press(KEY_LEFT_CTRL);
         if (kc.modifier & 0x02) keyboard.press(KEY_LEFT_SHIFT);
@@ -142,6 +155,38 @@ void fastTypeString(String text) {
   }
 }
 
+void beginHidRecording(std::vector<HidStroke>* out) {
+  hidRecording = out;
+}
+
+void endHidRecording() {
+  hidRecording = nullptr;
+}
+
+void replayHidStrokes(const std::vector<HidStroke>& strokes) {
+  for (const HidStroke& st : strokes) {
+    if (stopRequested) return;
+
+    if (st.tap) {
+      for (int b = 0; b < 8; b++) {
+        if (st.modifier & (1 << b)) { keyboard.press(MODIFIER_KEYS[b]); delay(st.holdMs); keyboard.release(MODIFIER_KEYS[b]); }
+      }
+      continue;
+    }
+
+    for (int b = 0; b < 8; b++) {
+      if (st.modifier & (1 << b)) keyboard.press(MODIFIER_KEYS[b]);
+    }
+    if (st.key > 0) {
+      keyboard.pressRaw(st.key);
+    }
+
+    delay(st.holdMs);
+    keyboard.releaseAll();
+    if (st.gapMs > 0) delay(st.gapMs);
+  }
+}
+
 void handleKeyInput(String line) {
   std::vector<String> keys;
   int startIdx = 0;
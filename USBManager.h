@@ -11,4 +11,20 @@ void handleKeyInput(String line);
 void pressKeyOnly(String key);
 void releaseAllKeys();
 
+// One HID report as sent by the fast* helpers: modifiers + key held for holdMs,
+// then releaseAll and gapMs. tap marks a bare modifier press (each bit tapped).
+struct HidStroke {
+  uint8_t modifier;
+  uint8_t key;
+  uint8_t holdMs;
+  uint8_t tap;
+  uint16_t gapMs;
+};
+
+// While recording, the fast* helpers append every report they send to out.
+void beginHidRecording(std::vector<HidStroke>* out);
+void endHidRecording();
+// Resends recorded strokes with their original timings, no keymap lookups.
+void replayHidStrokes(const std::vector<HidStroke>& strokes);
+
 #endif // USB_MANAGER_H
@@ -4,67 +4,63 @@
 #include "WiFiManager.h"
 #include "LogManager.h"
 #include "LEDManager.h"
+#include "FileJobManager.h"
+#include "ScriptCache.h"
+#include "ScriptJobManager.h"
+#include "ScriptSearch.h"
 #include <ArduinoJson.h>
 
 void handleFileUpload() {
   HTTPUpload& upload = server.upload();
+  static unsigned long uploadStartedAt = 0;
   
   if (upload.status == UPLOAD_FILE_START) {
     uploadFilename = upload.filename;
+    uploadStartedAt = millis();
+    lastUpload.error = "";
     Serial.println("File upload start: " + uploadFilename);
     
-    String uploadPath;
-    if (uploadFilename.endsWith(".txt")) {
-      uploadPath = String(DIR_SCRIPTS) + "/" + uploadFilename;
-    } else if (uploadFilename.endsWith(".json")) {
-      uploadPath = String(DIR_LANGUAGES) + "/" + uploadFilename;
-    } else {
-      uploadPath = String(DIR_UPLOADS) + "/" + uploadFilename;
-    }
-    
-    if (uploadFile) {
-      uploadFile.close();
-    }
-    
-    if (SD.exists(uploadPath)) {
-      SD.remove(uploadPath);
-    }
+    String uploadPath = uploadPathFor(uploadFilename);
     
-    uploadFile = SD.open(uploadPath, FILE_WRITE);
-    if (!uploadFile) {
+    // Staged to <path>.part; the existing file is only replaced on UPLOAD_FILE_END
+    if (!stagedWriteBegin(uploadPath)) {
       Serial.println("Failed to create file: " + uploadPath);
+      lastUpload.error = "Failed to create file: " + uploadPath;
       return;
     }
     
   } else if (upload.status == UPLOAD_FILE_WRITE) {
-    if (uploadFile) {
-      size_t bytesWritten = uploadFile.write(upload.buf, upload.currentSize);
-      if (bytesWritten != upload.currentSize) {
-        Serial.println("File write error: " + String(bytesWritten) + " vs " + String(upload.currentSize));
+    if (stagedWriteActive()) {
+      if (!stagedWrite(upload.buf, upload.currentSize)) {
+        Serial.println("File write error at " + String(upload.totalSize) + " bytes");
       }
     }
     
   } else if (upload.status == UPLOAD_FILE_END) {
-    if (uploadFile) {
-      uploadFile.flush();
-      uploadFile.close();
-      Serial.println("File upload complete: " + uploadFilename + " size: " + String(upload.totalSize));
+    if (stagedWriteActive()) {
+      bool committed = stagedWriteCommit();
+      if (!committed) lastUpload.error = lastError;
+      unsigned long elapsed = millis() - uploadStartedAt;
+      lastUpload.bytes = upload.totalSize;
+      lastUpload.durationMs = elapsed;
+      lastUpload.kbps = elapsed > 0 ? (upload.totalSize / 1024.0f) / (elapsed / 1000.0f) : 0.0f;
+      Serial.println("File upload " + String(committed ? "complete: " : "failed: ") + uploadFilename +
+                     " size: " + String(upload.totalSize) + " (" + String(lastUpload.kbps, 1) + " KB/s)");
       
-      if (uploadFilename.endsWith(".txt")) {
+      if (committed && uploadFilename.endsWith(".txt")) {
+        queueSearchIndexUpdate(uploadFilename);
         loadAvailableScripts();
-      } else if (uploadFilename.endsWith(".json")) {
+      } else if (committed && uploadFilename.endsWith(".json")) {
         loadAvailableLanguages();
+      } else if (committed && uploadFilename.endsWith(SCRIPT_LIBRARY_SUFFIX)) {
+        clearScriptCache();
+        loadAvailableScripts();
       }
     }
   } else if (upload.status == UPLOAD_FILE_ABORTED) {
     Serial.println("File upload aborted: " + uploadFilename);
-    if (uploadFile) {
-      uploadFile.close();
-      String uploadPath = String(DIR_UPLOADS) + "/" + uploadFilename;
-      if (SD.exists(uploadPath)) {
-        SD.remove(uploadPath);
-      }
-    }
+    lastUpload.error = "Upload aborted";
+    stagedWriteAbort();
   }
 }
 
@@ -125,12 +121,25 @@ void handleUseFile() {
   }
 }
 
+// Responds 202 with the job id, or 503 when the job table is full
+static void sendJobQueued(int jobId, String message) {
+  if (jobId < 0) {
+    server.send(503, "application/json", "{\"success\":false,\"message\":\"File job queue full\"}");
+    return;
+  }
+  server.send(202, "application/json", "{\"success\":true,\"jobId\":" + String(jobId) + ",\"message\":\"" + message + "\"}");
+}
+
 void handleCopyFile() {
   if (server.hasArg("source")) {
     String sourcePath = server.arg("source");
     String destPath = server.hasArg("destination") ? server.arg("destination") : "";
-    copyFile(sourcePath, destPath);
-    server.send(200, "application/json", "{\"success\":true,\"message\":\"File copied: " + sourcePath + "\"}");
+    if (destPath == "") {
+      copyFile(sourcePath, destPath);
+      server.send(200, "application/json", "{\"success\":true,\"message\":\"File copied: " + sourcePath + "\"}");
+    } else {
+      sendJobQueued(queueFileJob("COPY", sourcePath, destPath), "Copy queued: " + sourcePath);
+    }
   } else {
     server.send(400, "text/plain", "No source file specified");
   }
@@ -140,8 +149,12 @@ void handleCutFile() {
   if (server.hasArg("source")) {
     String sourcePath = server.arg("source");
     String destPath = server.hasArg("destination") ? server.arg("destination") : "";
-    cutFile(sourcePath, destPath);
-    server.send(200, "application/json", "{\"success\":true,\"message\":\"File cut: " + sourcePath + "\"}");
+    if (destPath == "") {
+      cutFile(sourcePath, destPath);
+      server.send(200, "application/json", "{\"success\":true,\"message\":\"File cut: " + sourcePath + "\"}");
+    } else {
+      sendJobQueued(queueFileJob("MOVE", sourcePath, destPath), "Move queued: " + sourcePath);
+    }
   } else {
     server.send(400, "text/plain", "No source file specified");
   }
@@ -149,8 +162,70 @@ void handleCutFile() {
 
 void handlePasteFile() {
   String destPath = server.hasArg("destination") ? server.arg("destination") : "";
-  pasteFile(destPath);
-  server.send(200, "application/json", "{\"success\":true,\"message\":\"File pasted\"}");
+  if (destPath != "" && !destPath.startsWith("/")) destPath = currentDirectory + destPath;
+  if (destPath == "") destPath = currentDirectory;
+
+  if (fileCopied && copiedFilePath != "") {
+    sendJobQueued(queueFileJob("COPY", copiedFilePath, destPath), "Paste queued");
+  } else if (fileCut && cutFilePath != "") {
+    int jobId = queueFileJob("MOVE", cutFilePath, destPath);
+    if (jobId >= 0) {
+      cutFilePath = "";
+      fileCut = false;
+    }
+    sendJobQueued(jobId, "Paste queued");
+  } else {
+    server.send(400, "application/json", "{\"success\":false,\"message\":\"No file to paste\"}");
+  }
+}
+
+void handleFileJobs() {
+  server.sendHeader("Cache-Control", "no-cache, no-store, must-revalidate, max-age=0");
+  server.send(200, "application/json", getFileJobsJson());
+}
+
+void handleCancelFileJob() {
+  String body = server.arg("plain");
+  DynamicJsonDocument doc(128);
+  if (!deserializeJson(doc, body) && doc.containsKey("id") && cancelFileJob(doc["id"].as<int>())) {
+    server.send(200, "text/plain", "Job cancelled");
+  } else {
+    server.send(404, "text/plain", "Job not found or already finished");
+  }
+}
+
+void handleScriptJobs() {
+  server.sendHeader("Cache-Control", "no-cache, no-store, must-revalidate, max-age=0");
+  server.send(200, "application/json", getScriptJobsJson());
+}
+
+// Requests are handled between jobs, so a running job is not cancellable: 409
+void handleCancelScriptJob() {
+  String body = server.arg("plain");
+  DynamicJsonDocument doc(128);
+  if (deserializeJson(doc, body) || !doc.containsKey("id")) {
+    server.send(400, "text/plain", "Missing job id");
+    return;
+  }
+  int id = doc["id"].as<int>();
+  if (cancelScriptJob(id)) {
+    server.send(200, "text/plain", "Job cancelled");
+  } else if (getScriptJobState(id) == "running") {
+    server.send(409, "text/plain", "Job is running and cannot be cancelled");
+  } else {
+    server.send(404, "text/plain", "Job not found or already finished");
+  }
+}
+
+void handleMoveScriptJob() {
+  String body = server.arg("plain");
+  DynamicJsonDocument doc(128);
+  if (!deserializeJson(doc, body) && doc.containsKey("id") && doc.containsKey("position") &&
+      moveScriptJob(doc["id"].as<int>(), doc["position"].as<int>())) {
+    server.send(200, "text/plain", "Job moved");
+  } else {
+    server.send(404, "text/plain", "Job not found or not queued");
+  }
 }
 
 void handleJoinInternet() {
@@ -255,11 +330,14 @@ void handleDeleteFile() {
       File file = SD.open(filepath);
       if (file) {
         if (file.isDirectory()) {
+          // Recursive deletes can take seconds; hand them to the job worker
           file.close();
-          success = deleteDirectory(filepath);
+          sendJobQueued(queueFileJob("DELETE", filepath, ""), "Delete queued: " + filename);
+          return;
         } else {
           file.close();
           success = SD.remove(filepath);
+          if (success) invalidateScriptCache(filepath);
         }
       }
 
@@ -268,6 +346,7 @@ void handleDeleteFile() {
         Serial.println("Deleted: " + filename);
 
         if (filename.endsWith(".txt")) {
+          queueSearchIndexUpdate(filepath);
           loadAvailableScripts();
         } else if (filename.endsWith(".json")) {
           loadAvailableLanguages();
@@ -13,6 +13,11 @@ void handleUseFile();
 void handleCopyFile();
 void handleCutFile();
 void handlePasteFile();
+void handleFileJobs();
+void handleCancelFileJob();
+void handleScriptJobs();
+void handleCancelScriptJob();
+void handleMoveScriptJob();
 void handleJoinInternet();
 void handleLeaveInternet();
 void handleListFiles();
@@ -6,6 +6,20 @@
 #include "LEDManager.h"
 #include "WiFiManager.h"
 #include "BTManager.h"
+#include "SettingsManager.h"
+#include "ScriptCache.h"
+#include "ClockManager.h"
+#include "TaskScheduler.h"
+#include "ScriptJobManager.h"
+#include "ExecutionCursor.h"
+#include "ScriptSimulator.h"
+#include "ScriptAnalyzer.h"
+#include "ScriptArena.h"
+#include "ScriptModules.h"
+#include "RowerPipeline.h"
+#include "BundleDeploy.h"
+#include "ScriptLibrary.h"
+#include "ScriptSearch.h"
 #include <ArduinoJson.h>
 
 void setupWebServer() {
@@ -19,9 +33,36 @@ void setupWebServer() {
   server.on("/api/copy-file", HTTP_POST, handleCopyFile);
   server.on("/api/cut-file", HTTP_POST, handleCutFile);
   server.on("/api/paste-file", HTTP_POST, handlePasteFile);
+  server.on("/api/file-jobs", handleFileJobs);
+  server.on("/api/cancel-file-job", HTTP_POST, handleCancelFileJob);
+  server.on("/api/script-jobs", handleScriptJobs);
+  server.on("/api/cancel-script-job", HTTP_POST, handleCancelScriptJob);
+  server.on("/api/move-script-job", HTTP_POST, handleMoveScriptJob);
+  server.on("/api/cursor", []() {
+    server.send(200, "application/json", getExecutionCursorJson());
+  });
+  server.on("/api/resume", HTTP_POST, []() {
+    if (!hasExecutionCursor()) {
+      server.send(404, "application/json", "{\"success\":false,\"message\":\"No saved execution cursor\"}");
+      return;
+    }
+    int jobId = queueResumeJob("cursor");
+    if (jobId < 0) {
+      server.send(503, "application/json", "{\"success\":false,\"message\":\"Script queue full\"}");
+      return;
+    }
+    server.send(202, "application/json", "{\"success\":true,\"jobId\":" + String(jobId) + "}");
+  });
   server.on("/api/upload", HTTP_POST, []() {
-    server.send(200, "text/plain", "Upload complete: " + uploadFilename);
+    if (lastUpload.error.length() > 0) {
+      server.send(500, "text/plain", "Upload failed: " + uploadFilename + " - " + lastUpload.error);
+      return;
+    }
+    server.send(200, "text/plain", "Upload complete: " + uploadFilename + " (" + String(lastUpload.kbps, 1) + " KB/s)");
   }, handleFileUpload);
+  server.on("/api/deploy", HTTP_POST, []() {
+    server.send(bundleDeploySucceeded() ? 200 : 500, "application/json", getBundleDeployJson());
+  }, handleBundleUpload);
   server.on("/api/download", handleFileDownload);
   server.on("/api/list-files", handleListFiles);
   server.on("/api/delete-file", HTTP_DELETE, handleDeleteFile);
@@ -74,8 +115,12 @@ void setupWebServer() {
 
   server.on("/execute", HTTP_POST, []() {
     String script = server.arg("plain");
-    executeScript(script);
-    server.send(200, "text/plain; charset=utf-8", "OK");
+    int jobId = queueScriptJob("web", "inline (" + String(script.length()) + " bytes)", script, SCRIPT_PRIORITY_NORMAL);
+    if (jobId < 0) {
+      server.send(503, "application/json", "{\"success\":false,\"message\":\"Script queue full\"}");
+      return;
+    }
+    server.send(202, "application/json", "{\"success\":true,\"jobId\":" + String(jobId) + "}");
   });
 
   server.on("/stop", HTTP_POST, []() {
@@ -87,8 +132,8 @@ void setupWebServer() {
     if (server.hasArg("lang")) {
       String lang = server.arg("lang");
       if (loadLanguage(lang)) {
-        // Persist immediately so it survives reboots
-        preferences.putString("language", currentLanguage);
+        // Persisted with the next coalesced settings commit
+        markSettingDirty(SETTING_LANGUAGE);
         server.send(200, "text/plain; charset=utf-8", "OK");
       } else {
         server.send(400, "text/plain; charset=utf-8", "Language not found");
@@ -99,6 +144,7 @@ void setupWebServer() {
   });
 
   server.on("/status", []() {
+    ensureAvailableScripts();
     String status = "Ready - Language: " + currentLanguage;
     status += " - Scripts: " + String(availableScripts.size());
     status += " - Clients: " + String(WiFi.softAPgetStationNum());
@@ -145,7 +191,7 @@ void setupWebServer() {
     } else {
       ledEnabled = !ledEnabled;
     }
-    preferences.putBool("led_enabled", ledEnabled);
+    markSettingDirty(SETTING_LED);
 
     if (ledEnabled) {
       setLEDMode(0);
@@ -173,7 +219,7 @@ void setupWebServer() {
     }
 
     loggingEnabled = doc["enabled"];
-    preferences.putBool("logging_enabled", loggingEnabled);
+    markSettingDirty(SETTING_LOGGING);
     server.send(200, "text/plain; charset=utf-8", "Logging " + String(loggingEnabled ? "enabled" : "disabled"));
   });
 
@@ -182,7 +228,7 @@ void setupWebServer() {
     DynamicJsonDocument doc(256);
     if (!deserializeJson(doc, body)) {
       wifiToggleEnabled = doc["enabled"];
-      preferences.putBool("wifi_toggle", wifiToggleEnabled);
+      markSettingDirty(SETTING_WIFI_TOGGLE);
       if (wifiToggleEnabled) setupAP(); else stopAP();
     }
     server.send(200, "application/json", "{\"enabled\":" + String(wifiToggleEnabled ? "true" : "false") + "}");
@@ -193,7 +239,7 @@ void setupWebServer() {
     DynamicJsonDocument doc(256);
     if (!deserializeJson(doc, body)) {
       bluetoothToggleEnabled = doc["enabled"];
-      preferences.putBool("bt_toggle", bluetoothToggleEnabled);
+      markSettingDirty(SETTING_BT_TOGGLE);
       if (bluetoothToggleEnabled) setupBT(); else stopBT();
     }
     server.send(200, "application/json", "{\"enabled\":" + String(bluetoothToggleEnabled ? "true" : "false") + "}");
@@ -204,7 +250,7 @@ void setupWebServer() {
     DynamicJsonDocument doc(256);
     if (!deserializeJson(doc, body)) {
       btDiscoveryEnabled = doc["enabled"];
-      preferences.putBool("bt_discovery", btDiscoveryEnabled);
+      markSettingDirty(SETTING_BT_DISCOVERY);
     }
     server.send(200, "application/json", "{\"enabled\":" + String(btDiscoveryEnabled ? "true" : "false") + "}");
   });
@@ -215,7 +261,7 @@ void setupWebServer() {
     DynamicJsonDocument doc(256);
     if (!deserializeJson(doc, body)) {
       bluetoothName = doc["name"].as<String>();
-      preferences.putString("bt_name", bluetoothName);
+      markSettingDirty(SETTING_BT_NAME);
     }
     server.send(200, "text/plain", "OK");
   });
@@ -231,12 +277,8 @@ void setupWebServer() {
       currentUSBConfig.mfr = doc["mfr"].as<String>();
       currentUSBConfig.prod = doc["prod"].as<String>();
 
-      preferences.putString("usb_vid", currentUSBConfig.vid);
-      preferences.putString("usb_pid", currentUSBConfig.pid);
-      preferences.putBool("usb_rndVid", currentUSBConfig.rndVid);
-      preferences.putBool("usb_rndPid", currentUSBConfig.rndPid);
-      preferences.putString("usb_mfr", currentUSBConfig.mfr);
-      preferences.putString("usb_prod", currentUSBConfig.prod);
+      markSettingDirty(SETTING_USB);
+      commitSettings();
       
       server.send(200, "text/plain", "USB settings saved. Rebooting for changes to take effect...");
       delay(1000);
@@ -252,12 +294,20 @@ void setupWebServer() {
     server.send(200, "text/plain", "AP stopped. You may lose connection if not connected to another WiFi.");
   });
 
+  server.on("/api/bt-devices", []() {
+    server.send(200, "application/json", getBTDevicesJson());
+  });
+
   server.on("/api/tasks", []() {
     String json = "[";
-    for (size_t i = 0; i < activeTasks.size(); i++) {
-      if (i > 0) json += ",";
-      json += "{\"id\":" + String(activeTasks[i].id) + ",\"description\":\"" + activeTasks[i].description + "\"}";
-    }
+    bool first = true;
+    auto addTask = [&](const BackgroundTask& task) {
+      if (!first) json += ",";
+      first = false;
+      json += "{\"id\":" + String(task.id) + ",\"description\":\"" + task.description + "\"}";
+    };
+    for (const BackgroundTask& task : activeTasks) addTask(task);
+    for (auto const& [id, task] : getTimedTasks()) addTask(task);
     json += "]";
     server.send(200, "application/json", json);
   });
@@ -267,9 +317,14 @@ void setupWebServer() {
     DynamicJsonDocument doc(256);
     if (!deserializeJson(doc, body)) {
       int id = doc["id"];
+      if (cancelTimedTask(id)) {
+        server.send(200, "text/plain", "Task cancelled");
+        return;
+      }
       for (auto it = activeTasks.begin(); it != activeTasks.end(); ++it) {
         if (it->id == id) {
           activeTasks.erase(it);
+          activeTasksChanged = true;
           server.send(200, "text/plain", "Task cancelled");
           return;
         }
@@ -280,6 +335,7 @@ void setupWebServer() {
 
 
   server.on("/api/scripts", []() {
+    ensureAvailableScripts();
     String json = "[";
     for (size_t i = 0; i < availableScripts.size(); i++) {
       if (i > 0) json += ",";
@@ -290,6 +346,7 @@ void setupWebServer() {
   });
 
   server.on("/api/languages", []() {
+    ensureAvailableLanguages();
     String json = "[";
     for (size_t i = 0; i < availableLanguages.size(); i++) {
       if (i > 0) json += ",";
@@ -299,6 +356,15 @@ void setupWebServer() {
     server.send(200, "application/json; charset=utf-8", json);
   });
 
+  server.on("/api/search", []() {
+    if (!server.hasArg("q")) {
+      server.send(400, "text/plain; charset=utf-8", "No query specified");
+      return;
+    }
+    int limit = server.hasArg("limit") ? server.arg("limit").toInt() : SEARCH_MAX_RESULTS;
+    server.send(200, "application/json; charset=utf-8", searchScriptsJson(server.arg("q"), limit));
+  });
+
   server.on("/api/load", []() {
     if (server.hasArg("file")) {
       String filename = server.arg("file");
@@ -346,6 +412,18 @@ void setupWebServer() {
     }
   });
 
+  server.on("/api/pack-library", HTTP_POST, []() {
+    DynamicJsonDocument doc(256);
+    if (deserializeJson(doc, server.arg("plain"))) {
+      server.send(400, "text/plain; charset=utf-8", "Invalid JSON");
+      return;
+    }
+    String message;
+    bool packed = packScriptLibrary(doc["name"] | "library", doc["removeLoose"] | false, message);
+    server.send(packed ? 200 : 500, "application/json",
+                "{\"success\":" + String(packed ? "true" : "false") + ",\"message\":\"" + message + "\"}");
+  });
+
   server.on("/api/check-file", []() {
     if (server.hasArg("file")) {
       String filename = server.arg("file");
@@ -372,7 +450,7 @@ void setupWebServer() {
     if (type == "language") {
       String newLang = doc["language"].as<String>();
       if (loadLanguage(newLang)) {
-        saveSettings();
+        markSettingDirty(SETTING_LANGUAGE);
         server.send(200, "text/plain; charset=utf-8", "Language applied: " + newLang);
       } else {
         server.send(500, "text/plain; charset=utf-8", "Failed to load language file");
@@ -395,7 +473,8 @@ void setupWebServer() {
     ap_ssid = doc["ssid"].as<String>();
     ap_password = doc["password"].as<String>();
     wifiScanTime = doc["scanTime"];
-    saveSettings();
+    markSettingDirty(SETTING_AP | SETTING_SCAN_TIME);
+    commitSettings();
 
     server.send(200, "text/plain; charset=utf-8", "WiFi settings saved. Rebooting...");
     delay(1000);
@@ -419,7 +498,7 @@ void setupWebServer() {
 
     for (JsonVariant v : files) {
       String filename = v.as<String>();
-      if (SD.exists(String(DIR_SCRIPTS) + "/" + filename)) {
+      if (scriptExists(filename)) {
         currentBootScriptFiles.push_back(filename);
         if (prefString.length() > 0) prefString += ",";
         prefString += filename;
@@ -429,11 +508,11 @@ void setupWebServer() {
 
     if (currentBootScriptFiles.size() > 0) {
       bootModeEnabled = true;
-      preferences.putString("boot_script", prefString);
+      markSettingDirty(SETTING_BOOT_SCRIPT);
       server.send(200, "text/plain; charset=utf-8", "Boot scripts set: " + prefString);
     } else {
       bootModeEnabled = false;
-      preferences.remove("boot_script");
+      markSettingDirty(SETTING_BOOT_SCRIPT);
       server.send(200, "text/plain; charset=utf-8", "Boot scripts disabled");
     }
   });
@@ -450,9 +529,11 @@ void setupWebServer() {
 
     String filename = doc["filename"].as<String>();
 
-    if (SD.exists(String(DIR_SCRIPTS) + "/" + filename)) {
-      String script = loadScript(filename);
-      executeScript(script);
+    if (scriptExists(filename)) {
+      if (queueScriptFileJob("test", filename, SCRIPT_PRIORITY_NORMAL) < 0) {
+        server.send(503, "text/plain; charset=utf-8", "Script queue full");
+        return;
+      }
       server.send(200, "text/plain; charset=utf-8", "Testing boot script: " + filename);
     } else {
       server.send(404, "text/plain; charset=utf-8", "Script file not found");
@@ -490,6 +571,16 @@ void setupWebServer() {
     doc["btDiscoveryEnabled"] = btDiscoveryEnabled;
     doc["autoConnectEnabled"] = autoConnectEnabled;
     doc["saveOnConnectEnabled"] = saveOnConnectEnabled;
+    doc["uploadBytes"] = lastUpload.bytes;
+    doc["uploadMs"] = lastUpload.durationMs;
+    doc["uploadKBps"] = lastUpload.kbps;
+    doc["freePsram"] = ESP.getFreePsram();
+    doc["scriptCache"] = serialized(getScriptCacheStatsJson());
+    doc["clock"] = serialized(getClockStatusJson());
+    doc["scriptArena"] = serialized(getScriptArenaStatsJson());
+    doc["rower"] = serialized(getRowerStatsJson());
+    doc["scriptLibrary"] = serialized(getScriptLibraryStatsJson());
+    doc["search"] = serialized(getSearchIndexStatsJson());
     // Delay progress (0-100)
     if (currentDelayTotal > 0) {
       unsigned long elapsed = millis() - currentDelayStart;
@@ -511,6 +602,7 @@ void setupWebServer() {
 
 
   server.on("/api/history", []() {
+    ensureCommandHistory();
     String json = "[";
     for (size_t i = 0; i < commandHistory.size(); i++) {
       if (i > 0) json += ",";
@@ -527,6 +619,7 @@ void setupWebServer() {
   });
 
   server.on("/api/export-history", []() {
+    ensureCommandHistory();
     String historyContent = "";
     for (String cmd : commandHistory) {
       historyContent += cmd + "\n";
@@ -534,6 +627,10 @@ void setupWebServer() {
     server.send(200, "text/plain", historyContent);
   });
 
+  server.on("/api/boot-report", []() {
+    server.send(200, "application/json", getBootReportJson());
+  });
+
   server.on("/api/clear-errors", HTTP_POST, []() {
     clearErrors();
     server.send(200, "text/plain; charset=utf-8", "Error log cleared");
@@ -546,9 +643,10 @@ void setupWebServer() {
     ESP.restart();
   });
 
+  // Static analysis: per-line diagnostics, metrics and the dry-run estimate
   server.on("/api/validate-script", HTTP_POST, []() {
     String body = server.arg("plain");
-    DynamicJsonDocument doc(4096);
+    DynamicJsonDocument doc(body.length() + 512);
     DeserializationError error = deserializeJson(doc, body);
 
     if (error) {
@@ -556,54 +654,29 @@ void setupWebServer() {
       return;
     }
 
-    String script = doc["script"].as<String>();
-    int lineCount = 0;
-    int errCount = 0;
-    String errs = "";
-
-    std::vector<String> lines;
-    int startIndex = 0;
-    int endIndex = script.indexOf('\n');
+    server.send(200, "application/json", analyzeScriptJson(doc["script"].as<String>()));
+  });
 
-    while (endIndex != -1) {
-      String line = script.substring(startIndex, endIndex);
-      line.trim();
-      if (line.length() > 0 && !line.startsWith("REM") && !line.startsWith("//")) {
-        lines.push_back(line);
-      }
-      startIndex = endIndex + 1;
-      endIndex = script.indexOf('\n', startIndex);
-    }
-    if (startIndex < script.length()) {
-      String line = script.substring(startIndex);
-      line.trim();
-      if (line.length() > 0 && !line.startsWith("REM") && !line.startsWith("//")) {
-        lines.push_back(line);
-      }
+  // Dry run: {"script": "..."} or {"file": "name"}, optional "keyDelay" override
+  server.on("/api/simulate", HTTP_POST, []() {
+    String body = server.arg("plain");
+    DynamicJsonDocument doc(body.length() + 512);
+    if (deserializeJson(doc, body)) {
+      server.send(400, "text/plain; charset=utf-8", "Invalid JSON");
+      return;
     }
-
-    lineCount = lines.size();
-
-    for (String line : lines) {
-      if (line.startsWith("STRING ") && line.length() == 7) {
-        errs += "Empty STRING command\\n";
-        errCount++;
-      }
-      if (line.startsWith("DELAY ") && line.substring(6).toInt() <= 0) {
-        errs += "Invalid DELAY value\\n";
-        errCount++;
-      }
-      if (line.startsWith("REPEAT ") && line.substring(7).toInt() <= 0) {
-        errs += "Invalid REPEAT count\\n";
-        errCount++;
+    int keyDelay = doc.containsKey("keyDelay") ? doc["keyDelay"].as<int>() : -1;
+    CompiledScriptPtr compiled;
+    if (doc.containsKey("file")) {
+      compiled = getCachedScript(doc["file"].as<String>());
+      if (!compiled) {
+        server.send(404, "application/json", "{\"success\":false,\"message\":\"Script not found\"}");
+        return;
       }
-    }
-
-    if (errCount == 0) {
-      server.send(200, "text/plain; charset=utf-8", "Script validation passed! " + String(lineCount) + " commands found.");
     } else {
-      server.send(200, "text/plain; charset=utf-8", "Script validation found " + String(errCount) + " issues:\\n" + errs);
+      compiled = compileScript(doc["script"].as<String>());
     }
+    server.send(200, "application/json", simulateScriptJson(linkScriptImports(compiled), keyDelay));
   });
 
   // Trigger async WiFi scan — returns immediately, results via /api/scan-results
@@ -622,7 +695,7 @@ void setupWebServer() {
     if (done) {
       for (size_t i = 0; i < availableSSIDs.size(); i++) {
         if (i > 0) json += ",";
-        json += "{\"ssid\":\"" + availableSSIDs[i] + "\",\"rssi\":0}";
+        json += "{\"ssid\":\"" + availableSSIDs[i] + "\",\"rssi\":" + String(getSSIDRssi(availableSSIDs[i])) + "}";
       }
       logDebug("HTTP: /api/scan-results — done, " + String(availableSSIDs.size()) + " networks");
     }
@@ -711,7 +784,7 @@ void setupWebServer() {
     DynamicJsonDocument doc(128);
     if (!deserializeJson(doc, body) && doc.containsKey("enabled")) {
       autoConnectEnabled = doc["enabled"];
-      preferences.putBool("autoconnect", autoConnectEnabled);
+      markSettingDirty(SETTING_AUTOCONNECT);
     }
     server.send(200, "application/json", "{\"enabled\":" + String(autoConnectEnabled ? "true" : "false") + "}");
   });
@@ -721,7 +794,7 @@ void setupWebServer() {
     DynamicJsonDocument doc(128);
     if (!deserializeJson(doc, body) && doc.containsKey("enabled")) {
       saveOnConnectEnabled = doc["enabled"];
-      preferences.putBool("save_creds", saveOnConnectEnabled);
+      markSettingDirty(SETTING_SAVE_CREDS);
     }
     server.send(200, "application/json", "{\"enabled\":" + String(saveOnConnectEnabled ? "true" : "false") + "}");
   });
@@ -309,6 +309,9 @@ let languagesDiscovered = false;
 let globalDeclaredVars = new Set();
 let globalDeclaredFunctions = new Set();
 let ignoredWarnings = new Set();
+let deviceDiagnostics = new Map(); // Line index -> diagnostic from /api/validate-script
+let deviceValidatedScript = null;
+let deviceValidateTimer = null;
 
 function toggleExample(el) {
     el.classList.toggle('active');
@@ -591,7 +594,7 @@ const VALID_KEYWORDS = new Set([
     'UPARROW', 'DOWNARROW', 'LEFTARROW', 'RIGHTARROW', 'UP', 'DOWN', 'LEFT', 'RIGHT', 'ESCAPE', 'DEL', 'WINDOWS', 'CONTROL', 'NUMLOCK', 'FROM', 'TO', 'STEP', 'LOCALE',
     'VID_', 'PID_', 'MAN_', 'PRODUCT_', 'LED_BLINK', 'BLINK_STOP', 'RUN_ON_REBOOT', 'END_RUN_ON_REBOOT', 'BLUETOOTH_DISCOVERY', 
     'RUN_WHEN_BLUETOOTH_FOUND', 'RUN_WHEN_BT_FOUND', 'BT_FOUND',
-    'RANDOM_VID', 'RANDOM_PID', 'RANDOM_MAN', 'RANDOM_PRODUCT', 'SET_BOOT_SCRIPT'
+    'RANDOM_VID', 'RANDOM_PID', 'RANDOM_MAN', 'RANDOM_PRODUCT', 'SET_BOOT_SCRIPT', 'LOCAL', 'RETURN', 'IMPORT'
 ]);
 
 
@@ -717,9 +720,12 @@ function updateErrorLens() {
             'IF', 'ELIF', 'FOR', 'FUNCTION', 'DEF_', 'HOLD', 'KEYCODE',
             'DOWNLOAD_FILE', 'UPLOAD_FILE', 'JOIN_INTERNET', 'IF_PRESENT', 'IF_NOTPRESENT',
             'IF_BT_PRESENT', 'IF_OS', 'IF_DETECT_OS_INCLUDES', 'RUN_AT_TIME', 'RUN_AT_DAY',
-            'WAIT_FOR_EVENT', 'RUN_WHEN_WIFI', 'LOCALE'
+            'WAIT_FOR_EVENT', 'RUN_WHEN_WIFI', 'LOCALE', 'IMPORT'
         ];
 
+        // Functions from IMPORTed modules live on the SD card; the device check resolves those calls
+        const hasImports = lines.some(l => /^IMPORT\s/i.test(l.trim()));
+
         // Pass 1: Collect definitions
         lines.forEach((line) => {
             const trimmed = line.trim();
@@ -756,6 +762,15 @@ function updateErrorLens() {
 
             const forLoopMatch = trimmed.match(/^FOR\s+\$([a-zA-Z0-9_]+)/i);
             if (forLoopMatch) globalDeclaredVars.add(forLoopMatch[1].toUpperCase());
+
+            // FUNCTION parameters and LOCAL slots
+            const paramMatch = trimmed.match(/^FUNCTION\s+[a-zA-Z0-9_]+\s*\((.*)\)\s*$/i);
+            if (paramMatch) {
+                paramMatch[1].split(',').map(p => p.trim().replace(/^\$/, '')).filter(p => p)
+                    .forEach(p => globalDeclaredVars.add(p.toUpperCase()));
+            }
+            const localMatch = trimmed.match(/^LOCAL\s+\$?([a-zA-Z0-9_]+)/i);
+            if (localMatch) globalDeclaredVars.add(localMatch[1].toUpperCase());
         });
 
         // Pass 2: Validation
@@ -911,7 +926,7 @@ function updateErrorLens() {
                         }
                     } else if (cmd === 'SELFDESTRUCT') {
                         if (!ignoredWarnings.has(`${i}-DANGER`)) errorMsg = makeWarning(`Dangerous command: This will trigger a device event immediately.`, 'DANGER', i);
-                    } else if (trimmed.includes('=') && !upper.startsWith('IF') && !upper.startsWith('ELIF') && !upper.startsWith('FOR') && !upper.startsWith('WHILE')) {
+                    } else if (trimmed.includes('=') && !upper.startsWith('IF') && !upper.startsWith('ELIF') && !upper.startsWith('FOR') && !upper.startsWith('WHILE') && cmd !== 'LOCAL') {
                         const name = trimmed.split('=')[0].trim().toUpperCase();
                         const afterEquals = trimmed.split('=')[1].trim();
                         if (!afterEquals && !ignoredWarnings.has(`${i}-${name}`)) {
@@ -924,9 +939,9 @@ function updateErrorLens() {
                             errorMsg = makeError(`Variable '${name}' is used before being declared.`);
                         }
                         processedVars.add(name);
-                    } else if (trimmed.endsWith('()')) {
-                        const fName = trimmed.replace('()', '').trim().toUpperCase();
-                        if (!globalDeclaredFunctions.has(fName)) errorMsg = makeError(`Call to undefined function: '${fName}()'`);
+                    } else if (/^[a-zA-Z0-9_]+\s*\(.*\)$/.test(trimmed)) {
+                        const fName = trimmed.substring(0, trimmed.indexOf('(')).trim().toUpperCase();
+                        if (!globalDeclaredFunctions.has(fName) && !hasImports) errorMsg = makeError(`Call to undefined function: '${fName}()'`);
                     } else {
                         // FALLBACK: Unknown command or variable check
                         const isPrefixCmd = /^(VID_|PID_|MAN_|PRODUCT_|HOLD_|HOLD_TILL_)/.test(cmd);
@@ -970,6 +985,13 @@ function updateErrorLens() {
                     }
                 }
 
+            // Device-side analysis (keymap, compile pass) only applies to the text it saw
+            if (!errorMsg && deviceValidatedScript === scriptArea.value) {
+                const dd = deviceDiagnostics.get(i);
+                if (dd && dd.severity === 'error') errorMsg = makeError(dd.message);
+                else if (dd && dd.severity === 'warning' && !ignoredWarnings.has(`${i}-DEVICE`)) errorMsg = makeWarning(dd.message, 'DEVICE', i);
+            }
+
             const hlLine = applyHighlighting(line);
             
             // Check for block-level error (Unclosed Function)
@@ -1055,9 +1077,33 @@ function updateErrorLens() {
             const hasFixable = errors.some(e => e.fixable);
             fixAllBtn.style.display = hasFixable ? 'block' : 'none';
         }
+        scheduleDeviceValidation();
     } catch (e) { console.error("Validator Crash:", e); }
 }
 
+// Runs the device's static analyzer once typing settles; results feed updateErrorLens
+function scheduleDeviceValidation() {
+    const script = document.getElementById('scriptArea').value;
+    if (script === deviceValidatedScript) return;
+    clearTimeout(deviceValidateTimer);
+    deviceValidateTimer = setTimeout(() => {
+        fetch('/api/validate-script', { method: 'POST', body: JSON.stringify({ script }) })
+            .then(r => r.json())
+            .then(d => {
+                deviceDiagnostics = new Map();
+                (d.diagnostics || []).forEach(x => { if (x.line > 0 && !deviceDiagnostics.has(x.line - 1)) deviceDiagnostics.set(x.line - 1, x); });
+                deviceValidatedScript = script;
+                const counter = document.getElementById('lineCounter');
+                if (counter && d.simulation) {
+                    counter.dataset.estimate = `~${(d.simulation.estimatedMs / 1000).toFixed(1)}s`;
+                    counter.title = `${d.metrics.instructions} instructions, ${d.simulation.hidReports} HID reports, ${d.simulation.charsTyped} chars`;
+                }
+                if (document.getElementById('scriptArea').value === script) updateErrorLens();
+            })
+            .catch(() => {});
+    }, 1500);
+}
+
 function jumpToLine(lineIdx) {
     if (lineIdx < 0) return;
     const scriptArea = document.getElementById('scriptArea');
@@ -1206,8 +1252,58 @@ function executeScript() {
     const script = document.getElementById('scriptArea').value.trim();
     if (!script) return;
     const statusEl = document.getElementById('scriptStatus');
-    statusEl.textContent = 'Executing...';
-    fetch('/execute', { method: 'POST', body: script }).then(r => { statusEl.textContent = r.ok ? 'Script Finished' : 'Execution Failed'; });
+    statusEl.textContent = 'Queuing...';
+    fetch('/execute', { method: 'POST', body: script })
+        .then(r => r.json())
+        .then(d => {
+            if (!d.success) { statusEl.textContent = d.message || 'Execution Failed'; return; }
+            statusEl.textContent = `Queued as job #${d.jobId}`;
+            watchScriptJob(d.jobId, statusEl);
+        })
+        .catch(() => { statusEl.textContent = 'Execution Failed'; });
+}
+
+function watchScriptJob(id, statusEl) {
+    fetch('/api/script-jobs').then(r => r.json()).then(jobs => {
+        const job = jobs.find(j => j.id === id);
+        if (!job) return;
+        if (job.state === 'queued') statusEl.textContent = `Queued as job #${id} (waiting ${(job.waitMs / 1000).toFixed(1)}s)`;
+        else if (job.state === 'running') statusEl.textContent = 'Executing...';
+        else {
+            const labels = { done: 'Script Finished', failed: 'Execution Failed', cancelled: 'Script Cancelled' };
+            statusEl.textContent = `${labels[job.state]} (${(job.latencyMs / 1000).toFixed(1)}s end-to-end)`;
+            return;
+        }
+        setTimeout(() => watchScriptJob(id, statusEl), 1000);
+    }).catch(() => setTimeout(() => watchScriptJob(id, statusEl), 2000));
+}
+
+function simulateScript() {
+    const script = document.getElementById('scriptArea').value;
+    const out = document.getElementById('simulationResult');
+    if (!script.trim()) { out.style.display = 'none'; return; }
+    out.style.display = 'block';
+    out.textContent = 'Simulating...';
+    fetch('/api/simulate', { method: 'POST', body: JSON.stringify({ script }) })
+        .then(r => r.json())
+        .then(d => {
+            if (!d.success) { out.textContent = d.message || 'Simulation failed'; return; }
+            // Offsets are UTF-8 byte positions in the source; map them to editor lines
+            const bytes = new TextEncoder().encode(script);
+            const lineAt = (offset) => { let n = 0; for (let i = 0; i < offset && i < bytes.length; i++) if (bytes[i] === 10) n++; return n; };
+            const notes = [];
+            if (d.truncated) notes.push('stopped after ' + d.steps + ' steps (runaway loop?)');
+            if (d.assumedBranches) notes.push(d.assumedBranches + ' IF branch(es) assumed taken');
+            if (d.externalCommands) notes.push(d.externalCommands + ' network/file command(s) not timed');
+            if (d.reboots) notes.push(d.reboots + ' USB identity reboot(s)');
+            if (d.missingKeys) notes.push(d.missingKeys + ' key(s) missing from the keymap');
+            if (d.endedAt) notes.push('script ends at line ' + d.endedAt);
+            let html = `<div class="issue-item"><div class="issue-text">~${(d.estimatedMs / 1000).toFixed(1)}s total (typing ${(d.typingMs / 1000).toFixed(1)}s, waits ${(d.waitMs / 1000).toFixed(1)}s, default delay ${(d.defaultDelayMs / 1000).toFixed(1)}s) · ${d.hidReports} HID reports · ${d.charsTyped} chars · ${d.keyPresses} key presses${notes.length ? '<br>' + notes.join(' · ') : ''}</div></div>`;
+            html += d.longestWaits.map(w => { const l = lineAt(w.offset); return `<div class="issue-item warning-item" onclick="jumpToLine(${l})"><div class="issue-text">Line ${l + 1}: ${(w.totalMs / 1000).toFixed(1)}s waiting${w.count > 1 ? ` over ${w.count} runs` : ''}</div></div>`; }).join('');
+            html += d.unboundedWaits.map(w => { const l = lineAt(w.offset); return `<div class="issue-item error-item" onclick="jumpToLine(${l})"><div class="issue-text">Line ${l + 1}: waits for an external event (unbounded)</div></div>`; }).join('');
+            out.innerHTML = html;
+        })
+        .catch(() => { out.textContent = 'Simulation failed'; });
 }
 
 function stopScript() { fetch('/stop', { method: 'POST' }); }
@@ -1248,6 +1344,7 @@ function updateStats() {
         set('uptime', data.uptime + 's');
         set('freeMemory', Math.round(data.freeMemory / 1024) + ' KB');
         set('lastError', data.lastError || 'None');
+        if (data.uploadBytes > 0) set('uploadRate', `${Math.round(data.uploadBytes / 1024)} KB @ ${data.uploadKBps.toFixed(1)} KB/s`);
 
         // Update WiFi Status
         const wifiStatusEl = document.getElementById('wifiStatus');
@@ -1854,7 +1951,7 @@ function setupCustomScrollbar(contentId, trackId, thumbId) {
             syncHighlightsScroll();
             const lines = content.value.split('\n').length;
             const counter = document.getElementById('lineCounter');
-            if (counter) counter.textContent = `${lines} Line${lines !== 1 ? 's' : ''}`;
+            if (counter) counter.textContent = `${lines} Line${lines !== 1 ? 's' : ''}${counter.dataset.estimate ? ' · ' + counter.dataset.estimate : ''}`;
         }
     }
 
@@ -1,6 +1,8 @@
 #include "WiFiManager.h"
 #include "LogManager.h"
+#include "ClockManager.h"
 #include <HTTPClient.h>
+#include <unordered_map>
 
 // ============================================================
 // AP Management
@@ -27,6 +29,85 @@ void stopAP() {
   logDebug("AP stopped");
 }
 
+// ============================================================
+// Scan cache — one SSID hash set shared by scripts, automation and the UI
+// ============================================================
+struct StringHash {
+  size_t operator()(const String& s) const {
+    uint32_t h = 2166136261u;
+    for (const char* p = s.c_str(); *p; p++) h = (h ^ (uint8_t)*p) * 16777619u;
+    return h;
+  }
+};
+
+struct SeenNetwork {
+  int rssi;
+  unsigned long seenAt;
+};
+
+static std::unordered_map<String, SeenNetwork, StringHash> seenNetworks;
+static unsigned long lastScanCompletedAt = 0;
+static unsigned long lastScanDuration = 0;
+static bool haveScanResults = false;
+
+// Watched SSIDs: -1 unknown, 0 absent, 1 present. Changes go to the callback.
+static std::unordered_map<String, int, StringHash> watchedSSIDs;
+static SSIDChangeCallback ssidChangeCallback = nullptr;
+
+static void storeScanResults(int n) {
+  availableSSIDs.clear();
+  seenNetworks.clear();
+  unsigned long now = millis();
+  for (int i = 0; i < n; i++) {
+    String ssid = WiFi.SSID(i);
+    int rssi = WiFi.RSSI(i);
+    auto it = seenNetworks.find(ssid);
+    if (it == seenNetworks.end()) {
+      availableSSIDs.push_back(ssid);
+      seenNetworks[ssid] = {rssi, now};
+    } else if (rssi > it->second.rssi) {
+      it->second.rssi = rssi;  // Strongest BSSID wins
+    }
+  }
+  lastScanCompletedAt = now;
+  haveScanResults = true;
+
+  for (auto& [ssid, state] : watchedSSIDs) {
+    int present = seenNetworks.count(ssid) ? 1 : 0;
+    if (present == state) continue;
+    state = present;
+    if (ssidChangeCallback) ssidChangeCallback(ssid, present == 1);
+  }
+}
+
+// wifiScanTime (the "scan time" setting) is the cache TTL
+bool wifiScanFresh() {
+  return haveScanResults && millis() - lastScanCompletedAt < (unsigned long)wifiScanTime;
+}
+
+void setSSIDChangeCallback(SSIDChangeCallback cb) {
+  ssidChangeCallback = cb;
+}
+
+void setWatchedSSIDs(const std::vector<String>& ssids) {
+  std::unordered_map<String, int, StringHash> next;
+  for (const String& ssid : ssids) {
+    auto it = watchedSSIDs.find(ssid);
+    next[ssid] = (it != watchedSSIDs.end()) ? it->second : -1;
+  }
+  watchedSSIDs.swap(next);
+}
+
+// Only answers from a scan within the TTL; callers that need an answer now run scanWiFi() first
+bool isSSIDPresent(String ssid) {
+  return wifiScanFresh() && seenNetworks.count(ssid) > 0;
+}
+
+int getSSIDRssi(String ssid) {
+  auto it = seenNetworks.find(ssid);
+  return (it != seenNetworks.end()) ? it->second.rssi : 0;
+}
+
 // ============================================================
 // Async WiFi Scan — safe to run while AP is active (AP_STA mode)
 // ============================================================
@@ -53,10 +134,9 @@ void startWiFiScan() {
     return;
   }
 
+  // The previous results stay readable until this scan replaces them
   wifiScanStarted = true;
   wifiScanStartedAt = millis();
-  availableSSIDs.clear();
-  Serial.println("[WiFi] Async scan started");
   logDebug("WiFi async scan started");
 }
 
@@ -64,9 +144,23 @@ bool wifiScanComplete() {
   return !wifiScanStarted;
 }
 
-// Called every loop() tick — collects async scan results without blocking
+// Age at which a watched cache is rescanned: early enough that the new results land
+// before the TTL runs out, so IF_PRESENT never has to fall back to a blocking scan
+static unsigned long rescanAge() {
+  unsigned long interval = min((unsigned long)WIFI_SCAN_INTERVAL, (unsigned long)max(wifiScanTime, 0));
+  return interval > lastScanDuration ? interval - lastScanDuration : 0;
+}
+
+// Called every loop() tick — collects async scan results without blocking, and
+// rescans on its own cadence while anything is watching an SSID
 void pollWiFiScan() {
-  if (!wifiScanStarted) return;
+  if (!wifiScanStarted) {
+    if (!watchedSSIDs.empty() && !wifiJoining &&
+        (!haveScanResults || millis() - lastScanCompletedAt >= rescanAge())) {
+      startWiFiScan();
+    }
+    return;
+  }
 
   int n = WiFi.scanComplete();
   if (n == WIFI_SCAN_RUNNING) {
@@ -81,26 +175,32 @@ void pollWiFiScan() {
   }
 
   // n == WIFI_SCAN_FAILED or >= 0: scan done
-  availableSSIDs.clear();
-  if (n > 0) {
-    for (int i = 0; i < n; i++) {
-      String ssid = WiFi.SSID(i);
-      int rssi = WiFi.RSSI(i);
-      availableSSIDs.push_back(ssid);
-      Serial.println("[WiFi] Found: " + ssid + " (" + String(rssi) + " dBm)");
-    }
-  } else {
+  if (n < 0) {
     Serial.println("[WiFi] Scan complete — no networks found (n=" + String(n) + ")");
+    n = 0;
   }
+  storeScanResults(n);
+  lastScanDuration = millis() - wifiScanStartedAt;
   logDebug("WiFi scan done, found: " + String(availableSSIDs.size()) + " networks");
   WiFi.scanDelete();
   wifiScanStarted = false;
 }
 
 // ============================================================
-// Blocking scan — used during DuckyScript IF_PRESENT commands
+// Blocking scan — used during DuckyScript IF_PRESENT commands.
+// Returns straight away while the cache is within its TTL.
 // ============================================================
 void scanWiFi() {
+  if (wifiScanFresh()) return;
+
+  // Let a running async scan finish rather than fighting it for the radio
+  unsigned long waitStart = millis();
+  while (wifiScanStarted && millis() - waitStart < 10000) {
+    pollWiFiScan();
+    delay(50);
+  }
+  if (wifiScanFresh()) return;
+
   Serial.println("[WiFi] Blocking scan (during script)...");
   logDebug("WiFi blocking scan started");
 
@@ -108,7 +208,6 @@ void scanWiFi() {
   WiFi.scanDelete();
   int n = WiFi.scanNetworks(/*async=*/false, /*show_hidden=*/false);
 
-  availableSSIDs.clear();
   if (n == WIFI_SCAN_FAILED || n < 0) {
     Serial.println("[WiFi] Blocking scan failed");
     lastError = "WiFi scan failed";
@@ -116,21 +215,12 @@ void scanWiFi() {
     logDebug("WiFi blocking scan FAILED (n=" + String(n) + ")");
     return;
   }
-  for (int i = 0; i < n; i++) {
-    availableSSIDs.push_back(WiFi.SSID(i));
-  }
+  storeScanResults(n);
   WiFi.scanDelete();
   Serial.println("[WiFi] Blocking scan done, found " + String(n) + " networks.");
   logDebug("WiFi blocking scan done, found: " + String(n));
 }
 
-bool isSSIDPresent(String ssid) {
-  for (String& s : availableSSIDs) {
-    if (s == ssid) return true;
-  }
-  return false;
-}
-
 // ============================================================
 // Non-blocking WiFi Join — creates background task
 // ============================================================
@@ -144,6 +234,7 @@ void joinWiFi(String ssid, String password) {
       if (it->type == "WIFI_JOINING") it = activeTasks.erase(it);
       else ++it;
     }
+    activeTasksChanged = true;
   }
 
   Serial.println("[WiFi] Joining network: " + ssid);
@@ -165,6 +256,7 @@ void joinWiFi(String ssid, String password) {
   task.payload = ssid;
   task.active = true;
   activeTasks.push_back(task);
+  activeTasksChanged = true;
   Serial.println("[WiFi] Join background task created (ID " + String(task.id) + ")");
 }
 
@@ -176,6 +268,7 @@ void stopJoiningWiFi() {
     if (it->type == "WIFI_JOINING") it = activeTasks.erase(it);
     else ++it;
   }
+  activeTasksChanged = true;
   Serial.println("[WiFi] Join aborted by user");
   logDebug("WiFi join aborted by user");
 }
@@ -194,25 +287,18 @@ void leaveWiFi() {
 // ============================================================
 // Utility
 // ============================================================
+// Cheap reads from ClockManager; no SNTP restart per call
 String getTime(String region) {
-  if (WiFi.status() != WL_CONNECTED) return "00:00:00";
-  
-  // Basic offset logic
-  long offset = 0;
-  if (region.equalsIgnoreCase("de")) offset = 3600; // CET (UTC+1) - neglecting DST for simplicity unless requested
-  
-  configTime(offset, 0, "pool.ntp.org", "time.nist.gov");
   struct tm timeinfo;
-  if (!getLocalTime(&timeinfo)) return "Failed to get time";
+  if (!clockLocalTime(region, clockNow(), &timeinfo)) return "00:00:00";
   char timeStr[9];
   strftime(timeStr, sizeof(timeStr), "%H:%M:%S", &timeinfo);
   return String(timeStr);
 }
 
 String getDay(String region) {
-  if (WiFi.status() != WL_CONNECTED) return "Unknown";
   struct tm timeinfo;
-  if (!getLocalTime(&timeinfo)) return "Failed to get day";
+  if (!clockLocalTime(region, clockNow(), &timeinfo)) return "Unknown";
   char dayStr[10];
   strftime(dayStr, sizeof(dayStr), "%A", &timeinfo); // %A is full weekday name
   return String(dayStr);
@@ -305,12 +391,15 @@ void processAutoConnect() {
     static unsigned long lastAutoAttempt = 0;
     if (!autoConnectEnabled || scriptRunning || wifiJoining || WiFi.status() == WL_CONNECTED) return;
     
-    // Attempt every 60 seconds
+    // Attempt every 60 seconds, from cached results; refresh them asynchronously if stale
     if (millis() - lastAutoAttempt < 60000) return;
+    if (!wifiScanFresh()) {
+        if (wifiScanComplete()) startWiFiScan();
+        return;
+    }
     lastAutoAttempt = millis();
     
     Serial.println("[WiFi] Auto-connect: Searching for saved networks...");
-    scanWiFi();
     
     String credsJson = getSavedWiFiCredentials();
     // Simple manual parsing of the mini-JSON we just built
@@ -11,6 +11,15 @@ void startWiFiScan();
 void pollWiFiScan();
 bool wifiScanComplete();
 bool isSSIDPresent(String ssid);
+int getSSIDRssi(String ssid);
+bool wifiScanFresh();
+
+// SSID watch list: while non-empty, pollWiFiScan() rescans before the cache outlives
+// its TTL (wifiScanTime, at most WIFI_SCAN_INTERVAL) and reports appeared/disappeared
+// transitions for the watched names only.
+typedef void (*SSIDChangeCallback)(const String& ssid, bool present);
+void setSSIDChangeCallback(SSIDChangeCallback cb);
+void setWatchedSSIDs(const std::vector<String>& ssids);
 void joinWiFi(String ssid, String password);
 void stopJoiningWiFi();
 void leaveWiFi();
@@ -0,0 +1,244 @@
+// Host test for ClockCore: SNTP packets against a stand-in responder, region/DST
+// rules and the cached clock. Build and run from the sketch folder:
+//   g++ -std=gnu++17 -I. tests/clock_core_test.cpp ClockCore.cpp -o clock_core_test && ./clock_core_test
+#include "ClockCore.h"
+#include <stdio.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                   \
+  do {                                                                \
+    if (!(cond)) {                                                    \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+      failures++;                                                     \
+    }                                                                 \
+  } while (0)
+
+// ============================================================
+// Stand-in NTP responder
+// ============================================================
+struct Responder {
+  uint8_t leap = 0;
+  uint8_t version = 4;
+  uint8_t mode = 4;
+  uint8_t stratum = 2;
+  uint32_t seconds = 0;   // NTP era seconds of the transmit timestamp
+  uint32_t fraction = 0;
+};
+
+static void writeU32(uint8_t* p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+// Answers a client request the way a server would; false if it is not one
+static bool respond(const Responder& r, const uint8_t* request, uint8_t* reply) {
+  if ((request[0] & 0x07) != 3) return false;
+  memset(reply, 0, SNTP_PACKET_SIZE);
+  reply[0] = (r.leap << 6) | (r.version << 3) | r.mode;
+  reply[1] = r.stratum;
+  memcpy(reply + 24, request + 40, 8);  // Originate = client transmit
+  writeU32(reply + 40, r.seconds);
+  writeU32(reply + 44, r.fraction);
+  return true;
+}
+
+static bool exchange(const Responder& r, time_t* epoch, size_t len = SNTP_PACKET_SIZE) {
+  uint8_t request[SNTP_PACKET_SIZE];
+  uint8_t reply[SNTP_PACKET_SIZE];
+  sntpBuildRequest(request);
+  if (!respond(r, request, reply)) return false;
+  return sntpParseReply(reply, len, epoch);
+}
+
+static void testSntpRequest() {
+  uint8_t request[SNTP_PACKET_SIZE];
+  memset(request, 0xAA, sizeof(request));
+  sntpBuildRequest(request);
+  CHECK(request[0] >> 6 == 0);
+  CHECK(((request[0] >> 3) & 0x07) == 4);
+  CHECK((request[0] & 0x07) == 3);
+  for (size_t i = 1; i < SNTP_PACKET_SIZE; i++) CHECK(request[i] == 0);
+}
+
+static void testSntpReply() {
+  Responder r;
+  time_t epoch = 0;
+
+  r.seconds = 1705320000UL + SNTP_UNIX_OFFSET;  // 2024-01-15 12:00:00 UTC
+  CHECK(exchange(r, &epoch));
+  CHECK(epoch == 1705320000);
+
+  r.fraction = 0x7FFFFFFFUL;  // Just under half a second rounds down
+  CHECK(exchange(r, &epoch));
+  CHECK(epoch == 1705320000);
+  r.fraction = 0x80000000UL;  // Half a second rounds up
+  CHECK(exchange(r, &epoch));
+  CHECK(epoch == 1705320001);
+
+  r = Responder();
+  r.version = 3;
+  r.seconds = 1705320000UL + SNTP_UNIX_OFFSET;
+  CHECK(exchange(r, &epoch));
+
+  // Era 1: 2040-01-01 00:00:00 UTC wraps past 2^32 NTP seconds
+  r = Responder();
+  r.seconds = (uint32_t)(2208988800ULL + SNTP_UNIX_OFFSET - 0x100000000ULL);
+  CHECK(exchange(r, &epoch));
+  CHECK(epoch == (time_t)2208988800LL);
+}
+
+static void testSntpRejects() {
+  Responder good;
+  good.seconds = 1705320000UL + SNTP_UNIX_OFFSET;
+  time_t epoch = 42;
+
+  CHECK(!exchange(good, &epoch, SNTP_PACKET_SIZE - 1));
+
+  Responder r = good;
+  r.leap = 3;  // Unsynchronized
+  CHECK(!exchange(r, &epoch));
+  r = good;
+  r.version = 2;
+  CHECK(!exchange(r, &epoch));
+  r = good;
+  r.mode = 3;  // Reflected client packet
+  CHECK(!exchange(r, &epoch));
+  r = good;
+  r.mode = 5;  // Broadcast
+  CHECK(!exchange(r, &epoch));
+  r = good;
+  r.stratum = 0;  // Kiss-o'-Death
+  CHECK(!exchange(r, &epoch));
+  r = good;
+  r.stratum = 16;
+  CHECK(!exchange(r, &epoch));
+  r = good;
+  r.seconds = 0;
+  CHECK(!exchange(r, &epoch));
+
+  CHECK(epoch == 42);  // Untouched by rejected replies
+}
+
+// ============================================================
+// Regions
+// ============================================================
+static void testRegionOffsets() {
+  const time_t winter = 1705320000;  // 2024-01-15 12:00 UTC
+  const time_t summer = 1721044800;  // 2024-07-15 12:00 UTC
+
+  CHECK(regionUtcOffset("", summer) == 0);
+  CHECK(regionUtcOffset("utc", summer) == 0);
+  CHECK(regionUtcOffset("us", summer) == 0);
+  CHECK(regionUtcOffset("mars", summer) == 0);
+  CHECK(regionUtcOffset("DE", summer) == 0);  // Matched as given
+
+  CHECK(regionUtcOffset("de", winter) == 3600);
+  CHECK(regionUtcOffset("de", summer) == 7200);
+  CHECK(regionUtcOffset("uk", winter) == 0);
+  CHECK(regionUtcOffset("uk", summer) == 3600);
+  CHECK(regionUtcOffset("us-east", winter) == -5 * 3600);
+  CHECK(regionUtcOffset("us-east", summer) == -4 * 3600);
+  CHECK(regionUtcOffset("us-central", summer) == -5 * 3600);
+  CHECK(regionUtcOffset("us-mountain", winter) == -7 * 3600);
+  CHECK(regionUtcOffset("us-pacific", summer) == -7 * 3600);
+}
+
+static void testDstBoundaries() {
+  // EU: 2024-03-31 01:00 UTC to 2024-10-27 01:00 UTC
+  const time_t euStart = 1711846800;
+  const time_t euEnd = 1729990800;
+  CHECK(regionUtcOffset("de", euStart - 1) == 3600);
+  CHECK(regionUtcOffset("de", euStart) == 7200);
+  CHECK(regionUtcOffset("de", euEnd - 1) == 7200);
+  CHECK(regionUtcOffset("de", euEnd) == 3600);
+  CHECK(regionUtcOffset("uk", euStart - 1) == 0);
+  CHECK(regionUtcOffset("uk", euStart) == 3600);
+  CHECK(regionUtcOffset("uk", euEnd) == 0);
+
+  // US: 2024-03-10 02:00 local standard to 2024-11-03 02:00 local daylight
+  const time_t eastStart = 1710054000;  // 07:00 UTC
+  const time_t eastEnd = 1730613600;    // 06:00 UTC
+  CHECK(regionUtcOffset("us-east", eastStart - 1) == -5 * 3600);
+  CHECK(regionUtcOffset("us-east", eastStart) == -4 * 3600);
+  CHECK(regionUtcOffset("us-east", eastEnd - 1) == -4 * 3600);
+  CHECK(regionUtcOffset("us-east", eastEnd) == -5 * 3600);
+
+  const time_t pacificStart = 1710064800;  // 10:00 UTC
+  const time_t pacificEnd = 1730624400;    // 09:00 UTC
+  CHECK(regionUtcOffset("us-pacific", pacificStart - 1) == -8 * 3600);
+  CHECK(regionUtcOffset("us-pacific", pacificStart) == -7 * 3600);
+  CHECK(regionUtcOffset("us-pacific", pacificEnd - 1) == -7 * 3600);
+  CHECK(regionUtcOffset("us-pacific", pacificEnd) == -8 * 3600);
+  // Eastern has already switched while Pacific has not
+  CHECK(regionUtcOffset("us-east", pacificStart - 1) == -4 * 3600);
+}
+
+// ============================================================
+// Cached clock
+// ============================================================
+static time_t fakeTime = 0;
+static time_t fakeSource() { return fakeTime; }
+
+static void testClockCacheNow() {
+  ClockCache cache;
+
+  fakeTime = 1000;
+  CHECK(clockCacheNow(cache, fakeSource) == 1000);
+  fakeTime = 1005;
+  CHECK(clockCacheNow(cache, fakeSource) == 1005);
+
+  // Backward jitter between resyncs is held at the last value
+  fakeTime = 1003;
+  CHECK(clockCacheNow(cache, fakeSource) == 1005);
+  fakeTime = 1006;
+  CHECK(clockCacheNow(cache, fakeSource) == 1006);
+
+  // A large downward resync takes effect at once instead of freezing the clock
+  fakeTime = 1705320000;
+  CHECK(clockCacheNow(cache, fakeSource) == 1705320000);
+  fakeTime = 1705316400;  // Server says we were an hour fast
+  clockCacheResync(cache);
+  CHECK(clockCacheNow(cache, fakeSource) == 1705316400);
+  fakeTime = 1705316401;
+  CHECK(clockCacheNow(cache, fakeSource) == 1705316401);
+  fakeTime = 1705316400;
+  CHECK(clockCacheNow(cache, fakeSource) == 1705316401);
+}
+
+static void testClockCacheLocalTime() {
+  ClockCache cache;
+  struct tm t;
+
+  clockCacheLocalTime(cache, "de", 1721044800, &t);  // 2024-07-15 12:00 UTC
+  CHECK(t.tm_hour == 14 && t.tm_mday == 15 && t.tm_mon == 6);
+  clockCacheLocalTime(cache, "us-pacific", 1721044800, &t);  // Same second, new region
+  CHECK(t.tm_hour == 5);
+  clockCacheLocalTime(cache, "us-pacific", 1705320000, &t);  // 2024-01-15 12:00 UTC
+  CHECK(t.tm_hour == 4);
+
+  // A resync drops the cached breakdown along with the last returned second
+  clockCacheResync(cache);
+  CHECK(cache.cachedEpoch == -1);
+  clockCacheLocalTime(cache, "us-pacific", 1705320000, &t);
+  CHECK(t.tm_hour == 4 && t.tm_wday == 1);  // Monday
+}
+
+int main() {
+  testSntpRequest();
+  testSntpReply();
+  testSntpRejects();
+  testRegionOffsets();
+  testDstBoundaries();
+  testClockCacheNow();
+  testClockCacheLocalTime();
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("clock_core_test: all checks passed\n");
+  return 0;
+}